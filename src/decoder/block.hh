@@ -36,6 +36,7 @@
 #include "vp8_raster.hh"
 #include "safe_array.hh"
 #include "vp8_header_structures.hh"
+#include "tokens.hh"
 
 struct ProbabilityTables;
 struct Quantizer;
@@ -43,8 +44,6 @@ class BoolEncoder;
 
 enum BlockType { Y_after_Y2 = 0, Y2, UV, Y_without_Y2 };
 
-constexpr static int16_t ZERO_REF[ 16 ] = { 0 };
-
 class DCTCoefficients
 {
 private:
@@ -69,6 +68,13 @@ public:
   void idct_add( VP8Raster::Block4 & output ) const;
   void iwht( SafeArray<SafeArray<DCTCoefficients, 4>, 4> & output ) const;
 
+  /* cheaper versions for when only the DC or only the first-row coefficients
+     are nonzero; eob is one past the zigzag index of the last nonzero one */
+  void idct_add( VP8Raster::Block4 & output, const uint8_t eob ) const;
+  void idct_dc_add( VP8Raster::Block4 & output ) const;
+  void idct_row_add( VP8Raster::Block4 & output ) const;
+  void iwht( SafeArray<SafeArray<DCTCoefficients, 4>, 4> & output, const uint8_t eob ) const;
+
   void subtract_dct( const VP8Raster::Block4 & block, const TwoDSubRange< uint8_t, 4, 4 > & prediction );
   void wht( SafeArray< int16_t, 16 > & input );
 
@@ -142,6 +148,9 @@ private:
 
   bool has_nonzero_ { false };
 
+  /* one past the zigzag index of the last nonzero coefficient (16 if unknown) */
+  uint8_t eob_ { 16 };
+
   MotionVector motion_vector_ {};
 
 public:
@@ -195,6 +204,7 @@ public:
   bool coded( void ) const { static_assert( initial_block_type == Y2,
                                             "only Y2 blocks can be omitted" ); return coded_; }
   bool has_nonzero( void ) const { return has_nonzero_; }
+  uint8_t eob( void ) const { return eob_; }
 
   void set_dc_coefficient( const int16_t & val );
   DCTCoefficients dequantize( const Quantizer & quantizer ) const;
@@ -221,23 +231,59 @@ public:
   void serialize_tokens( BoolEncoder & data,
                          const ProbabilityTables & probability_tables ) const;
 
-  DCTCoefficients & mutable_coefficients( void ) { return coefficients_; }
+  DCTCoefficients & mutable_coefficients( void )
+  {
+    /* the caller may put a coefficient anywhere */
+    eob_ = 16;
+    return coefficients_;
+  }
+
   const DCTCoefficients & coefficients( void ) const { return coefficients_; }
 
   void add_residue( VP8Raster::Block4 & raster ) const;
 
+  /* dequantize and add the inverse transform to the raster, skipping the
+     work for coefficients past the end of block */
+  void dequantize_idct_add( const Quantizer & quantizer, VP8Raster::Block4 & output ) const;
+
   void calculate_has_nonzero()
   {
-    has_nonzero_ = ( memcmp( &coefficients_.at( 0 ), ZERO_REF,
-                             sizeof( ZERO_REF ) ) != 0 );
+    eob_ = 16;
+    while ( eob_ > 0 and coefficients_.at( zigzag.at( eob_ - 1 ) ) == 0 ) {
+      eob_--;
+    }
+
+    has_nonzero_ = eob_ > 0;
   }
 
   void zero_out()
   {
     has_nonzero_ = false;
+    eob_ = 0;
     coefficients_.zero_out();
   }
 
+  /* back to how a new block starts, for a frame that is parsed again.
+     Coefficients past the end of block are already zero, so a block
+     that had none isn't touched. */
+  void reset()
+  {
+    type_ = initial_block_type;
+    prediction_mode_ = {};
+    coded_ = true;
+    has_nonzero_ = false;
+    motion_vector_ = {};
+
+    if ( eob_ == 16 ) {
+      coefficients_.zero_out();
+    } else {
+      for ( uint8_t i = 0; i < eob_; i++ ) {
+        coefficients_.at( zigzag.at( i ) ) = 0;
+      }
+    }
+    eob_ = 0;
+  }
+
   bool operator==( const Block & other ) const
   {
     return type_ == other.type_ and
@@ -29,6 +29,9 @@
 #ifndef BOOL_DECODER_HH
 #define BOOL_DECODER_HH
 
+#include <cstring>
+#include <endian.h>
+
 #include "chunk.hh"
 #include "safe_array.hh"
 
@@ -47,42 +50,67 @@ class BoolDecoder
 private:
   Chunk chunk_;
 
-  uint32_t range_, value_;
-  char bit_count_;
+  /* the next undecoded bits of the chunk, most significant first. The top
+     octet is what gets compared with the split, as in the RFC 6386 decoder */
+  uint64_t value_;
+  uint32_t range_;
+
+  /* number of bits in value_ beyond the top octet */
+  int bit_count_;
+
+  /* octets shifted into value_ so far, including the zeros that stand in
+     for data past the end of the chunk */
+  uint64_t octets_loaded_;
 
-  bool valid_;
   bool complete_chunk_;
 
-  void load_octet( void )
+  static constexpr int value_bits = 64;
+
+  void fill( void )
   {
-    if ( chunk_.size() ) {
-      value_ |= chunk_.octet();
-      chunk_ = chunk_( 1 );
-    }
-    else if ( not complete_chunk_ ) {
-      valid_ = false;
+    /* whole octets that still fit below the bits we have */
+    const int octets = ( value_bits - 8 - bit_count_ ) / 8;
+    const int shift = value_bits - 8 - bit_count_ - 8 * octets;
+
+    if ( octets_loaded_ + sizeof( uint64_t ) <= chunk_.size() ) {
+      uint64_t big_endian_octets;
+      std::memcpy( &big_endian_octets, chunk_.buffer() + octets_loaded_, sizeof( uint64_t ) );
+      const uint64_t octets_value = be64toh( big_endian_octets );
+      value_ |= ( octets_value >> ( value_bits - 8 * octets ) ) << shift;
+    } else {
+      for ( int i = 0; i < octets; i++ ) {
+        if ( octets_loaded_ + i < chunk_.size() ) {
+          value_ |= uint64_t( chunk_.buffer()[ octets_loaded_ + i ] ) << ( shift + 8 * ( octets - 1 - i ) );
+        }
+      }
     }
+
+    octets_loaded_ += octets;
+    bit_count_ += 8 * octets;
   }
 
 public:
   BoolDecoder( const Chunk & s_chunk, const bool complete_chunk = true )
     : chunk_( s_chunk ),
-      range_( 255 ),
       value_( 0 ),
-      bit_count_( 0 ),
-      valid_( true ),
+      range_( 255 ),
+      bit_count_( -8 ),
+      octets_loaded_( 0 ),
       complete_chunk_( complete_chunk )
   {
-    load_octet();
-    value_ <<= 8;
-    load_octet();
+    fill();
   }
 
-  /* based on dixie bool_decoder.h */
+  /* based on dixie bool_decoder.h, reading a word at a time like libvpx */
   bool get( const Probability probability = 128 )
   {
     const uint32_t split = 1 + (((range_ - 1) * probability) >> 8);
-    const uint32_t SPLIT = split << 8;
+
+    if ( bit_count_ < 0 ) {
+      fill();
+    }
+
+    const uint64_t SPLIT = uint64_t( split ) << ( value_bits - 8 );
     bool ret;
 
     if ( value_ >= SPLIT ) { /* encoded a one */
@@ -94,23 +122,33 @@ public:
       range_ = split;
     }
 
-    while ( range_ < 128 ) {
-      value_ <<= 1;
-      range_ <<= 1;
-      if ( ++bit_count_ == 8 ) {
-        bit_count_ = 0;
-        load_octet();
-      }
-    }
+    /* renormalize so that range_ is back in [128, 255] */
+    const int shift = __builtin_clz( range_ ) - 24;
+    range_ <<= shift;
+    value_ <<= shift;
+    bit_count_ -= shift;
 
     return ret;
   }
 
-  bool valid() const { return valid_; }
+  /* the bit-at-a-time decoder wanted one more octet after every 8 bits of
+     renormalization, having started with two. An incomplete chunk stays valid
+     as long as that octet would have been available. */
+  bool valid() const
+  {
+    if ( complete_chunk_ ) {
+      return true;
+    }
+
+    const uint64_t bits_consumed = 8 * octets_loaded_ - 8 - bit_count_;
+    return 2 + bits_consumed / 8 <= chunk_.size();
+  }
 
+  /* reads zeros forever. Reading still changes its state, so each
+     thread gets its own. */
   static BoolDecoder & zero_decoder()
   {
-    static BoolDecoder zd { { nullptr, 0 } };
+    thread_local BoolDecoder zd { { nullptr, 0 } };
     return zd;
   }
 
@@ -30,6 +30,7 @@
 #include "uncompressed_chunk.hh"
 #include "frame.hh"
 #include "decoder_state.hh"
+#include "parsed_frame.hh"
 
 #include <sstream>
 #include <boost/functional/hash.hpp>
@@ -38,16 +39,19 @@ using namespace std;
 
 Decoder::Decoder( const uint16_t width, const uint16_t height )
   : state_( width, height ),
-    references_( width, height )
+    references_( width, height ),
+    frame_pools_( make_shared<FramePools>() )
 {}
 
 Decoder::Decoder( DecoderState state, References refs )
-  : state_( state ), references_( refs )
+  : state_( state ), references_( refs ),
+    frame_pools_( make_shared<FramePools>() )
 {}
 
 Decoder::Decoder(EncoderStateDeserializer &idata)
   : state_(move(DecoderState::deserialize(idata)))
-  , references_(move(References::deserialize(idata))) {
+  , references_(move(References::deserialize(idata)))
+  , frame_pools_(make_shared<FramePools>()) {
   assert(idata.remaining() == 0);
 }
 
@@ -89,7 +93,7 @@ UncompressedChunk Decoder::decompress_frame( const Chunk & compressed_frame ) co
 template<class FrameType>
 FrameType Decoder::parse_frame( const UncompressedChunk & decompressed_frame )
 {
-  return state_.parse_and_apply<FrameType>( decompressed_frame );
+  return state_.parse_and_apply<FrameType>( decompressed_frame, decode_threads_ );
 }
 template KeyFrame Decoder::parse_frame<KeyFrame>( const UncompressedChunk & decompressed_frame );
 template InterFrame Decoder::parse_frame<InterFrame>( const UncompressedChunk & decompressed_frame );
@@ -106,9 +110,11 @@ pair<bool, RasterHandle> Decoder::decode_frame( const FrameType & frame )
 
   const bool shown = frame.show_frame();
 
-  frame.decode( state_.segmentation, references_, raster );
+  frame.decode_and_loopfilter( state_.segmentation, state_.filter_adjustments,
+                               references_, raster, decode_threads_ );
 
-  frame.loopfilter( state_.segmentation, state_.filter_adjustments, raster );
+  /* while the picture is still in cache, for when it is a reference */
+  raster.get().extend_borders();
 
   RasterHandle immutable_raster( move( raster ) );
 
@@ -124,11 +130,17 @@ template pair<bool, RasterHandle> Decoder::decode_frame<InterFrame>( const Inter
  */
 pair<bool, RasterHandle> Decoder::get_frame_output( const Chunk & compressed_frame )
 {
+  /* the frames come from (and go back to) this decoder's pools, so that
+     decoding a stream doesn't allocate once the pools are warm */
   UncompressedChunk decompressed_frame = decompress_frame( compressed_frame );
   if ( decompressed_frame.key_frame() ) {
-    return decode_frame( parse_frame<KeyFrame>( decompressed_frame ) );
+    KeyFrameHandle frame { state_.width, state_.height, frame_pools_->key_frames };
+    state_.parse_and_apply( decompressed_frame, frame.get(), decode_threads_ );
+    return decode_frame( frame.get() );
   } else if ( not decompressed_frame.experimental() ) {
-    return decode_frame( parse_frame<InterFrame>( decompressed_frame ) );
+    InterFrameHandle frame { state_.width, state_.height, frame_pools_->inter_frames };
+    state_.parse_and_apply( decompressed_frame, frame.get(), decode_threads_ );
+    return decode_frame( frame.get() );
   } else {
     throw Unsupported( "experimental" );
   }
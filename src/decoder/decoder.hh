@@ -30,6 +30,8 @@
 #define DECODER_HH
 
 #include <vector>
+#include <algorithm>
+#include <memory>
 #include "safe_array.hh"
 #include "modemv_data.hh"
 #include "loopfilter.hh"
@@ -189,6 +191,15 @@ struct Segmentation
 
 struct DecoderState
 {
+private:
+  static BoolDecoder first_partition_decoder( const UncompressedChunk & uncompressed_chunk );
+
+  /* everything after the frame header */
+  template <class FrameType>
+  void apply( const UncompressedChunk & uncompressed_chunk, BoolDecoder & first_partition,
+              FrameType & frame, const unsigned int thread_count );
+
+public:
   uint16_t width, height;
 
   ProbabilityTables probability_tables = {};
@@ -209,7 +220,13 @@ struct DecoderState
                 const unsigned int s_height );
 
   template <class FrameType>
-  FrameType parse_and_apply( const UncompressedChunk & uncompressed_chunk );
+  FrameType parse_and_apply( const UncompressedChunk & uncompressed_chunk,
+                             const unsigned int thread_count = 1 );
+
+  /* same, but parses into an existing frame of the right size, reusing its storage */
+  template <class FrameType>
+  void parse_and_apply( const UncompressedChunk & uncompressed_chunk, FrameType & frame,
+                        const unsigned int thread_count = 1 );
 
   bool operator==( const DecoderState & other ) const;
 
@@ -243,12 +260,19 @@ public:
 
 class Decoder
 {
+friend class ParsedFrame;
 private:
   DecoderState state_;
   References references_;
 
+  /* frames are parsed into recycled storage; copies of a decoder share it */
+  struct FramePools;
+  std::shared_ptr<FramePools> frame_pools_;
+
   bool error_concealment_ { false };
 
+  unsigned int decode_threads_ { 1 };
+
 public:
   Decoder( const uint16_t width, const uint16_t height );
   Decoder( DecoderState state, References references );
@@ -278,6 +302,9 @@ public:
 
   DecoderState get_state() const { return state_; }
 
+  /* adopt the state left behind by a frame that was parsed on a copy of this decoder's state */
+  void set_state( const DecoderState & state ) { state_ = state; }
+
   References get_references( void ) const { return references_; }
 
   uint16_t get_width() const { return state_.width; }
@@ -297,6 +324,10 @@ public:
 
   void set_error_concealment( const bool val ) { error_concealment_ = val; }
   bool error_concealment() const { return error_concealment_; }
+
+  /* number of threads used to parse and reconstruct each frame; output is identical for any value */
+  void set_decode_threads( const unsigned int threads ) { decode_threads_ = std::max( 1u, threads ); }
+  unsigned int decode_threads() const { return decode_threads_; }
 };
 
 
@@ -69,22 +69,51 @@ void FilterAdjustments::update<KeyFrameHeader>(const KeyFrameHeader &header);
 template
 void FilterAdjustments::update<InterFrameHeader>(const InterFrameHeader &header);
 
-template <>
-inline KeyFrame DecoderState::parse_and_apply<KeyFrame>( const UncompressedChunk & uncompressed_chunk )
+inline BoolDecoder DecoderState::first_partition_decoder( const UncompressedChunk & uncompressed_chunk )
 {
-  assert( uncompressed_chunk.key_frame() );
+  if ( uncompressed_chunk.key_frame() and uncompressed_chunk.experimental() ) {
+    throw Invalid( "experimental key frame" );
+  }
 
   /* initialize Boolean decoder for the frame and macroblock headers */
-  BoolDecoder first_partition( uncompressed_chunk.first_partition(),
-                               uncompressed_chunk.corruption_level() >= CORRUPTED_FIRST_PARTITION );
+  return BoolDecoder( uncompressed_chunk.first_partition(),
+                      uncompressed_chunk.corruption_level() >= CORRUPTED_FIRST_PARTITION );
+}
 
-  if ( uncompressed_chunk.experimental() ) {
-    throw Invalid( "experimental key frame" );
-  }
+template <class FrameType>
+inline FrameType DecoderState::parse_and_apply( const UncompressedChunk & uncompressed_chunk,
+                                                const unsigned int thread_count )
+{
+  BoolDecoder first_partition = first_partition_decoder( uncompressed_chunk );
+
+  /* parse frame header */
+  FrameType myframe( uncompressed_chunk.show_frame(), width, height, first_partition );
+
+  apply( uncompressed_chunk, first_partition, myframe, thread_count );
+
+  return myframe;
+}
+
+template <class FrameType>
+inline void DecoderState::parse_and_apply( const UncompressedChunk & uncompressed_chunk,
+                                           FrameType & frame,
+                                           const unsigned int thread_count )
+{
+  BoolDecoder first_partition = first_partition_decoder( uncompressed_chunk );
+
+  /* parse frame header into the reused frame */
+  frame.reset( uncompressed_chunk.show_frame(), first_partition );
+
+  apply( uncompressed_chunk, first_partition, frame, thread_count );
+}
 
-  /* parse keyframe header */
-  KeyFrame myframe( uncompressed_chunk.show_frame(),
-                    width, height, first_partition );
+template <>
+inline void DecoderState::apply<KeyFrame>( const UncompressedChunk & uncompressed_chunk,
+                                           BoolDecoder & first_partition,
+                                           KeyFrame & myframe,
+                                           const unsigned int thread_count )
+{
+  assert( uncompressed_chunk.key_frame() );
 
   /* reset persistent decoder state to default values */
   *this = DecoderState( myframe.header(), width, height );
@@ -104,25 +133,17 @@ inline KeyFrame DecoderState::parse_and_apply<KeyFrame>( const UncompressedChunk
     myframe.update_segmentation( segmentation.get().map );
   }
 
-  myframe.parse_tokens( uncompressed_chunk.dct_partitions( myframe.dct_partition_count() ),
-                        frame_probability_tables );
-
-  return myframe;
+  myframe.parse_tokens( uncompressed_chunk, frame_probability_tables, thread_count );
 }
 
 template <>
-inline InterFrame DecoderState::parse_and_apply<InterFrame>( const UncompressedChunk & uncompressed_chunk )
+inline void DecoderState::apply<InterFrame>( const UncompressedChunk & uncompressed_chunk,
+                                             BoolDecoder & first_partition,
+                                             InterFrame & myframe,
+                                             const unsigned int thread_count )
 {
   assert( not uncompressed_chunk.key_frame() );
 
-  /* initialize Boolean decoder for the frame and macroblock headers */
-  BoolDecoder first_partition( uncompressed_chunk.first_partition(),
-                               uncompressed_chunk.corruption_level() >= CORRUPTED_FIRST_PARTITION );
-
-  /* parse interframe header */
-  InterFrame myframe( uncompressed_chunk.show_frame(),
-                      width, height, first_partition );
-
   /* update probability tables. replace persistent copy if prescribed in header */
   ProbabilityTables frame_probability_tables( probability_tables );
   frame_probability_tables.update( myframe.header() );
@@ -160,10 +181,7 @@ inline InterFrame DecoderState::parse_and_apply<InterFrame>( const UncompressedC
     myframe.update_segmentation( segmentation.get().map );
   }
 
-  myframe.parse_tokens( uncompressed_chunk.dct_partitions( myframe.dct_partition_count() ),
-                        frame_probability_tables );
-
-  return myframe;
+  myframe.parse_tokens( uncompressed_chunk, frame_probability_tables, thread_count );
 }
 
 template <class HeaderType>
@@ -27,6 +27,8 @@
    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #include "frame.hh"
+#include "uncompressed_chunk.hh"
+#include "wavefront.hh"
 
 using namespace std;
 
@@ -101,12 +103,20 @@ void Frame<FrameHeaderType, MacroblockType>::parse_macroblock_headers( BoolDecod
   const ProbabilityArray< num_segments > mb_segment_tree_probs = calculate_mb_segment_tree_probs();
 
   /* parse the macroblock headers */
-  macroblock_headers_.initialize( macroblock_width_, macroblock_height_,
-                                  rest_of_first_partition, header_,
-                                  mb_segment_tree_probs,
-                                  probability_tables,
-                                  Y2_, Y_, U_, V_,
-                                  error_concealment );
+  if ( macroblock_headers_.initialized() ) {
+    macroblock_headers_.get().reset( rest_of_first_partition, header_,
+                                     mb_segment_tree_probs,
+                                     probability_tables,
+                                     Y2_, Y_, U_, V_,
+                                     error_concealment );
+  } else {
+    macroblock_headers_.initialize( macroblock_width_, macroblock_height_,
+                                    rest_of_first_partition, header_,
+                                    mb_segment_tree_probs,
+                                    probability_tables,
+                                    Y2_, Y_, U_, V_,
+                                    error_concealment );
+  }
 
   /* repoint Y2 above/left pointers to skip missing subblocks */
   relink_y2_blocks();
@@ -119,68 +129,94 @@ void Frame<FrameHeaderType, MacroblockType>::update_segmentation( SegmentationMa
 }
 
 template <class FrameHeaderType, class MacroblockType>
-void Frame<FrameHeaderType, MacroblockType>::parse_tokens( vector< Chunk > dct_partitions,
-                                                           const ProbabilityTables & probability_tables )
+void Frame<FrameHeaderType, MacroblockType>::parse_tokens( const UncompressedChunk & uncompressed_chunk,
+                                                           const ProbabilityTables & probability_tables,
+                                                           const unsigned int thread_count )
 {
-  vector<BoolDecoder> dct_partition_decoders;
-  for ( const auto & x : dct_partitions ) {
-    dct_partition_decoders.emplace_back( x );
+  const unsigned int partition_count = dct_partition_count();
+
+  SafeArray< Optional< BoolDecoder >, UncompressedChunk::max_dct_partitions > dct_partition_decoders;
+  for ( unsigned int i = 0; i < partition_count; i++ ) {
+    dct_partition_decoders.at( i ).initialize( uncompressed_chunk.dct_partition( partition_count, i ) );
+  }
+
+  /* row r only reads from partition r % N, and its token contexts only need
+     the row above, so the partitions can be parsed in a wavefront. Rows are
+     dealt round-robin to the workers; the number of workers has to divide N
+     so that no partition's decoder is ever shared between two of them. */
+  unsigned int workers = partition_count;
+  while ( workers > thread_count ) {
+    workers /= 2;
   }
 
   /* parse every macroblock's tokens */
-  macroblock_headers_.get().forall_ij( [&]( MacroblockType & macroblock,
-                                            const unsigned int,
-                                            const unsigned int row )
-                                       {
-                                         macroblock.parse_tokens( dct_partition_decoders.at( row % dct_partition_decoders.size() ),
-                                                                  probability_tables ); } );
+  wavefront_forall_ij( macroblock_width_, macroblock_height_, workers,
+                       [&]( const unsigned int column, const unsigned int row )
+                       {
+                         macroblock_headers_.get().at( column, row ).parse_tokens( dct_partition_decoders.at( row % partition_count ).get(),
+                                                                                   probability_tables ); } );
 }
 
 template <class FrameHeaderType, class MacroblockType>
-void Frame<FrameHeaderType, MacroblockType>::loopfilter( const Optional< Segmentation > & segmentation,
-                                                         const Optional< FilterAdjustments > & filter_adjustments,
-                                                         VP8Raster & raster ) const
+SafeArray< FilterParameters, num_segments > Frame<FrameHeaderType, MacroblockType>::calculate_segment_loopfilters( const Optional< Segmentation > & segmentation ) const
 {
-  if ( header_.loop_filter_level ) {
-    /* calculate per-segment filter adjustments if
-       segmentation is enabled */
+  /* calculate per-segment filter adjustments if
+     segmentation is enabled; otherwise every segment uses the frame's filter */
+
+  const FilterParameters frame_loopfilter( header_.filter_type,
+                                           header_.loop_filter_level,
+                                           header_.sharpness_level );
 
-    const FilterParameters frame_loopfilter( header_.filter_type,
-                                             header_.loop_filter_level,
-                                             header_.sharpness_level );
+  SafeArray< FilterParameters, num_segments > segment_loopfilters;
 
-    SafeArray< FilterParameters, num_segments > segment_loopfilters;
+  for ( uint8_t i = 0; i < num_segments; i++ ) {
+    FilterParameters segment_filter( frame_loopfilter );
 
     if ( segmentation.initialized() ) {
-      for ( uint8_t i = 0; i < num_segments; i++ ) {
-        FilterParameters segment_filter( header_.filter_type,
-                                         header_.loop_filter_level,
-                                         header_.sharpness_level );
-        segment_filter.filter_level = segmentation.get().segment_filter_adjustments.at( i )
-          + ( segmentation.get().absolute_segment_adjustments
-              ? 0
-              : segment_filter.filter_level );
-
-        segment_loopfilters.at( i ) = segment_filter;
-      }
+      segment_filter.filter_level = segmentation.get().segment_filter_adjustments.at( i )
+        + ( segmentation.get().absolute_segment_adjustments
+            ? 0
+            : segment_filter.filter_level );
     }
 
-    /* the macroblock needs to know whether the mode- and reference-based
-       filter adjustments are enabled */
-
-    macroblock_headers_.get().forall_ij( [&]( const MacroblockType & macroblock,
-                                              const unsigned int column,
-                                              const unsigned int row )
-                                         {
-                                           VP8Raster::Macroblock output = raster.macroblock( column, row );
-                                           macroblock.loopfilter( filter_adjustments,
-                                                                  segmentation.initialized()
-                                                                  ? segment_loopfilters.at( macroblock.segment_id() )
-                                                                  : frame_loopfilter,
-                                                                  output ); } );
+    segment_loopfilters.at( i ) = segment_filter;
   }
+
+  return segment_loopfilters;
 }
 
+template <class FrameHeaderType, class MacroblockType>
+void Frame<FrameHeaderType, MacroblockType>::loopfilter_row( const unsigned int row,
+                                                             const Optional< Segmentation > & segmentation,
+                                                             const Optional< FilterAdjustments > & filter_adjustments,
+                                                             const SafeArray< FilterParameters, num_segments > & segment_loopfilters,
+                                                             VP8Raster & raster ) const
+{
+  /* the macroblock needs to know whether the mode- and reference-based
+     filter adjustments are enabled */
+
+  for ( unsigned int column = 0; column < macroblock_width_; column++ ) {
+    const MacroblockType & macroblock = macroblock_headers_.get().at( column, row );
+    VP8Raster::Macroblock output = raster.macroblock( column, row );
+    macroblock.loopfilter( filter_adjustments,
+                           segment_loopfilters.at( segmentation.initialized() ? macroblock.segment_id() : 0 ),
+                           output );
+  }
+}
+
+template <class FrameHeaderType, class MacroblockType>
+void Frame<FrameHeaderType, MacroblockType>::loopfilter( const Optional< Segmentation > & segmentation,
+                                                         const Optional< FilterAdjustments > & filter_adjustments,
+                                                         VP8Raster & raster ) const
+{
+  if ( header_.loop_filter_level ) {
+    const auto segment_loopfilters = calculate_segment_loopfilters( segmentation );
+
+    for ( unsigned int row = 0; row < macroblock_height_; row++ ) {
+      loopfilter_row( row, segmentation, filter_adjustments, segment_loopfilters, raster );
+    }
+  }
+}
 
 template <class FrameHeaderType, class MacroblockType>
 SafeArray<Quantizer, num_segments> Frame<FrameHeaderType, MacroblockType>::calculate_segment_quantizers( const Optional< Segmentation > & segmentation ) const
@@ -205,48 +241,90 @@ SafeArray<Quantizer, num_segments> Frame<FrameHeaderType, MacroblockType>::calcu
   return segment_quantizers;
 }
 
-template <>
-void KeyFrame::decode( const Optional< Segmentation > & segmentation, const References &,
-                       VP8Raster & raster ) const
+static void reconstruct_macroblock( const KeyFrameMacroblock & macroblock, const Quantizer & quantizer,
+                                   const References &, VP8Raster::Macroblock & output )
 {
-  const Quantizer frame_quantizer( header_.quant_indices );
-  const auto segment_quantizers = calculate_segment_quantizers( segmentation );
+  macroblock.reconstruct_intra( quantizer, output );
+}
 
-  /* process each macroblock */
-  macroblock_headers_.get().forall_ij( [&]( const KeyFrameMacroblock & macroblock,
-                                            const unsigned int column,
-                                            const unsigned int row ) {
-                                         const auto & quantizer = segmentation.initialized()
-                                           ? segment_quantizers.at( macroblock.segment_id() )
-                                           : frame_quantizer;
-                                         VP8Raster::Macroblock output = raster.macroblock( column, row );
-                                         macroblock.reconstruct_intra( quantizer, output );
-                                       } );
+static void reconstruct_macroblock( const InterFrameMacroblock & macroblock, const Quantizer & quantizer,
+                                   const References & references, VP8Raster::Macroblock & output )
+{
+  if ( macroblock.inter_coded() ) {
+    macroblock.reconstruct_inter( quantizer, references, output );
+  } else {
+    macroblock.reconstruct_intra( quantizer, output );
+  }
 }
 
-template <>
-void InterFrame::decode( const Optional<Segmentation> & segmentation, const References & references,
-                         VP8Raster & raster ) const
+template <class FrameHeaderType, class MacroblockType>
+template <class RowCallback>
+void Frame<FrameHeaderType, MacroblockType>::reconstruct( const Optional< Segmentation > & segmentation,
+                                                          const References & references,
+                                                          VP8Raster & raster,
+                                                          const unsigned int thread_count,
+                                                          const RowCallback & row_done ) const
 {
   const Quantizer frame_quantizer( header_.quant_indices );
   const auto segment_quantizers = calculate_segment_quantizers( segmentation );
 
-  /* process each macroblock */
-  macroblock_headers_.get().forall_ij( [&]( const InterFrameMacroblock & macroblock,
-                                            const unsigned int column,
-                                            const unsigned int row ) {
-                                         const auto & quantizer = segmentation.initialized()
-                                           ? segment_quantizers.at( macroblock.segment_id() )
-                                           : frame_quantizer;
-                                         VP8Raster::Macroblock output = raster.macroblock( column, row );
-                                         if ( macroblock.inter_coded() ) {
-                                           macroblock.reconstruct_inter( quantizer,
-                                                                         references,
-                                                                         output );
-                                         } else {
-                                           macroblock.reconstruct_intra( quantizer,
-                                                                         output );
-                                         } } );
+  /* process each macroblock (in wavefront order if we have more than one thread) */
+  wavefront_forall_ij( macroblock_width_, macroblock_height_, thread_count,
+                       [&]( const unsigned int column, const unsigned int row ) {
+                         const MacroblockType & macroblock = macroblock_headers_.get().at( column, row );
+                         const auto & quantizer = segmentation.initialized()
+                           ? segment_quantizers.at( macroblock.segment_id() )
+                           : frame_quantizer;
+                         VP8Raster::Macroblock output = raster.macroblock( column, row );
+                         reconstruct_macroblock( macroblock, quantizer, references, output );
+                       },
+                       row_done );
+}
+
+template <class FrameHeaderType, class MacroblockType>
+void Frame<FrameHeaderType, MacroblockType>::decode( const Optional< Segmentation > & segmentation,
+                                                     const References & references,
+                                                     VP8Raster & raster,
+                                                     const unsigned int thread_count ) const
+{
+  reconstruct( segmentation, references, raster, thread_count, []( const unsigned int ) {} );
+}
+
+template <class FrameHeaderType, class MacroblockType>
+void Frame<FrameHeaderType, MacroblockType>::decode_and_loopfilter( const Optional< Segmentation > & segmentation,
+                                                                    const Optional< FilterAdjustments > & filter_adjustments,
+                                                                    const References & references,
+                                                                    HashCachedRaster & raster,
+                                                                    const unsigned int thread_count ) const
+{
+  /* each macroblock row is one of the raster's hash strips */
+  if ( not header_.loop_filter_level ) {
+    reconstruct( segmentation, references, raster, thread_count,
+                 [&]( const unsigned int row ) { raster.hash_strip( row ); } );
+    return;
+  }
+
+  const auto segment_loopfilters = calculate_segment_loopfilters( segmentation );
+
+  /* intra prediction in row r reads the unfiltered bottom edge of row r - 1,
+     while filtering row r - 1 only touches rows r - 2 and r - 1. So row r - 1
+     can be filtered as soon as row r has been reconstructed, while the rows
+     below are still being predicted, and row r - 2 is then final. */
+  reconstruct( segmentation, references, raster, thread_count,
+               [&]( const unsigned int row ) {
+                 if ( row > 0 ) {
+                   loopfilter_row( row - 1, segmentation, filter_adjustments, segment_loopfilters, raster );
+                 }
+                 if ( row > 1 ) {
+                   raster.hash_strip( row - 2 );
+                 }
+                 if ( row + 1 == macroblock_height_ ) {
+                   loopfilter_row( row, segmentation, filter_adjustments, segment_loopfilters, raster );
+                   for ( unsigned int strip = row > 0 ? row - 1 : 0; strip <= row; strip++ ) {
+                     raster.hash_strip( strip );
+                   }
+                 }
+               } );
 }
 
 /* "above" for a Y2 block refers to the first macroblock above that actually has Y2 coded */
@@ -255,16 +333,20 @@ void InterFrame::decode( const Optional<Segmentation> & segmentation, const Refe
 template <class FrameHeaderType, class MacroblockType>
 void Frame<FrameHeaderType, MacroblockType>::relink_y2_blocks( void )
 {
-  vector< Optional< const Y2Block * > > above_coded( macroblock_width_ );
-  vector< Optional< const Y2Block * > > left_coded( macroblock_height_ );
+  /* the nearest coded block above (or to the left) is either the neighbor
+     itself or the block that the already-relinked neighbor points to */
+  const auto nearest_coded = [&]( const unsigned int column, const unsigned int row,
+                                  const bool above ) -> Optional< const Y2Block * > {
+    const Y2Block & neighbor = Y2_.at( column, row );
+    if ( neighbor.coded() ) {
+      return &neighbor;
+    }
+    return above ? neighbor.context().above : neighbor.context().left;
+  };
 
   Y2_.forall_ij( [&]( Y2Block & block, const unsigned int column, const unsigned int row ) {
-      block.set_above( above_coded.at( column ) );
-      block.set_left( left_coded.at( row ) );
-      if ( block.coded() ) {
-        above_coded.at( column ) = &block;
-        left_coded.at( row ) = &block;
-      }
+      block.set_above( row > 0 ? nearest_coded( column, row - 1, true ) : Optional< const Y2Block * >() );
+      block.set_left( column > 0 ? nearest_coded( column - 1, row, false ) : Optional< const Y2Block * >() );
     } );
 }
 
@@ -388,5 +470,18 @@ Frame<FrameHeaderType, MacroblockType>::Frame( const uint16_t width, const uint1
   parse_macroblock_headers( BoolDecoder::zero_decoder(), ProbabilityTables {}, false );
 }
 
+template <class FrameHeaderType, class MacroblockType>
+void Frame<FrameHeaderType, MacroblockType>::reset( const bool show, BoolDecoder & first_partition )
+{
+  show_ = show;
+  header_ = FrameHeaderType( first_partition );
+
+  /* the blocks go back to how a new frame has them, keeping their contexts */
+  Y2_.forall( [] ( Y2Block & block ) { block.reset(); } );
+  Y_.forall( [] ( YBlock & block ) { block.reset(); } );
+  U_.forall( [] ( UVBlock & block ) { block.reset(); } );
+  V_.forall( [] ( UVBlock & block ) { block.reset(); } );
+}
+
 template class Frame<KeyFrameHeader, KeyFrameMacroblock>;
 template class Frame<InterFrameHeader, InterFrameMacroblock>;
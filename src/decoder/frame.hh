@@ -35,6 +35,7 @@
 
 struct References;
 struct Segmentation;
+class UncompressedChunk;
 struct FilterAdjustments;
 
 struct Quantizers
@@ -64,9 +65,31 @@ class Frame
 
   ProbabilityArray< num_segments > calculate_mb_segment_tree_probs( void ) const;
   SafeArray< Quantizer, num_segments > calculate_segment_quantizers( const Optional< Segmentation > & segmentation ) const;
-
-  std::vector< uint8_t > serialize_first_partition( const ProbabilityTables & probability_tables ) const;
-  std::vector< std::vector< uint8_t > > serialize_tokens( const ProbabilityTables & probability_tables ) const;
+  SafeArray< FilterParameters, num_segments > calculate_segment_loopfilters( const Optional< Segmentation > & segmentation ) const;
+
+  void loopfilter_row( const unsigned int row,
+                       const Optional< Segmentation > & segmentation,
+                       const Optional< FilterAdjustments > & filter_adjustments,
+                       const SafeArray< FilterParameters, num_segments > & segment_loopfilters,
+                       VP8Raster & raster ) const;
+
+  template <class RowCallback>
+  void reconstruct( const Optional< Segmentation > & segmentation, const References & references,
+                    VP8Raster & raster, const unsigned int thread_count,
+                    const RowCallback & row_done ) const;
+
+  /* these append to the output, and return or fill in the partition lengths */
+  size_t serialize_first_partition( const ProbabilityTables & probability_tables,
+                                    std::vector< uint8_t > & output ) const;
+  size_t serialize_partition( const unsigned int partition,
+                              const ProbabilityTables & probability_tables,
+                              std::vector< uint8_t > & output ) const;
+  void serialize_tokens( const ProbabilityTables & probability_tables,
+                         std::vector< uint8_t > & output,
+                         const unsigned int thread_count ) const;
+
+  void write_frame( const bool key_frame, const ProbabilityTables & frame_probability_tables,
+                    std::vector< uint8_t > & output, const unsigned int thread_count ) const;
 
  public:
   void relink_y2_blocks( void );
@@ -91,10 +114,21 @@ class Frame
 
   void update_segmentation( SegmentationMap & mutable_segmentation_map );
 
-  void parse_tokens( std::vector< Chunk > dct_partitions, const ProbabilityTables & probability_tables );
+  /* with thread_count > 1, DCT partitions are parsed concurrently */
+  void parse_tokens( const UncompressedChunk & uncompressed_chunk, const ProbabilityTables & probability_tables,
+                     const unsigned int thread_count = 1 );
 
+  /* with thread_count > 1, macroblock rows are reconstructed in a wavefront */
   void decode( const Optional< Segmentation > & segmentation, const References & references,
-               VP8Raster & raster ) const;
+               VP8Raster & raster, const unsigned int thread_count = 1 ) const;
+
+  /* same result as decode() followed by loopfilter(), but each macroblock
+     row is deblocked as soon as the row below it has been reconstructed, and
+     hashed as soon as it is final */
+  void decode_and_loopfilter( const Optional< Segmentation > & segmentation,
+                              const Optional< FilterAdjustments > & filter_adjustments,
+                              const References & references,
+                              HashCachedRaster & raster, const unsigned int thread_count = 1 ) const;
 
   void copy_to( const RasterHandle & raster, References & references ) const;
 
@@ -104,6 +138,12 @@ class Frame
 
   std::vector< uint8_t > serialize( const ProbabilityTables & probability_tables ) const;
 
+  /* same, but replaces the contents of the given buffer, so that a buffer
+     that is kept around is only allocated once. With thread_count > 1, the
+     DCT partitions are serialized concurrently. */
+  void serialize( const ProbabilityTables & probability_tables, std::vector< uint8_t > & output,
+                  const unsigned int thread_count = 1 ) const;
+
   uint8_t dct_partition_count( void ) const { return 1 << header_.log2_number_of_dct_partitions; }
 
   bool show_frame( void ) const { return show_; }
@@ -121,6 +161,10 @@ class Frame
 
   /* empty frame */
   Frame( const uint16_t width, const uint16_t height );
+
+  /* start over with a new frame header, reusing this frame's storage
+     (the macroblock headers are replaced by parse_macroblock_headers()) */
+  void reset( const bool show, BoolDecoder & first_partition );
 };
 
 using KeyFrame = Frame<KeyFrameHeader, KeyFrameMacroblock>;
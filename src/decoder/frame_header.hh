@@ -221,10 +221,6 @@ struct KeyFrameHeader
     if ( color_space or clamping_type ) {
       throw Unsupported( "VP8 color_space and clamping_type bits" );
     }
-
-    if ( filter_type ) {
-      throw Unsupported( "VP8 'simple' in-loop deblocking filter" );
-    }
   }
 
   static constexpr bool key_frame( void ) { return true; }
@@ -288,11 +284,7 @@ struct InterFrameHeader
     prob_inter( data ), prob_references_last( data ), prob_references_golden( data ),
     intra_16x16_prob( data ), intra_chroma_prob( data ),
     mv_prob_update( data )
-  {
-    if ( filter_type ) {
-      throw Unsupported( "VP8 'simple' in-loop deblocking filter" );
-    }
-  }
+  {}
 
   static constexpr bool key_frame( void ) { return false; }
 
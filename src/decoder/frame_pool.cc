@@ -31,15 +31,7 @@
 
 using namespace std;
 
-/* helper to dequeue front element from a queue */
-template <typename T>
-static T dequeue( queue<T> & q )
-{
-  T ret { move( q.front() ) };
-  q.pop();
-  return ret;
-}
-
+/* reuse the most recently freed frame, or make one if none are free */
 template<class FrameType>
 typename FramePool<FrameType>::FrameHolder FramePool<FrameType>::make_frame( const uint16_t width,
                                                                              const uint16_t height )
@@ -51,11 +43,12 @@ typename FramePool<FrameType>::FrameHolder FramePool<FrameType>::make_frame( con
   if ( unused_frames_.empty() ) {
     ret.reset( new FrameType( width, height ) );
   } else {
-    if ( (unused_frames_.front()->display_width() != width )
-         or (unused_frames_.front()->display_height() != height ) ) {
+    if ( (unused_frames_.back()->display_width() != width )
+         or (unused_frames_.back()->display_height() != height ) ) {
       throw Unsupported( "frame size has changed" );
     } else {
-      ret = dequeue( unused_frames_ );
+      ret = move( unused_frames_.back() );
+      unused_frames_.pop_back();
     }
   }
 
@@ -70,7 +63,7 @@ void FramePool<FrameType>::free_frame( FrameType * frame )
   unique_lock<mutex> lock { mutex_ };
 
   assert( frame );
-  unused_frames_.emplace( frame );
+  unused_frames_.emplace_back( frame );
 }
 
 template<class FrameType>
@@ -30,7 +30,7 @@
 #define FRAME_POOL_HH
 
 #include <mutex>
-#include <queue>
+#include <vector>
 #include <memory>
 
 #include "frame.hh"
@@ -57,7 +57,8 @@ public:
   typedef std::unique_ptr<FrameType, FrameDeleter<FrameType>> FrameHolder;
 
 private:
-  std::queue<FrameHolder> unused_frames_ {};
+  /* most recently freed first, and no allocation once it has grown */
+  std::vector<FrameHolder> unused_frames_ {};
 
   std::mutex mutex_ {};
 
@@ -0,0 +1,978 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* Copyright 2013-2018 the Alfalfa authors
+                       and the Massachusetts Institute of Technology
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+      1. Redistributions of source code must retain the above copyright
+         notice, this list of conditions and the following disclaimer.
+
+      2. Redistributions in binary form must reproduce the above copyright
+         notice, this list of conditions and the following disclaimer in the
+         documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+/* The C kernels follow the reference code in libvpx:
+ *
+ *  Copyright (c) 2010 The WebM project authors. All Rights Reserved.
+ *
+ *  Use of this source code is governed by a BSD-style license
+ *  that can be found in the LICENSE file in the root of the source
+ *  tree. An additional intellectual property rights grant can be found
+ *  in the file PATENTS.  All contributing project authors may
+ *  be found in the AUTHORS file in the root of the source tree.
+ */
+
+#include <config.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <algorithm>
+
+#include "kernels.hh"
+#include "vp8_raster.hh"
+#include "loopfilter_filters.hh"
+#include "exception.hh"
+#include "sad_sse.hh"
+
+#ifdef HAVE_SSE2
+#include "intrapred_sse.hh"
+#include "predictor_sse.hh"
+#include "dct_sse.hh"
+#include "transform_sse.hh"
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+const char * simd_level_name( const SIMDLevel level )
+{
+  switch ( level ) {
+  case SIMDLevel::C: return "c";
+  case SIMDLevel::SSE2: return "sse2";
+  case SIMDLevel::SSSE3: return "ssse3";
+  case SIMDLevel::AVX2: return "avx2";
+  default: throw LogicError();
+  }
+}
+
+/* intra prediction */
+
+template <unsigned int size>
+static constexpr unsigned int log2_size( void )
+{
+  static_assert( size == 4 or size == 8 or size == 16, "invalid block size" );
+  return size == 4 ? 2 : size == 8 ? 3 : 4;
+}
+
+template <unsigned int size>
+static void fill_block( uint8_t * dst, const ptrdiff_t stride, const uint8_t value )
+{
+  for ( unsigned int row = 0; row < size; row++, dst += stride ) {
+    memset( dst, value, size );
+  }
+}
+
+template <unsigned int size>
+static unsigned int edge_sum( const uint8_t * edge )
+{
+  unsigned int sum = 0;
+  for ( unsigned int i = 0; i < size; i++ ) {
+    sum += edge[ i ];
+  }
+  return sum;
+}
+
+template <unsigned int size>
+static void dc_predictor_c( uint8_t * dst, ptrdiff_t stride, const uint8_t * above, const uint8_t * left )
+{
+  const unsigned int shift = log2_size<size>();
+  fill_block<size>( dst, stride, ( edge_sum<size>( above ) + edge_sum<size>( left ) + ( 1 << shift ) ) >> ( shift + 1 ) );
+}
+
+template <unsigned int size>
+static void dc_top_predictor_c( uint8_t * dst, ptrdiff_t stride, const uint8_t * above, const uint8_t * )
+{
+  const unsigned int shift = log2_size<size>();
+  fill_block<size>( dst, stride, ( edge_sum<size>( above ) + ( 1 << ( shift - 1 ) ) ) >> shift );
+}
+
+template <unsigned int size>
+static void dc_left_predictor_c( uint8_t * dst, ptrdiff_t stride, const uint8_t *, const uint8_t * left )
+{
+  const unsigned int shift = log2_size<size>();
+  fill_block<size>( dst, stride, ( edge_sum<size>( left ) + ( 1 << ( shift - 1 ) ) ) >> shift );
+}
+
+template <unsigned int size>
+static void dc_128_predictor_c( uint8_t * dst, ptrdiff_t stride, const uint8_t *, const uint8_t * )
+{
+  fill_block<size>( dst, stride, 128 );
+}
+
+template <unsigned int size>
+static void v_predictor_c( uint8_t * dst, ptrdiff_t stride, const uint8_t * above, const uint8_t * )
+{
+  for ( unsigned int row = 0; row < size; row++, dst += stride ) {
+    memcpy( dst, above, size );
+  }
+}
+
+template <unsigned int size>
+static void h_predictor_c( uint8_t * dst, ptrdiff_t stride, const uint8_t *, const uint8_t * left )
+{
+  for ( unsigned int row = 0; row < size; row++, dst += stride ) {
+    memset( dst, left[ row ], size );
+  }
+}
+
+template <unsigned int size>
+static void tm_predictor_c( uint8_t * dst, ptrdiff_t stride, const uint8_t * above, const uint8_t * left )
+{
+  for ( unsigned int row = 0; row < size; row++, dst += stride ) {
+    for ( unsigned int column = 0; column < size; column++ ) {
+      dst[ column ] = clamp255( left[ row ] + above[ column ] - above[ -1 ] );
+    }
+  }
+}
+
+static inline uint8_t avg2( const uint8_t x, const uint8_t y )
+{
+  return ( x + y + 1 ) >> 1;
+}
+
+static inline uint8_t avg3( const uint8_t x, const uint8_t y, const uint8_t z )
+{
+  return ( x + 2 * y + z + 2 ) >> 2;
+}
+
+/* B_HD_PRED */
+static void d153_predictor_4x4_c( uint8_t * dst, ptrdiff_t stride, const uint8_t * above, const uint8_t * left )
+{
+  /* the edge running from the bottom left, up through the corner, to the right */
+  const uint8_t edge[ 8 ] = { left[ 3 ], left[ 2 ], left[ 1 ], left[ 0 ],
+                              above[ -1 ], above[ 0 ], above[ 1 ], above[ 2 ] };
+
+  uint8_t * const row0 = dst;
+  uint8_t * const row1 = dst + stride;
+  uint8_t * const row2 = dst + 2 * stride;
+  uint8_t * const row3 = dst + 3 * stride;
+
+  row3[ 0 ] =             avg2( edge[ 0 ], edge[ 1 ] );
+  row3[ 1 ] =             avg3( edge[ 0 ], edge[ 1 ], edge[ 2 ] );
+  row2[ 0 ] = row3[ 2 ] = avg2( edge[ 1 ], edge[ 2 ] );
+  row2[ 1 ] = row3[ 3 ] = avg3( edge[ 1 ], edge[ 2 ], edge[ 3 ] );
+  row2[ 2 ] = row1[ 0 ] = avg2( edge[ 2 ], edge[ 3 ] );
+  row2[ 3 ] = row1[ 1 ] = avg3( edge[ 2 ], edge[ 3 ], edge[ 4 ] );
+  row1[ 2 ] = row0[ 0 ] = avg2( edge[ 3 ], edge[ 4 ] );
+  row1[ 3 ] = row0[ 1 ] = avg3( edge[ 3 ], edge[ 4 ], edge[ 5 ] );
+  row0[ 2 ] =             avg3( edge[ 4 ], edge[ 5 ], edge[ 6 ] );
+  row0[ 3 ] =             avg3( edge[ 5 ], edge[ 6 ], edge[ 7 ] );
+}
+
+/* B_HU_PRED */
+static void d207_predictor_4x4_c( uint8_t * dst, ptrdiff_t stride, const uint8_t *, const uint8_t * left )
+{
+  uint8_t * const row0 = dst;
+  uint8_t * const row1 = dst + stride;
+  uint8_t * const row2 = dst + 2 * stride;
+  uint8_t * const row3 = dst + 3 * stride;
+
+  row0[ 0 ] =             avg2( left[ 0 ], left[ 1 ] );
+  row0[ 1 ] =             avg3( left[ 0 ], left[ 1 ], left[ 2 ] );
+  row0[ 2 ] = row1[ 0 ] = avg2( left[ 1 ], left[ 2 ] );
+  row0[ 3 ] = row1[ 1 ] = avg3( left[ 1 ], left[ 2 ], left[ 3 ] );
+  row1[ 2 ] = row2[ 0 ] = avg2( left[ 2 ], left[ 3 ] );
+  row1[ 3 ] = row2[ 1 ] = avg3( left[ 2 ], left[ 3 ], left[ 3 ] );
+  row2[ 2 ] = row2[ 3 ] = row3[ 0 ] = row3[ 1 ] = row3[ 2 ] = row3[ 3 ] = left[ 3 ];
+}
+
+/* inter prediction */
+
+static constexpr int16_t sixtap_filters[ 8 ][ 6 ] =
+  { { 0,  0,  128,    0,   0,  0 },
+    { 0, -6,  123,   12,  -1,  0 },
+    { 2, -11, 108,   36,  -8,  1 },
+    { 0, -9,   93,   50,  -6,  0 },
+    { 3, -16,  77,   77, -16,  3 },
+    { 0, -6,   50,   93,  -9,  0 },
+    { 1, -8,   36,  108, -11,  2 },
+    { 0, -1,   12,  123,  -6,  0 } };
+
+/* tap k of the filter reads src[ ( k - 2 ) * step ] */
+static inline uint8_t sixtap( const uint8_t * src, const ptrdiff_t step, const int16_t * filter )
+{
+  return clamp255( ( src[ -2 * step ] * filter[ 0 ]
+                     + src[ -step ] * filter[ 1 ]
+                     + src[ 0 ] * filter[ 2 ]
+                     + src[ step ] * filter[ 3 ]
+                     + src[ 2 * step ] * filter[ 4 ]
+                     + src[ 3 * step ] * filter[ 5 ]
+                     + 64 ) >> 7 );
+}
+
+template <unsigned int size>
+static void sixtap_horizontal_c( const uint8_t * src, const unsigned int src_stride,
+                                 uint8_t * dst, const unsigned int dst_stride,
+                                 const unsigned int height, const unsigned int filter_index )
+{
+  const int16_t * filter = sixtap_filters[ filter_index ];
+
+  for ( unsigned int row = 0; row < height; row++, src += src_stride, dst += dst_stride ) {
+    for ( unsigned int column = 0; column < size; column++ ) {
+      dst[ column ] = sixtap( src + column, 1, filter );
+    }
+  }
+}
+
+template <unsigned int size>
+static void sixtap_vertical_c( const uint8_t * src, const unsigned int src_stride,
+                               uint8_t * dst, const unsigned int dst_stride,
+                               const unsigned int height, const unsigned int filter_index )
+{
+  const int16_t * filter = sixtap_filters[ filter_index ];
+
+  src += 2 * src_stride;
+
+  for ( unsigned int row = 0; row < height; row++, src += src_stride, dst += dst_stride ) {
+    for ( unsigned int column = 0; column < size; column++ ) {
+      dst[ column ] = sixtap( src + column, src_stride, filter );
+    }
+  }
+}
+
+/* loop filter: each edge is filtered at count points spaced along apart,
+   touching the pixels spaced across apart on either side of it */
+
+static void simple_filter_edge_c( uint8_t * s, const int along, const int across, const uint8_t * blimit )
+{
+  for ( unsigned int i = 0; i < 16; i++, s += along ) {
+    const int8_t mask = vp8_simple_filter_mask( blimit[ 0 ], s[ -2 * across ], s[ -across ], s[ 0 ], s[ across ] );
+    vp8_simple_filter( mask, s - 2 * across, s - across, s, s + across );
+  }
+}
+
+static void mbloop_filter_edge_c( uint8_t * s, const int along, const int across, const unsigned int count,
+                                  const uint8_t * blimit, const uint8_t * limit, const uint8_t * thresh )
+{
+  for ( unsigned int i = 0; i < count; i++, s += along ) {
+    const int8_t mask = vp8_filter_mask( limit[ 0 ], blimit[ 0 ],
+                                         s[ -4 * across ], s[ -3 * across ], s[ -2 * across ], s[ -across ],
+                                         s[ 0 ], s[ across ], s[ 2 * across ], s[ 3 * across ] );
+
+    const int8_t hev = vp8_hevmask( thresh[ 0 ], s[ -2 * across ], s[ -across ], s[ 0 ], s[ across ] );
+
+    vp8_mbfilter( mask, hev, s[ -3 * across ], s[ -2 * across ], s[ -across ],
+                  s[ 0 ], s[ across ], s[ 2 * across ] );
+  }
+}
+
+static void loop_filter_edge_c( uint8_t * s, const int along, const int across, const unsigned int count,
+                                const uint8_t * blimit, const uint8_t * limit, const uint8_t * thresh )
+{
+  for ( unsigned int i = 0; i < count; i++, s += along ) {
+    const int8_t mask = vp8_filter_mask( limit[ 0 ], blimit[ 0 ],
+                                         s[ -4 * across ], s[ -3 * across ], s[ -2 * across ], s[ -across ],
+                                         s[ 0 ], s[ across ], s[ 2 * across ], s[ 3 * across ] );
+
+    const int8_t hev = vp8_hevmask( thresh[ 0 ], s[ -2 * across ], s[ -across ], s[ 0 ], s[ across ] );
+
+    vp8_filter( mask, hev, s[ -2 * across ], s[ -across ], s[ 0 ], s[ across ] );
+  }
+}
+
+static void loop_filter_simple_vertical_edge_c( uint8_t * y, int stride, const uint8_t * blimit )
+{
+  simple_filter_edge_c( y, stride, 1, blimit );
+}
+
+static void loop_filter_simple_horizontal_edge_c( uint8_t * y, int stride, const uint8_t * blimit )
+{
+  simple_filter_edge_c( y, 1, stride, blimit );
+}
+
+static void mbloop_filter_vertical_edge_c( uint8_t * y, int stride, const uint8_t * blimit,
+                                           const uint8_t * limit, const uint8_t * thresh )
+{
+  mbloop_filter_edge_c( y, stride, 1, 16, blimit, limit, thresh );
+}
+
+static void mbloop_filter_horizontal_edge_c( uint8_t * y, int stride, const uint8_t * blimit,
+                                             const uint8_t * limit, const uint8_t * thresh )
+{
+  mbloop_filter_edge_c( y, 1, stride, 16, blimit, limit, thresh );
+}
+
+static void mbloop_filter_vertical_edge_uv_c( uint8_t * u, int stride, const uint8_t * blimit,
+                                              const uint8_t * limit, const uint8_t * thresh, uint8_t * v )
+{
+  mbloop_filter_edge_c( u, stride, 1, 8, blimit, limit, thresh );
+  mbloop_filter_edge_c( v, stride, 1, 8, blimit, limit, thresh );
+}
+
+static void mbloop_filter_horizontal_edge_uv_c( uint8_t * u, int stride, const uint8_t * blimit,
+                                                const uint8_t * limit, const uint8_t * thresh, uint8_t * v )
+{
+  mbloop_filter_edge_c( u, 1, stride, 8, blimit, limit, thresh );
+  mbloop_filter_edge_c( v, 1, stride, 8, blimit, limit, thresh );
+}
+
+static void loop_filter_bv_y_c( uint8_t * y, int stride, const uint8_t * blimit,
+                                const uint8_t * limit, const uint8_t * thresh )
+{
+  for ( unsigned int column = 4; column < 16; column += 4 ) {
+    loop_filter_edge_c( y + column, stride, 1, 16, blimit, limit, thresh );
+  }
+}
+
+static void loop_filter_bh_y_c( uint8_t * y, int stride, const uint8_t * blimit,
+                                const uint8_t * limit, const uint8_t * thresh )
+{
+  for ( unsigned int row = 4; row < 16; row += 4 ) {
+    loop_filter_edge_c( y + row * stride, 1, stride, 16, blimit, limit, thresh );
+  }
+}
+
+static void loop_filter_bv_uv_c( uint8_t * u, int stride, const uint8_t * blimit,
+                                 const uint8_t * limit, const uint8_t * thresh, uint8_t * v )
+{
+  loop_filter_edge_c( u + 4, stride, 1, 8, blimit, limit, thresh );
+  loop_filter_edge_c( v + 4, stride, 1, 8, blimit, limit, thresh );
+}
+
+static void loop_filter_bh_uv_c( uint8_t * u, int stride, const uint8_t * blimit,
+                                 const uint8_t * limit, const uint8_t * thresh, uint8_t * v )
+{
+  loop_filter_edge_c( u + 4 * stride, 1, stride, 8, blimit, limit, thresh );
+  loop_filter_edge_c( v + 4 * stride, 1, stride, 8, blimit, limit, thresh );
+}
+
+#ifdef HAVE_SSE2
+
+/* the SSE2 entry points take the edges one or two at a time */
+
+#ifdef ARCH_X86_64
+
+static void loop_filter_bv_y_sse2( uint8_t * y, int stride, const uint8_t * blimit,
+                                   const uint8_t * limit, const uint8_t * thresh )
+{
+  vp8_loop_filter_bv_y_sse2( y, stride, blimit, limit, thresh, 2 );
+}
+
+static void loop_filter_bh_y_sse2( uint8_t * y, int stride, const uint8_t * blimit,
+                                   const uint8_t * limit, const uint8_t * thresh )
+{
+  vp8_loop_filter_bh_y_sse2( y, stride, blimit, limit, thresh, 2 );
+}
+
+#else
+
+static void loop_filter_bv_y_sse2( uint8_t * y, int stride, const uint8_t * blimit,
+                                   const uint8_t * limit, const uint8_t * thresh )
+{
+  vp8_loop_filter_vertical_edge_sse2( y + 4, stride, blimit, limit, thresh );
+  vp8_loop_filter_vertical_edge_sse2( y + 8, stride, blimit, limit, thresh );
+  vp8_loop_filter_vertical_edge_sse2( y + 12, stride, blimit, limit, thresh );
+}
+
+static void loop_filter_bh_y_sse2( uint8_t * y, int stride, const uint8_t * blimit,
+                                   const uint8_t * limit, const uint8_t * thresh )
+{
+  vp8_loop_filter_horizontal_edge_sse2( y + 4 * stride, stride, blimit, limit, thresh );
+  vp8_loop_filter_horizontal_edge_sse2( y + 8 * stride, stride, blimit, limit, thresh );
+  vp8_loop_filter_horizontal_edge_sse2( y + 12 * stride, stride, blimit, limit, thresh );
+}
+
+#endif
+
+static void loop_filter_bv_uv_sse2( uint8_t * u, int stride, const uint8_t * blimit,
+                                    const uint8_t * limit, const uint8_t * thresh, uint8_t * v )
+{
+  vp8_loop_filter_vertical_edge_uv_sse2( u + 4, stride, blimit, limit, thresh, v + 4 );
+}
+
+static void loop_filter_bh_uv_sse2( uint8_t * u, int stride, const uint8_t * blimit,
+                                    const uint8_t * limit, const uint8_t * thresh, uint8_t * v )
+{
+  vp8_loop_filter_horizontal_edge_uv_sse2( u + 4 * stride, stride, blimit, limit, thresh, v + 4 * stride );
+}
+
+#endif
+
+/* transforms */
+
+static void subtract_block_c( int rows, int cols,
+                              int16_t * diff, ptrdiff_t diff_stride,
+                              const uint8_t * src, ptrdiff_t src_stride,
+                              const uint8_t * pred, ptrdiff_t pred_stride )
+{
+  for ( int row = 0; row < rows; row++ ) {
+    for ( int column = 0; column < cols; column++ ) {
+      diff[ column ] = src[ column ] - pred[ column ];
+    }
+
+    diff += diff_stride;
+    src += src_stride;
+    pred += pred_stride;
+  }
+}
+
+static void fdct4x4_c( short * input, short * output, int pitch )
+{
+  const short * ip = input;
+  short * op = output;
+
+  for ( unsigned int i = 0; i < 4; i++ ) {
+    const int a1 = ( ip[ 0 ] + ip[ 3 ] ) * 8;
+    const int b1 = ( ip[ 1 ] + ip[ 2 ] ) * 8;
+    const int c1 = ( ip[ 1 ] - ip[ 2 ] ) * 8;
+    const int d1 = ( ip[ 0 ] - ip[ 3 ] ) * 8;
+
+    op[ 0 ] = a1 + b1;
+    op[ 2 ] = a1 - b1;
+
+    op[ 1 ] = ( c1 * 2217 + d1 * 5352 + 14500 ) >> 12;
+    op[ 3 ] = ( d1 * 2217 - c1 * 5352 +  7500 ) >> 12;
+
+    ip += pitch / 2;
+    op += 4;
+  }
+
+  op = output;
+
+  for ( unsigned int i = 0; i < 4; i++ ) {
+    const int a1 = op[ 0 ] + op[ 12 ];
+    const int b1 = op[ 4 ] + op[ 8 ];
+    const int c1 = op[ 4 ] - op[ 8 ];
+    const int d1 = op[ 0 ] - op[ 12 ];
+
+    op[ 0 ] = ( a1 + b1 + 7 ) >> 4;
+    op[ 8 ] = ( a1 - b1 + 7 ) >> 4;
+
+    op[ 4 ]  = ( ( c1 * 2217 + d1 * 5352 + 12000 ) >> 16 ) + ( d1 != 0 );
+    op[ 12 ] =   ( d1 * 2217 - c1 * 5352 + 51000 ) >> 16;
+
+    op++;
+  }
+}
+
+static void walsh4x4_c( short * input, short * output, int pitch )
+{
+  const short * ip = input;
+  short * op = output;
+
+  for ( unsigned int i = 0; i < 4; i++ ) {
+    const int a1 = ( ip[ 0 ] + ip[ 2 ] ) * 4;
+    const int d1 = ( ip[ 1 ] + ip[ 3 ] ) * 4;
+    const int c1 = ( ip[ 1 ] - ip[ 3 ] ) * 4;
+    const int b1 = ( ip[ 0 ] - ip[ 2 ] ) * 4;
+
+    op[ 0 ] = a1 + d1 + ( a1 != 0 );
+    op[ 1 ] = b1 + c1;
+    op[ 2 ] = b1 - c1;
+    op[ 3 ] = a1 - d1;
+
+    ip += pitch / 2;
+    op += 4;
+  }
+
+  op = output;
+
+  for ( unsigned int i = 0; i < 4; i++ ) {
+    const int a1 = op[ 0 ] + op[ 8 ];
+    const int d1 = op[ 4 ] + op[ 12 ];
+    const int c1 = op[ 4 ] - op[ 12 ];
+    const int b1 = op[ 0 ] - op[ 8 ];
+
+    int a2 = a1 + d1;
+    int b2 = b1 + c1;
+    int c2 = b1 - c1;
+    int d2 = a1 - d1;
+
+    a2 += a2 < 0;
+    b2 += b2 < 0;
+    c2 += c2 < 0;
+    d2 += d2 < 0;
+
+    op[ 0 ]  = ( a2 + 3 ) >> 3;
+    op[ 4 ]  = ( b2 + 3 ) >> 3;
+    op[ 8 ]  = ( c2 + 3 ) >> 3;
+    op[ 12 ] = ( d2 + 3 ) >> 3;
+
+    op++;
+  }
+}
+
+static void inverse_walsh4x4_c( const short * input, short * output )
+{
+  short intermediate[ 16 ];
+
+  for ( unsigned int i = 0; i < 4; i++ ) {
+    const int a1 = input[ i + 0 ] + input[ i + 12 ];
+    const int b1 = input[ i + 4 ] + input[ i + 8 ];
+    const int c1 = input[ i + 4 ] - input[ i + 8 ];
+    const int d1 = input[ i + 0 ] - input[ i + 12 ];
+
+    intermediate[ i + 0 ]  = a1 + b1;
+    intermediate[ i + 4 ]  = c1 + d1;
+    intermediate[ i + 8 ]  = a1 - b1;
+    intermediate[ i + 12 ] = d1 - c1;
+  }
+
+  for ( unsigned int i = 0; i < 4; i++ ) {
+    const short * ip = intermediate + i * 4;
+    const int a1 = ip[ 0 ] + ip[ 3 ];
+    const int b1 = ip[ 1 ] + ip[ 2 ];
+    const int c1 = ip[ 1 ] - ip[ 2 ];
+    const int d1 = ip[ 0 ] - ip[ 3 ];
+
+    /* each output is the DC coefficient of the next 16-coefficient block */
+    short * op = output + i * 4 * 16;
+    op[ 0 * 16 ] = ( a1 + b1 + 3 ) >> 3;
+    op[ 1 * 16 ] = ( c1 + d1 + 3 ) >> 3;
+    op[ 2 * 16 ] = ( a1 - b1 + 3 ) >> 3;
+    op[ 3 * 16 ] = ( d1 - c1 + 3 ) >> 3;
+  }
+}
+
+static inline int MUL_20091( const int a ) { return ( ( ( a * 20091 ) >> 16 ) + a ); }
+static inline int MUL_35468( const int a ) { return ( ( a * 35468 ) >> 16 ); }
+
+/* based on libav/ffmpeg vp8_idct_add_c */
+static void idct4x4_add_c( const short * input, unsigned char * pred, int pitch,
+                           unsigned char * dest, int stride )
+{
+  short intermediate[ 16 ];
+
+  for ( unsigned int i = 0; i < 4; i++ ) {
+    const int t0 = input[ i + 0 ] + input[ i + 8 ];
+    const int t1 = input[ i + 0 ] - input[ i + 8 ];
+    const int t2 = MUL_35468( input[ i + 4 ] ) - MUL_20091( input[ i + 12 ] );
+    const int t3 = MUL_20091( input[ i + 4 ] ) + MUL_35468( input[ i + 12 ] );
+
+    intermediate[ i * 4 + 0 ] = t0 + t3;
+    intermediate[ i * 4 + 1 ] = t1 + t2;
+    intermediate[ i * 4 + 2 ] = t1 - t2;
+    intermediate[ i * 4 + 3 ] = t0 - t3;
+  }
+
+  for ( unsigned int i = 0; i < 4; i++, pred += pitch, dest += stride ) {
+    const int t0 = intermediate[ i + 0 ] + intermediate[ i + 8 ];
+    const int t1 = intermediate[ i + 0 ] - intermediate[ i + 8 ];
+    const int t2 = MUL_35468( intermediate[ i + 4 ] ) - MUL_20091( intermediate[ i + 12 ] );
+    const int t3 = MUL_20091( intermediate[ i + 4 ] ) + MUL_35468( intermediate[ i + 12 ] );
+
+    dest[ 0 ] = clamp255( pred[ 0 ] + ( ( t0 + t3 + 4 ) >> 3 ) );
+    dest[ 1 ] = clamp255( pred[ 1 ] + ( ( t1 + t2 + 4 ) >> 3 ) );
+    dest[ 2 ] = clamp255( pred[ 2 ] + ( ( t1 - t2 + 4 ) >> 3 ) );
+    dest[ 3 ] = clamp255( pred[ 3 ] + ( ( t0 - t3 + 4 ) >> 3 ) );
+  }
+}
+
+static void add_row_residue_c( uint8_t * dst, int stride, const int16_t * residue )
+{
+  for ( unsigned int row = 0; row < 4; row++, dst += stride ) {
+    for ( unsigned int column = 0; column < 4; column++ ) {
+      dst[ column ] = clamp255( dst[ column ] + residue[ column ] );
+    }
+  }
+}
+
+static void dequantize_c( const int16_t * input, int16_t * output,
+                          const int16_t dc_factor, const int16_t ac_factor )
+{
+  output[ 0 ] = input[ 0 ] * dc_factor;
+  for ( unsigned int i = 1; i < 16; i++ ) {
+    output[ i ] = input[ i ] * ac_factor;
+  }
+}
+
+#ifdef __SSE2__
+
+static void add_row_residue_sse2( uint8_t * dst, int stride, const int16_t * residue )
+{
+  int32_t rows[ 4 ];
+  for ( unsigned int row = 0; row < 4; row++ ) {
+    memcpy( &rows[ row ], dst + row * stride, sizeof( int32_t ) );
+  }
+
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i residue_rows = _mm_set_epi16( residue[ 3 ], residue[ 2 ], residue[ 1 ], residue[ 0 ],
+                                              residue[ 3 ], residue[ 2 ], residue[ 1 ], residue[ 0 ] );
+  const __m128i pixels = _mm_set_epi32( rows[ 3 ], rows[ 2 ], rows[ 1 ], rows[ 0 ] );
+
+  const __m128i top = _mm_add_epi16( _mm_unpacklo_epi8( pixels, zero ), residue_rows );
+  const __m128i bottom = _mm_add_epi16( _mm_unpackhi_epi8( pixels, zero ), residue_rows );
+
+  _mm_storeu_si128( reinterpret_cast<__m128i *>( rows ), _mm_packus_epi16( top, bottom ) );
+
+  for ( unsigned int row = 0; row < 4; row++ ) {
+    memcpy( dst + row * stride, &rows[ row ], sizeof( int32_t ) );
+  }
+}
+
+static void dequantize_sse2( const int16_t * input, int16_t * output,
+                             const int16_t dc_factor, const int16_t ac_factor )
+{
+  const __m128i coeffs_0 = _mm_loadu_si128( reinterpret_cast<const __m128i *>( input ) );
+  const __m128i coeffs_1 = _mm_loadu_si128( reinterpret_cast<const __m128i *>( input + 8 ) );
+
+  const __m128i factors_0 = _mm_set_epi16( ac_factor, ac_factor, ac_factor, ac_factor,
+                                           ac_factor, ac_factor, ac_factor, dc_factor );
+  const __m128i factors_1 = _mm_set1_epi16( ac_factor );
+
+  _mm_storeu_si128( reinterpret_cast<__m128i *>( output ), _mm_mullo_epi16( coeffs_0, factors_0 ) );
+  _mm_storeu_si128( reinterpret_cast<__m128i *>( output + 8 ), _mm_mullo_epi16( coeffs_1, factors_1 ) );
+}
+
+static void sad16x16x4d_sse2( const uint8_t * src, int src_stride,
+                              const uint8_t * const ref[ 4 ], int ref_stride, unsigned int sad[ 4 ] )
+{
+  __m128i sums[ 4 ] = { _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128() };
+
+  for ( unsigned int row = 0; row < 16; row++ ) {
+    const __m128i source = _mm_loadu_si128( reinterpret_cast<const __m128i *>( src + row * src_stride ) );
+    for ( unsigned int i = 0; i < 4; i++ ) {
+      const __m128i reference = _mm_loadu_si128( reinterpret_cast<const __m128i *>( ref[ i ] + row * ref_stride ) );
+      sums[ i ] = _mm_add_epi64( sums[ i ], _mm_sad_epu8( source, reference ) );
+    }
+  }
+
+  for ( unsigned int i = 0; i < 4; i++ ) {
+    sad[ i ] = _mm_cvtsi128_si32( _mm_add_epi64( sums[ i ], _mm_srli_si128( sums[ i ], 8 ) ) );
+  }
+}
+
+#endif
+
+/* SAD and variance */
+
+template <unsigned int size>
+static unsigned int sad_c( const uint8_t * src, int src_stride, const uint8_t * ref, int ref_stride )
+{
+  unsigned int sad = 0;
+
+  for ( unsigned int row = 0; row < size; row++, src += src_stride, ref += ref_stride ) {
+    for ( unsigned int column = 0; column < size; column++ ) {
+      sad += abs( src[ column ] - ref[ column ] );
+    }
+  }
+
+  return sad;
+}
+
+template <unsigned int size>
+static void sad_x4_c( const uint8_t * src, int src_stride,
+                      const uint8_t * const ref[ 4 ], int ref_stride, unsigned int sad[ 4 ] )
+{
+  for ( unsigned int i = 0; i < 4; i++ ) {
+    sad[ i ] = sad_c<size>( src, src_stride, ref[ i ], ref_stride );
+  }
+}
+
+template <unsigned int size>
+static void get_variance_c( const uint8_t * src, int src_stride, const uint8_t * ref, int ref_stride,
+                            unsigned int * sse, int * sum )
+{
+  unsigned int squares = 0;
+  int total = 0;
+
+  for ( unsigned int row = 0; row < size; row++, src += src_stride, ref += ref_stride ) {
+    for ( unsigned int column = 0; column < size; column++ ) {
+      const int diff = src[ column ] - ref[ column ];
+      total += diff;
+      squares += diff * diff;
+    }
+  }
+
+  *sse = squares;
+  if ( sum ) {
+    *sum = total;
+  }
+}
+
+template <unsigned int size>
+static unsigned int variance_c( const uint8_t * src, int src_stride, const uint8_t * ref, int ref_stride,
+                                unsigned int * sse )
+{
+  int sum;
+  get_variance_c<size>( src, src_stride, ref, ref_stride, sse, &sum );
+  return *sse - ( int64_t( sum ) * sum ) / ( size * size );
+}
+
+/* choosing the kernels */
+
+template <unsigned int size>
+static BlockKernels block_kernels_c( void )
+{
+  BlockKernels block;
+
+  block.dc_predict = dc_predictor_c<size>;
+  block.dc_top_predict = dc_top_predictor_c<size>;
+  block.dc_left_predict = dc_left_predictor_c<size>;
+  block.dc_128_predict = dc_128_predictor_c<size>;
+  block.vertical_predict = v_predictor_c<size>;
+  block.horizontal_predict = h_predictor_c<size>;
+  block.true_motion_predict = tm_predictor_c<size>;
+
+  block.sixtap_horizontal = sixtap_horizontal_c<size>;
+  block.sixtap_vertical = sixtap_vertical_c<size>;
+
+  block.sad = sad_c<size>;
+  block.sad_x4 = sad_x4_c<size>;
+  block.get_variance = get_variance_c<size>;
+  block.variance = variance_c<size>;
+
+  return block;
+}
+
+static Kernels kernels_c( void )
+{
+  Kernels k;
+
+  k.level = SIMDLevel::C;
+
+  k.block4 = block_kernels_c<4>();
+  k.block8 = block_kernels_c<8>();
+  k.block16 = block_kernels_c<16>();
+
+  k.horizontal_down_predict_4x4 = d153_predictor_4x4_c;
+  k.horizontal_up_predict_4x4 = d207_predictor_4x4_c;
+
+  k.simple_filter_vertical_edge = loop_filter_simple_vertical_edge_c;
+  k.simple_filter_horizontal_edge = loop_filter_simple_horizontal_edge_c;
+  k.mbloop_filter_vertical_edge = mbloop_filter_vertical_edge_c;
+  k.mbloop_filter_horizontal_edge = mbloop_filter_horizontal_edge_c;
+  k.mbloop_filter_vertical_edge_uv = mbloop_filter_vertical_edge_uv_c;
+  k.mbloop_filter_horizontal_edge_uv = mbloop_filter_horizontal_edge_uv_c;
+  k.loop_filter_bv_y = loop_filter_bv_y_c;
+  k.loop_filter_bh_y = loop_filter_bh_y_c;
+  k.loop_filter_bv_uv = loop_filter_bv_uv_c;
+  k.loop_filter_bh_uv = loop_filter_bh_uv_c;
+
+  k.subtract_block = subtract_block_c;
+  k.fdct4x4 = fdct4x4_c;
+  k.walsh4x4 = walsh4x4_c;
+  k.inverse_walsh4x4 = inverse_walsh4x4_c;
+  k.idct4x4_add = idct4x4_add_c;
+  k.add_row_residue = add_row_residue_c;
+  k.dequantize = dequantize_c;
+
+  return k;
+}
+
+static void use_sse2( Kernels & k )
+{
+  k.level = SIMDLevel::SSE2;
+
+#ifdef __SSE2__
+  k.add_row_residue = add_row_residue_sse2;
+  k.dequantize = dequantize_sse2;
+  k.block16.sad_x4 = sad16x16x4d_sse2;
+
+  k.block4.get_variance = vpx_get4x4var_sse2;
+  k.block8.get_variance = vpx_get8x8var_sse2;
+  k.block16.get_variance = vpx_get16x16var_sse2;
+  k.block4.variance = vpx_variance4x4_sse2;
+  k.block8.variance = vpx_variance8x8_sse2;
+  k.block16.variance = vpx_variance16x16_sse2;
+#endif
+
+#ifdef HAVE_SSE2
+  k.block4.dc_predict = vpx_dc_predictor_4x4_sse2;
+  k.block4.dc_top_predict = vpx_dc_top_predictor_4x4_sse2;
+  k.block4.dc_left_predict = vpx_dc_left_predictor_4x4_sse2;
+  k.block4.dc_128_predict = vpx_dc_128_predictor_4x4_sse2;
+  k.block4.vertical_predict = vpx_v_predictor_4x4_sse2;
+  k.block4.horizontal_predict = vpx_h_predictor_4x4_sse2;
+  k.block4.true_motion_predict = vpx_tm_predictor_4x4_sse2;
+
+  k.block8.dc_predict = vpx_dc_predictor_8x8_sse2;
+  k.block8.dc_top_predict = vpx_dc_top_predictor_8x8_sse2;
+  k.block8.dc_left_predict = vpx_dc_left_predictor_8x8_sse2;
+  k.block8.dc_128_predict = vpx_dc_128_predictor_8x8_sse2;
+  k.block8.vertical_predict = vpx_v_predictor_8x8_sse2;
+  k.block8.horizontal_predict = vpx_h_predictor_8x8_sse2;
+  k.block8.true_motion_predict = vpx_tm_predictor_8x8_sse2;
+
+  k.block16.dc_predict = vpx_dc_predictor_16x16_sse2;
+  k.block16.dc_top_predict = vpx_dc_top_predictor_16x16_sse2;
+  k.block16.dc_left_predict = vpx_dc_left_predictor_16x16_sse2;
+  k.block16.dc_128_predict = vpx_dc_128_predictor_16x16_sse2;
+  k.block16.vertical_predict = vpx_v_predictor_16x16_sse2;
+  k.block16.horizontal_predict = vpx_h_predictor_16x16_sse2;
+  k.block16.true_motion_predict = vpx_tm_predictor_16x16_sse2;
+
+  k.horizontal_up_predict_4x4 = vpx_d207_predictor_4x4_sse2;
+
+  k.block16.sad = vpx_sad16x16_sse2;
+
+  k.simple_filter_vertical_edge = vp8_loop_filter_simple_vertical_edge_sse2;
+  k.simple_filter_horizontal_edge = vp8_loop_filter_simple_horizontal_edge_sse2;
+  k.mbloop_filter_vertical_edge = vp8_mbloop_filter_vertical_edge_sse2;
+  k.mbloop_filter_horizontal_edge = vp8_mbloop_filter_horizontal_edge_sse2;
+  k.mbloop_filter_vertical_edge_uv = vp8_mbloop_filter_vertical_edge_uv_sse2;
+  k.mbloop_filter_horizontal_edge_uv = vp8_mbloop_filter_horizontal_edge_uv_sse2;
+  k.loop_filter_bv_y = loop_filter_bv_y_sse2;
+  k.loop_filter_bh_y = loop_filter_bh_y_sse2;
+  k.loop_filter_bv_uv = loop_filter_bv_uv_sse2;
+  k.loop_filter_bh_uv = loop_filter_bh_uv_sse2;
+
+  k.subtract_block = vpx_subtract_block_sse2;
+  k.fdct4x4 = vp8_short_fdct4x4_sse2;
+  k.walsh4x4 = vp8_short_walsh4x4_sse2;
+  k.inverse_walsh4x4 = vp8_short_inv_walsh4x4_sse2;
+  k.idct4x4_add = vp8_short_idct4x4llm_mmx;
+#endif
+}
+
+/* only the six-tap filters and the 4x4 horizontal-down predictor have
+   SSSE3 versions; every other kernel keeps its SSE2 (or C) variant */
+static void use_ssse3( Kernels & k )
+{
+  k.level = SIMDLevel::SSSE3;
+
+#ifdef HAVE_SSE2
+  k.horizontal_down_predict_4x4 = vpx_d153_predictor_4x4_ssse3;
+
+  k.block4.sixtap_horizontal = vp8_filter_block1d4_h6_ssse3;
+  k.block4.sixtap_vertical = vp8_filter_block1d4_v6_ssse3;
+  k.block8.sixtap_horizontal = vp8_filter_block1d8_h6_ssse3;
+  k.block8.sixtap_vertical = vp8_filter_block1d8_v6_ssse3;
+  k.block16.sixtap_horizontal = vp8_filter_block1d16_h6_ssse3;
+  k.block16.sixtap_vertical = vp8_filter_block1d16_v6_ssse3;
+#endif
+}
+
+/* only SAD and variance have AVX2 versions. The predictors, loop filters,
+   transforms, subtraction and dequantization stay at SSE2, and the six-tap
+   filters and horizontal-down predictor at SSSE3. */
+static void use_avx2( Kernels & k )
+{
+  k.level = SIMDLevel::AVX2;
+
+#ifdef __SSE2__
+  k.block4.sad = vpx_sad4x4_avx2;
+  k.block8.sad = vpx_sad8x8_avx2;
+  k.block16.sad = vpx_sad16x16_avx2;
+  k.block4.sad_x4 = vpx_sad4x4x4d_avx2;
+  k.block8.sad_x4 = vpx_sad8x8x4d_avx2;
+  k.block16.sad_x4 = vpx_sad16x16x4d_avx2;
+  k.block4.get_variance = vpx_get4x4var_avx2;
+  k.block8.get_variance = vpx_get8x8var_avx2;
+  k.block16.get_variance = vpx_get16x16var_avx2;
+  k.block4.variance = vpx_variance4x4_avx2;
+  k.block8.variance = vpx_variance8x8_avx2;
+  k.block16.variance = vpx_variance16x16_avx2;
+#endif
+}
+
+static SIMDLevel cpu_level( void )
+{
+#if defined( __x86_64__ ) || defined( __i386__ )
+  __builtin_cpu_init();
+
+  if ( __builtin_cpu_supports( "avx2" ) ) { return SIMDLevel::AVX2; }
+  if ( __builtin_cpu_supports( "ssse3" ) ) { return SIMDLevel::SSSE3; }
+  if ( __builtin_cpu_supports( "sse2" ) ) { return SIMDLevel::SSE2; }
+#endif
+
+  return SIMDLevel::C;
+}
+
+static SIMDLevel requested_level( void )
+{
+  const char * requested = getenv( "ALFALFA_SIMD" );
+
+  if ( requested == nullptr or *requested == 0 ) {
+    return SIMDLevel::AVX2;
+  }
+
+  for ( const SIMDLevel level : { SIMDLevel::C, SIMDLevel::SSE2, SIMDLevel::SSSE3, SIMDLevel::AVX2 } ) {
+    if ( simd_level_name( level ) == string( requested ) ) {
+      return level;
+    }
+  }
+
+  throw internal_error( "ALFALFA_SIMD", "expected one of c, sse2, ssse3 or avx2" );
+}
+
+static Kernels select_kernels( const SIMDLevel level )
+{
+  Kernels k = kernels_c();
+
+  if ( level >= SIMDLevel::SSE2 ) { use_sse2( k ); }
+  if ( level >= SIMDLevel::SSSE3 ) { use_ssse3( k ); }
+  if ( level >= SIMDLevel::AVX2 ) { use_avx2( k ); }
+
+  return k;
+}
+
+const Kernels & kernels( void )
+{
+  static const Kernels selected = select_kernels( min( cpu_level(), requested_level() ) );
+  return selected;
+}
+
+/* inter prediction, in one or two passes of the six-tap filters */
+
+template <unsigned int size>
+void sixtap_predict( const uint8_t * src, const unsigned int src_stride,
+                     uint8_t * dst, const unsigned int dst_stride,
+                     const uint8_t mx, const uint8_t my )
+{
+  if ( mx == 0 and my == 0 ) {
+    for ( unsigned int row = 0; row < size; row++ ) {
+      memcpy( dst + row * dst_stride, src + row * src_stride, size );
+    }
+    return;
+  }
+
+  const BlockKernels & block_kernels = kernels().block<size>();
+
+  if ( mx ) {
+    if ( my ) {
+      alignas(16) SafeArray< SafeArray< uint8_t, size + 8 >, size + 8 > intermediate;
+      uint8_t * intermediate_ptr = &intermediate.at( 0 ).at( 0 );
+
+      block_kernels.sixtap_horizontal( src - 2 * src_stride, src_stride, intermediate_ptr,
+                                       size, size + 5, mx );
+      block_kernels.sixtap_vertical( intermediate_ptr, size, dst, dst_stride,
+                                     size, my );
+    }
+    else {
+      /* First pass only */
+      block_kernels.sixtap_horizontal( src, src_stride, dst, dst_stride, size, mx );
+    }
+  }
+  else {
+    /* Second pass only */
+    block_kernels.sixtap_vertical( src - 2 * src_stride, src_stride, dst, dst_stride,
+                                   size, my );
+  }
+}
+
+template void sixtap_predict<4>( const uint8_t *, const unsigned int, uint8_t *, const unsigned int,
+                                 const uint8_t, const uint8_t );
+template void sixtap_predict<8>( const uint8_t *, const unsigned int, uint8_t *, const unsigned int,
+                                 const uint8_t, const uint8_t );
+template void sixtap_predict<16>( const uint8_t *, const unsigned int, uint8_t *, const unsigned int,
+                                  const uint8_t, const uint8_t );
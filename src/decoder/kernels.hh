@@ -0,0 +1,169 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* Copyright 2013-2018 the Alfalfa authors
+                       and the Massachusetts Institute of Technology
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+      1. Redistributions of source code must retain the above copyright
+         notice, this list of conditions and the following disclaimer.
+
+      2. Redistributions in binary form must reproduce the above copyright
+         notice, this list of conditions and the following disclaimer in the
+         documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#ifndef KERNELS_HH
+#define KERNELS_HH
+
+#include <cstdint>
+#include <cstddef>
+
+/* The pixel kernels (prediction, transforms, loop filter, SAD/variance) are
+   reached through a table of function pointers that is filled in once, the
+   first time it is used, with the best variant the CPU supports. Setting
+   ALFALFA_SIMD to c, sse2, ssse3 or avx2 caps the level, so the variants
+   can be compared on one machine. Every variant produces the same output. */
+
+enum class SIMDLevel : uint8_t { C, SSE2, SSSE3, AVX2 };
+
+const char * simd_level_name( const SIMDLevel level );
+
+typedef void intra_predictor( uint8_t * dst, ptrdiff_t stride,
+                              const uint8_t * above, const uint8_t * left );
+
+/* six-tap filter of height rows; the vertical filter's src starts two rows above the block */
+typedef void subpixel_filter( const uint8_t * src, const unsigned int src_stride,
+                              uint8_t * dst, const unsigned int dst_stride,
+                              const unsigned int height, const unsigned int filter_index );
+
+typedef void simple_loop_filter( uint8_t * y, int stride, const uint8_t * blimit );
+
+typedef void loop_filter( uint8_t * y, int stride,
+                          const uint8_t * blimit, const uint8_t * limit, const uint8_t * thresh );
+
+typedef void loop_filter_uv( uint8_t * u, int stride,
+                             const uint8_t * blimit, const uint8_t * limit, const uint8_t * thresh,
+                             uint8_t * v );
+
+typedef void subtract_block_function( int rows, int cols,
+                                      int16_t * diff, ptrdiff_t diff_stride,
+                                      const uint8_t * src, ptrdiff_t src_stride,
+                                      const uint8_t * pred, ptrdiff_t pred_stride );
+
+/* pitch is the distance between input rows in bytes */
+typedef void forward_transform( short * input, short * output, int pitch );
+
+/* writes the DC coefficient of each of 16 consecutive 16-coefficient blocks */
+typedef void inverse_walsh_function( const short * input, short * output );
+
+typedef void idct_add_function( const short * input, unsigned char * pred, int pitch,
+                                unsigned char * dest, int stride );
+
+/* adds residue[ column ] to every row of a 4x4 block */
+typedef void add_row_residue_function( uint8_t * dst, int stride, const int16_t * residue );
+
+typedef void dequantize_function( const int16_t * input, int16_t * output,
+                                  const int16_t dc_factor, const int16_t ac_factor );
+
+typedef unsigned int sad_function( const uint8_t * src, int src_stride,
+                                   const uint8_t * ref, int ref_stride );
+
+/* the SADs of one source block against four reference blocks with the same stride */
+typedef void sad_x4_function( const uint8_t * src, int src_stride,
+                              const uint8_t * const ref[ 4 ], int ref_stride,
+                              unsigned int sad[ 4 ] );
+
+/* sum may be null if only the sum of squared errors is wanted */
+typedef void get_variance_function( const uint8_t * src, int src_stride,
+                                    const uint8_t * ref, int ref_stride,
+                                    unsigned int * sse, int * sum );
+
+typedef unsigned int variance_function( const uint8_t * src, int src_stride,
+                                        const uint8_t * ref, int ref_stride,
+                                        unsigned int * sse );
+
+/* kernels that come in one variant per block size */
+struct BlockKernels
+{
+  intra_predictor * dc_predict;
+  intra_predictor * dc_top_predict;
+  intra_predictor * dc_left_predict;
+  intra_predictor * dc_128_predict;
+  intra_predictor * vertical_predict;
+  intra_predictor * horizontal_predict;
+  intra_predictor * true_motion_predict;
+
+  subpixel_filter * sixtap_horizontal;
+  subpixel_filter * sixtap_vertical;
+
+  sad_function * sad;
+  sad_x4_function * sad_x4;
+  get_variance_function * get_variance;
+  variance_function * variance;
+};
+
+struct Kernels
+{
+  SIMDLevel level;
+
+  BlockKernels block4, block8, block16;
+
+  intra_predictor * horizontal_down_predict_4x4;
+  intra_predictor * horizontal_up_predict_4x4;
+
+  simple_loop_filter * simple_filter_vertical_edge;
+  simple_loop_filter * simple_filter_horizontal_edge;
+
+  loop_filter * mbloop_filter_vertical_edge;
+  loop_filter * mbloop_filter_horizontal_edge;
+  loop_filter_uv * mbloop_filter_vertical_edge_uv;
+  loop_filter_uv * mbloop_filter_horizontal_edge_uv;
+
+  /* the three interior edges of a luma macroblock, and the one of each chroma block */
+  loop_filter * loop_filter_bv_y;
+  loop_filter * loop_filter_bh_y;
+  loop_filter_uv * loop_filter_bv_uv;
+  loop_filter_uv * loop_filter_bh_uv;
+
+  subtract_block_function * subtract_block;
+  forward_transform * fdct4x4;
+  forward_transform * walsh4x4;
+  inverse_walsh_function * inverse_walsh4x4;
+  idct_add_function * idct4x4_add;
+  add_row_residue_function * add_row_residue;
+  dequantize_function * dequantize;
+
+  template <unsigned int size>
+  const BlockKernels & block( void ) const;
+};
+
+template <> inline const BlockKernels & Kernels::block<4>( void ) const { return block4; }
+template <> inline const BlockKernels & Kernels::block<8>( void ) const { return block8; }
+template <> inline const BlockKernels & Kernels::block<16>( void ) const { return block16; }
+
+/* the kernels for this CPU, chosen on first use */
+const Kernels & kernels( void );
+
+/* predicts a block at an eighth-pixel offset (mx, my) from src, the reference
+   pixel at its top-left corner, which must have two rows and columns before it
+   and three after it */
+template <unsigned int size>
+void sixtap_predict( const uint8_t * src, const unsigned int src_stride,
+                     uint8_t * dst, const unsigned int dst_stride,
+                     const uint8_t mx, const uint8_t my );
+
+#endif /* KERNELS_HH */
@@ -30,7 +30,7 @@
 #include "frame_header.hh"
 #include "macroblock.hh"
 #include "vp8_raster.hh"
-#include "loopfilter_filters.hh"
+#include "kernels.hh"
 #include "decoder.hh"
 
 static inline uint8_t clamp63( const int input )
@@ -124,9 +124,46 @@ NormalLoopFilter::NormalLoopFilter( const bool key_frame,
 
 }
 
-void SimpleLoopFilter::filter( VP8Raster::Macroblock & , const bool )
+// Corresponds to vp8_loop_filter_simple_vertical_edge_c; column is the first column right of the edge
+void SimpleLoopFilter::filter_vertical_edge( VP8Raster::Block16 & block, const unsigned int column,
+                                             const std::array<uint8_t, 16> & edge_limit )
 {
-  throw Unsupported( "VP8 'simple' in-loop deblocking filter" );
+  kernels().simple_filter_vertical_edge( &block.at( column, 0 ), block.stride(), edge_limit.data() );
+}
+
+// Corresponds to vp8_loop_filter_simple_horizontal_edge_c; row is the first row below the edge
+void SimpleLoopFilter::filter_horizontal_edge( VP8Raster::Block16 & block, const unsigned int row,
+                                               const std::array<uint8_t, 16> & edge_limit )
+{
+  kernels().simple_filter_horizontal_edge( &block.at( 0, row ), block.stride(), edge_limit.data() );
+}
+
+// Corresponds to the SIMPLE_LOOPFILTER case of vp8_loop_filter_frame: only luma is filtered
+void SimpleLoopFilter::filter( VP8Raster::Macroblock & raster, const bool skip_subblock_edges )
+{
+  /* 1: filter the left inter-macroblock edge */
+  if ( raster.Y.column() > 0 ) {
+    filter_vertical_edge( raster.Y, 0, macroblock_limit_vector_ );
+  }
+
+  /* 2: filter the vertical subblock edges */
+  if ( not skip_subblock_edges ) {
+    for ( unsigned int column = 4; column < 16; column += 4 ) {
+      filter_vertical_edge( raster.Y, column, subblock_limit_vector_ );
+    }
+  }
+
+  /* 3: filter the top inter-macroblock edge */
+  if ( raster.Y.row() > 0 ) {
+    filter_horizontal_edge( raster.Y, 0, macroblock_limit_vector_ );
+  }
+
+  /* 4: filter the horizontal subblock edges */
+  if ( not skip_subblock_edges ) {
+    for ( unsigned int row = 4; row < 16; row += 4 ) {
+      filter_horizontal_edge( raster.Y, row, subblock_limit_vector_ );
+    }
+  }
 }
 
 // Corresponds roughly to vp8_loop_filter_mbh_c combined with vp8_loop_filter_row_normal
@@ -153,245 +190,66 @@ void NormalLoopFilter::filter( VP8Raster::Macroblock & raster, const bool skip_s
   }
 }
 
-// Roughly the same as filter_mbloop_filter_horizontal_edge_c
-template <class BlockType>
-void NormalLoopFilter::filter_mb_vertical_c( BlockType & block )
-{
-  const uint8_t size = BlockType::dimension;
-
-  for ( unsigned int row = 0; row < size; row++ ) {
-    uint8_t *central = &block.at( 0, row );
-
-    const int8_t mask = vp8_filter_mask( simple_.interior_limit(),
-                                         simple_.macroblock_edge_limit(),
-                                         *(central - 4),
-                                         *(central - 3),
-                                         *(central - 2),
-                                         *(central - 1),
-                                         *(central),
-                                         *(central + 1),
-                                         *(central + 2),
-                                         *(central + 3) );
-
-    const int8_t hev = vp8_hevmask( hev_threshold_vector_[0],
-                                    *(central - 2),
-                                    *(central - 1),
-                                    *(central),
-                                    *(central + 1) );
-
-    vp8_mbfilter( mask, hev,
-                  *(central - 3), *(central - 2), *(central - 1),
-                  *(central), *(central + 1), *(central + 2) );
-  }
-}
-
 void NormalLoopFilter::filter_mb_vertical( VP8Raster::Macroblock & raster )
 {
-#ifdef HAVE_SSE2
-  uint8_t *y_ptr = &raster.Y.at(0, 0);
-  uint8_t *u_ptr = &raster.U.at(0, 0);
-  uint8_t *v_ptr = &raster.V.at(0, 0);
-
-  const int y_stride = raster.Y.stride();
-  const int uv_stride = raster.U.stride(); // Is v stride always u stride?
-
-  auto blimit_vec = simple_.macroblock_limit_vector().data();
-  auto limit_vec = simple_.interior_limit_vector().data();
-
-  vp8_mbloop_filter_vertical_edge_sse2(y_ptr, y_stride, blimit_vec, limit_vec, hev_threshold_vector_.data());
-  vp8_mbloop_filter_vertical_edge_uv_sse2(u_ptr, uv_stride, blimit_vec, limit_vec, hev_threshold_vector_.data(),
-                                          v_ptr);
-#else
-  filter_mb_vertical_c( raster.Y );
-  filter_mb_vertical_c( raster.U );
-  filter_mb_vertical_c( raster.V );
-#endif
-}
-
-template <class BlockType>
-void NormalLoopFilter::filter_mb_horizontal_c( BlockType & block )
-{
-  const uint8_t size = BlockType::dimension;
-
-  const unsigned int stride = block.stride();
-
-  for ( unsigned int column = 0; column < size; column++ ) {
-    uint8_t *central = &block.at( column, 0 );
-
-    const int8_t mask = vp8_filter_mask( simple_.interior_limit(),
-                                         simple_.macroblock_edge_limit(),
-                                         *(central - 4 * stride ),
-                                         *(central - 3 * stride ),
-                                         *(central - 2 * stride ),
-                                         *(central - stride ),
-                                         *(central),
-                                         *(central + stride ),
-                                         *(central + 2 * stride ),
-                                         *(central + 3 * stride ) );
-
-    const int8_t hev = vp8_hevmask( hev_threshold_vector_[0],
-                                    *(central - 2 * stride ),
-                                    *(central - stride ),
-                                    *(central),
-                                    *(central + stride ) );
-
-    vp8_mbfilter( mask, hev,
-                  *(central - 3 * stride ),
-                  *(central - 2 * stride ),
-                  *(central - stride ),
-                  *(central),
-                  *(central + stride ),
-                  *(central + 2 * stride ) );
-  }
+  const Kernels & k = kernels();
+
+  k.mbloop_filter_vertical_edge( &raster.Y.at( 0, 0 ), raster.Y.stride(),
+                                 simple_.macroblock_limit_vector().data(),
+                                 simple_.interior_limit_vector().data(),
+                                 hev_threshold_vector_.data() );
+
+  k.mbloop_filter_vertical_edge_uv( &raster.U.at( 0, 0 ), raster.U.stride(),
+                                    simple_.macroblock_limit_vector().data(),
+                                    simple_.interior_limit_vector().data(),
+                                    hev_threshold_vector_.data(),
+                                    &raster.V.at( 0, 0 ) );
 }
 
 void NormalLoopFilter::filter_mb_horizontal( VP8Raster::Macroblock & raster )
 {
-#ifdef HAVE_SSE2
-  uint8_t *y_ptr = &raster.Y.at(0, 0);
-  uint8_t *u_ptr = &raster.U.at(0, 0);
-  uint8_t *v_ptr = &raster.V.at(0, 0);
-
-  const int y_stride = raster.Y.stride();
-  const int uv_stride = raster.U.stride(); // Is v stride always u stride?
-
-  auto blimit_vec = simple_.macroblock_limit_vector().data();
-  auto limit_vec = simple_.interior_limit_vector().data();
-
-  vp8_mbloop_filter_horizontal_edge_sse2(y_ptr, y_stride, blimit_vec, limit_vec, hev_threshold_vector_.data());
-  vp8_mbloop_filter_horizontal_edge_uv_sse2(u_ptr, uv_stride, blimit_vec, limit_vec, hev_threshold_vector_.data(),
-                                          v_ptr);
-#else
-  filter_mb_horizontal_c( raster.Y );
-  filter_mb_horizontal_c( raster.U );
-  filter_mb_horizontal_c( raster.V );
-#endif
-}
-
-template <class BlockType>
-void NormalLoopFilter::filter_sb_vertical_c( BlockType & block )
-{
-  const uint8_t size = BlockType::dimension;
-
-  for ( unsigned int center_column = 4; center_column < size; center_column += 4 ) {
-    for ( unsigned int row = 0; row < size; row++ ) {
-      uint8_t *central = &block.at( center_column, row );
-
-      const int8_t mask = vp8_filter_mask( simple_.interior_limit(),
-                                           simple_.subblock_edge_limit(),
-                                           *(central - 4),
-                                           *(central - 3),
-                                           *(central - 2),
-                                           *(central - 1),
-                                           *(central),
-                                           *(central + 1),
-                                           *(central + 2),
-                                           *(central + 3) );
-
-      const int8_t hev = vp8_hevmask( hev_threshold_vector_[0],
-                                      *(central - 2),
-                                      *(central - 1),
-                                      *(central),
-                                      *(central + 1) );
-
-      vp8_filter( mask, hev,
-                  *(central - 2), *(central - 1),
-                  *(central), *(central + 1) );
-    }
-  }
+  const Kernels & k = kernels();
+
+  k.mbloop_filter_horizontal_edge( &raster.Y.at( 0, 0 ), raster.Y.stride(),
+                                   simple_.macroblock_limit_vector().data(),
+                                   simple_.interior_limit_vector().data(),
+                                   hev_threshold_vector_.data() );
+
+  k.mbloop_filter_horizontal_edge_uv( &raster.U.at( 0, 0 ), raster.U.stride(),
+                                      simple_.macroblock_limit_vector().data(),
+                                      simple_.interior_limit_vector().data(),
+                                      hev_threshold_vector_.data(),
+                                      &raster.V.at( 0, 0 ) );
 }
 
 void NormalLoopFilter::filter_sb_vertical( VP8Raster::Macroblock & raster )
 {
-#ifdef HAVE_SSE2
-  uint8_t *y_ptr = &raster.Y.at(0, 0);
-  uint8_t *u_ptr = &raster.U.at(0, 0);
-  uint8_t *v_ptr = &raster.V.at(0, 0);
-
-  const int y_stride = raster.Y.stride();
-  const int uv_stride = raster.U.stride(); // Is v stride always u stride?
-
-  auto blimit_vec = simple_.subblock_limit_vector().data();
-  auto limit_vec = simple_.interior_limit_vector().data();
-
-#ifdef ARCH_X86_64
-    vp8_loop_filter_bv_y_sse2(y_ptr, y_stride, blimit_vec, limit_vec, hev_threshold_vector_.data(), 2);
-#else
-    vp8_loop_filter_vertical_edge_sse2(y_ptr + 4, y_stride, blimit_vec, limit_vec, hev_threshold_vector_.data());
-    vp8_loop_filter_vertical_edge_sse2(y_ptr + 8, y_stride, blimit_vec, limit_vec, hev_threshold_vector_.data());
-    vp8_loop_filter_vertical_edge_sse2(y_ptr + 12, y_stride, blimit_vec, limit_vec, hev_threshold_vector_.data());
-#endif
-
-  vp8_loop_filter_vertical_edge_uv_sse2(u_ptr + 4, uv_stride, blimit_vec, limit_vec, hev_threshold_vector_.data(), v_ptr + 4);
-#else
-  filter_sb_vertical_c( raster.Y );
-  filter_sb_vertical_c( raster.U );
-  filter_sb_vertical_c( raster.V );
-#endif
-}
-
-template <class BlockType>
-void NormalLoopFilter::filter_sb_horizontal_c( BlockType & block )
-{
-  const uint8_t size = BlockType::dimension;
-
-  const unsigned int stride = block.stride();
-
-  for ( unsigned int center_row = 4; center_row < size; center_row += 4 ) {
-    for ( unsigned int column = 0; column < size; column++ ) {
-      uint8_t *central = &block.at( column, center_row );
-
-      const int8_t mask = vp8_filter_mask( simple_.interior_limit(),
-                                           simple_.subblock_edge_limit(),
-                                           *(central - 4 * stride ),
-                                           *(central - 3 * stride ),
-                                           *(central - 2 * stride ),
-                                           *(central - stride ),
-                                           *(central),
-                                           *(central + stride ),
-                                           *(central + 2 * stride ),
-                                           *(central + 3 * stride ) );
-
-      const int8_t hev = vp8_hevmask( hev_threshold_vector_[0],
-                                      *(central - 2 * stride ),
-                                      *(central - stride ),
-                                      *(central),
-                                      *(central + stride ) );
-
-      vp8_filter( mask, hev,
-                  *(central - 2 * stride ),
-                  *(central - stride ),
-                  *(central),
-                  *(central + stride ) );
-    }
-  }
+  const Kernels & k = kernels();
+
+  k.loop_filter_bv_y( &raster.Y.at( 0, 0 ), raster.Y.stride(),
+                      simple_.subblock_limit_vector().data(),
+                      simple_.interior_limit_vector().data(),
+                      hev_threshold_vector_.data() );
+
+  k.loop_filter_bv_uv( &raster.U.at( 0, 0 ), raster.U.stride(),
+                       simple_.subblock_limit_vector().data(),
+                       simple_.interior_limit_vector().data(),
+                       hev_threshold_vector_.data(),
+                       &raster.V.at( 0, 0 ) );
 }
 
 void NormalLoopFilter::filter_sb_horizontal( VP8Raster::Macroblock & raster )
 {
-#ifdef HAVE_SSE2
-  uint8_t *y_ptr = &raster.Y.at(0, 0);
-  uint8_t *u_ptr = &raster.U.at(0, 0);
-  uint8_t *v_ptr = &raster.V.at(0, 0);
-
-  const int y_stride = raster.Y.stride();
-  const int uv_stride = raster.U.stride(); // Is v stride always u stride?
-
-  auto blimit_vec = simple_.subblock_limit_vector().data();
-  auto limit_vec = simple_.interior_limit_vector().data();
-
-#ifdef ARCH_X86_64
-    vp8_loop_filter_bh_y_sse2(y_ptr, y_stride, blimit_vec, limit_vec, hev_threshold_vector_.data(), 2);
-#else
-    vp8_loop_filter_horizontal_edge_sse2(y_ptr + 4 * ystride, y_stride, blimit_vec, limit_vec, hev_threshold_vector_.data());
-    vp8_loop_filter_horizontal_edge_sse2(y_ptr + 8 * ystride, y_stride, blimit_vec, limit_vec, hev_threshold_vector_.data());
-    vp8_loop_filter_horizontal_edge_sse2(y_ptr + 12 * ystride, y_stride, blimit_vec, limit_vec, hev_threshold_vector_.data());
-#endif
-
-  vp8_loop_filter_horizontal_edge_uv_sse2(u_ptr + 4 * uv_stride, uv_stride, blimit_vec, limit_vec, hev_threshold_vector_.data(), v_ptr + 4 * uv_stride);
-#else
-  filter_sb_horizontal_c( raster.Y );
-  filter_sb_horizontal_c( raster.U );
-  filter_sb_horizontal_c( raster.V );
-#endif
+  const Kernels & k = kernels();
+
+  k.loop_filter_bh_y( &raster.Y.at( 0, 0 ), raster.Y.stride(),
+                      simple_.subblock_limit_vector().data(),
+                      simple_.interior_limit_vector().data(),
+                      hev_threshold_vector_.data() );
+
+  k.loop_filter_bh_uv( &raster.U.at( 0, 0 ), raster.U.stride(),
+                       simple_.subblock_limit_vector().data(),
+                       simple_.interior_limit_vector().data(),
+                       hev_threshold_vector_.data(),
+                       &raster.V.at( 0, 0 ) );
 }
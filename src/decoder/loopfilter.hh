@@ -70,6 +70,12 @@ private:
   alignas(16) std::array<uint8_t, 16> subblock_limit_vector_;
   uint8_t filter_level_;
 
+  void filter_vertical_edge( VP8Raster::Block16 & block, const unsigned int column,
+                             const std::array<uint8_t, 16> & edge_limit );
+
+  void filter_horizontal_edge( VP8Raster::Block16 & block, const unsigned int row,
+                               const std::array<uint8_t, 16> & edge_limit );
+
 public:
   SimpleLoopFilter( const FilterParameters & params );
 
@@ -98,18 +104,6 @@ private:
 
   void filter_sb_horizontal( VP8Raster::Macroblock & raster );
 
-  template <class BlockType>
-  void filter_mb_vertical_c( BlockType & block );
-
-  template <class BlockType>
-  void filter_mb_horizontal_c( BlockType & block );
-
-  template <class BlockType>
-  void filter_sb_vertical_c( BlockType & block );
-
-  template <class BlockType>
-  void filter_sb_horizontal_c( BlockType & block );
-
 public:
   NormalLoopFilter( const bool key_frame, const FilterParameters & params );
 
@@ -266,6 +266,16 @@ extern "C" {
   loop_filter_uvfunction vp8_loop_filter_vertical_edge_uv_sse2;
   loop_filter_uvfunction vp8_mbloop_filter_horizontal_edge_uv_sse2;
   loop_filter_uvfunction vp8_mbloop_filter_vertical_edge_uv_sse2;
+
+  typedef void loop_filter_simple_function
+  (
+      unsigned char *y,   /* source pointer */
+      int p,              /* pitch */
+      const uint8_t *blimit
+  );
+
+  loop_filter_simple_function vp8_loop_filter_simple_horizontal_edge_sse2;
+  loop_filter_simple_function vp8_loop_filter_simple_vertical_edge_sse2;
 }
 
 #endif /* HAVE_SSE2 */
@@ -505,17 +505,21 @@ template <class FrameHeaderType, class MacroblockHeaderType>
 void Macroblock<FrameHeaderType, MacroblockHeaderType>::apply_walsh( const Quantizer & quantizer,
                                                                      VP8Raster::Macroblock & raster ) const
 {
+    /* blocks without AC coefficients only need the DC from the Y2 block */
     SafeArray< SafeArray< DCTCoefficients, 4 >, 4 > Y_dequant_coeffs;
     for ( int row = 0; row < 4; row++ ) {
       for ( int column = 0; column < 4; column++ ) {
-        Y_dequant_coeffs.at( row ).at( column ) = Y_.at( column, row ).dequantize( quantizer );
+        if ( Y_.at( column, row ).eob() > 1 ) {
+          Y_dequant_coeffs.at( row ).at( column ) = Y_.at( column, row ).dequantize( quantizer );
+        }
       }
     }
-    Y2_.dequantize( quantizer ).iwht( Y_dequant_coeffs );
+    Y2_.dequantize( quantizer ).iwht( Y_dequant_coeffs, Y2_.eob() );
 
     for ( int row = 0; row < 4; row++ ) {
       for ( int column = 0; column < 4; column++ ) {
-        Y_dequant_coeffs.at( row ).at( column ).idct_add( raster.Y_sub_at( column, row ) );
+        Y_dequant_coeffs.at( row ).at( column ).idct_add( raster.Y_sub_at( column, row ),
+                                                          Y_.at( column, row ).eob() );
       }
     }
 }
@@ -530,9 +534,9 @@ void Macroblock<FrameHeaderType, MacroblockHeaderType>::reconstruct_intra( const
 
   if ( has_nonzero_ ) {
     U_.forall_ij( [&] ( const UVBlock & block, const unsigned int column, const unsigned int row )
-                  { block.dequantize( quantizer ).idct_add( raster.U_sub_at( column, row ) ); } );
+                  { block.dequantize_idct_add( quantizer, raster.U_sub_at( column, row ) ); } );
     V_.forall_ij( [&] ( const UVBlock & block, const unsigned int column, const unsigned int row )
-                  { block.dequantize( quantizer ).idct_add( raster.V_sub_at( column, row ) ); } );
+                  { block.dequantize_idct_add( quantizer, raster.V_sub_at( column, row ) ); } );
   }
 
   /* Luma */
@@ -540,7 +544,7 @@ void Macroblock<FrameHeaderType, MacroblockHeaderType>::reconstruct_intra( const
     /* Prediction and inverse transform done in line! */
     Y_.forall_ij( [&] ( const YBlock & block, const unsigned int column, const unsigned int row ) {
         raster.Y_sub_at( column, row ).intra_predict( block.prediction_mode() );
-        if ( has_nonzero_ ) block.dequantize( quantizer ).idct_add( raster.Y_sub_at( column, row ) );
+        if ( has_nonzero_ ) block.dequantize_idct_add( quantizer, raster.Y_sub_at( column, row ) );
       } );
   } else {
     raster.Y.intra_predict( Y2_.prediction_mode() );
@@ -555,14 +559,14 @@ void InterFrameMacroblock::reconstruct_inter( const Quantizer & quantizer,
                                               const References & references,
                                               VP8Raster::Macroblock & raster ) const
 {
-  const VP8Raster & reference = references.at( header_.reference() );
+  const VP8Raster::ExtendedPlanes & reference = references.at( header_.reference() ).extended();
 
   if ( Y2_.prediction_mode() == SPLITMV ) {
     Y_.forall_ij(
       [&] ( const YBlock & block, const unsigned int column, const unsigned int row )
       {
         raster.Y_sub_at( column, row ).inter_predict( block.motion_vector(),
-                                                      reference.Y() );
+                                                      reference.Y );
       }
     );
 
@@ -570,32 +574,32 @@ void InterFrameMacroblock::reconstruct_inter( const Quantizer & quantizer,
       [&] ( const UVBlock & block, const unsigned int column, const unsigned int row )
       {
         raster.U_sub_at( column, row ).inter_predict( block.motion_vector(),
-                                                      reference.U() );
+                                                      reference.U );
         raster.V_sub_at( column, row ).inter_predict( block.motion_vector(),
-                                                      reference.V() );
+                                                      reference.V );
       }
     );
 
     if ( has_nonzero_ ) {
       /* Add residue */
       Y_.forall_ij( [&] ( const YBlock & block, const unsigned int column, const unsigned int row )
-                    { block.dequantize( quantizer ).idct_add( raster.Y_sub_at( column, row ) ); } );
+                    { block.dequantize_idct_add( quantizer, raster.Y_sub_at( column, row ) ); } );
       U_.forall_ij( [&] ( const UVBlock & block, const unsigned int column, const unsigned int row )
-                    { block.dequantize( quantizer ).idct_add( raster.U_sub_at( column, row ) ); } );
+                    { block.dequantize_idct_add( quantizer, raster.U_sub_at( column, row ) ); } );
       V_.forall_ij( [&] ( const UVBlock & block, const unsigned int column, const unsigned int row )
-                    { block.dequantize( quantizer ).idct_add( raster.V_sub_at( column, row ) ); } );
+                    { block.dequantize_idct_add( quantizer, raster.V_sub_at( column, row ) ); } );
     }
   } else {
-    raster.Y.inter_predict( base_motion_vector(), reference.Y() );
-    raster.U.inter_predict( U_.at( 0, 0 ).motion_vector(), reference.U() );
-    raster.V.inter_predict( U_.at( 0, 0 ).motion_vector(), reference.V() );
+    raster.Y.inter_predict( base_motion_vector(), reference.Y );
+    raster.U.inter_predict( U_.at( 0, 0 ).motion_vector(), reference.U );
+    raster.V.inter_predict( U_.at( 0, 0 ).motion_vector(), reference.V );
 
     if ( has_nonzero_ ) {
       apply_walsh( quantizer, raster );
       U_.forall_ij( [&] ( const UVBlock & block, const unsigned int column, const unsigned int row )
-                    { block.dequantize( quantizer ).idct_add( raster.U_sub_at( column, row ) ); } );
+                    { block.dequantize_idct_add( quantizer, raster.U_sub_at( column, row ) ); } );
       V_.forall_ij( [&] ( const UVBlock & block, const unsigned int column, const unsigned int row )
-                    { block.dequantize( quantizer ).idct_add( raster.V_sub_at( column, row ) ); } );
+                    { block.dequantize_idct_add( quantizer, raster.V_sub_at( column, row ) ); } );
     }
   }
 }
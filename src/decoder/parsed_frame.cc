@@ -0,0 +1,68 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* Copyright 2013-2018 the Alfalfa authors
+                       and the Massachusetts Institute of Technology
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+      1. Redistributions of source code must retain the above copyright
+         notice, this list of conditions and the following disclaimer.
+
+      2. Redistributions in binary form must reproduce the above copyright
+         notice, this list of conditions and the following disclaimer in the
+         documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#include "parsed_frame.hh"
+#include "uncompressed_chunk.hh"
+#include "exception.hh"
+
+using namespace std;
+
+ParsedFrame::ParsedFrame( const Decoder & decoder, const Chunk & compressed_frame )
+  : frame_pools_( decoder.frame_pools_ ),
+    compressed_frame_( compressed_frame ),
+    source_state_( decoder.state_ ),
+    state_( decoder.state_ )
+{
+  const uint16_t width = state_.width, height = state_.height;
+
+  const UncompressedChunk uncompressed_chunk = decoder.decompress_frame( compressed_frame );
+  if ( uncompressed_chunk.key_frame() ) {
+    key_frame_.initialize( width, height, frame_pools_->key_frames );
+    state_.parse_and_apply( uncompressed_chunk, key_frame_.get().get(), decoder.decode_threads() );
+  } else if ( not uncompressed_chunk.experimental() ) {
+    inter_frame_.initialize( width, height, frame_pools_->inter_frames );
+    state_.parse_and_apply( uncompressed_chunk, inter_frame_.get().get(), decoder.decode_threads() );
+  } else {
+    throw Unsupported( "experimental" );
+  }
+}
+
+bool ParsedFrame::matches( const Decoder & decoder, const Chunk & compressed_frame ) const
+{
+  return compressed_frame.buffer() == compressed_frame_.buffer()
+    and compressed_frame.size() == compressed_frame_.size()
+    and frame_pools_ == decoder.frame_pools_
+    and source_state_ == decoder.state_;
+}
+
+pair<bool, RasterHandle> ParsedFrame::decode( Decoder & decoder ) const
+{
+  return key_frame()
+    ? decoder.decode_frame( key_frame_.get().get() )
+    : decoder.decode_frame( inter_frame_.get().get() );
+}
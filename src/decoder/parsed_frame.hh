@@ -0,0 +1,78 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* Copyright 2013-2018 the Alfalfa authors
+                       and the Massachusetts Institute of Technology
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+      1. Redistributions of source code must retain the above copyright
+         notice, this list of conditions and the following disclaimer.
+
+      2. Redistributions in binary form must reproduce the above copyright
+         notice, this list of conditions and the following disclaimer in the
+         documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#ifndef PARSED_FRAME_HH
+#define PARSED_FRAME_HH
+
+#include <memory>
+
+#include "decoder.hh"
+#include "decoder_state.hh"
+#include "frame_pool.hh"
+#include "chunk.hh"
+
+struct Decoder::FramePools
+{
+  FramePool<KeyFrame> key_frames {};
+  FramePool<InterFrame> inter_frames {};
+};
+
+/* a frame parsed ahead of time against a copy of a decoder's state, into
+   storage recycled through that decoder's pools */
+class ParsedFrame
+{
+private:
+  /* declared first so the pools outlive the frames going back to them */
+  std::shared_ptr<Decoder::FramePools> frame_pools_;
+
+  /* refers to the caller's bytes, which must stay put until it is decoded */
+  Chunk compressed_frame_;
+  DecoderState source_state_;
+
+  DecoderState state_;
+  Optional<KeyFrameHandle> key_frame_ {};
+  Optional<InterFrameHandle> inter_frame_ {};
+
+public:
+  /* leaves the decoder untouched */
+  ParsedFrame( const Decoder & decoder, const Chunk & compressed_frame );
+
+  /* true if this was parsed from compressed_frame's bytes, in place,
+     against the state the decoder is in now */
+  bool matches( const Decoder & decoder, const Chunk & compressed_frame ) const;
+
+  /* the decoder's state once the frame has been applied */
+  const DecoderState & state( void ) const { return state_; }
+
+  bool key_frame( void ) const { return key_frame_.initialized(); }
+
+  /* reconstructs the frame on a decoder that has already been given state() */
+  std::pair<bool, RasterHandle> decode( Decoder & decoder ) const;
+};
+
+#endif /* PARSED_FRAME_HH */
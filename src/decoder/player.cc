@@ -28,9 +28,11 @@
 
 #include "player.hh"
 #include "uncompressed_chunk.hh"
-#include "decoder_state.hh"
+#include "parsed_frame.hh"
 
 #include <fstream>
+#include <future>
+#include <algorithm>
 
 using namespace std;
 
@@ -59,7 +61,51 @@ size_t FramePlayer::serialize(EncoderStateSerializer &odata) {
 
 Optional<RasterHandle> FramePlayer::decode( const Chunk & chunk )
 {
-  return decoder_.parse_and_decode_frame( chunk );
+  return decode( chunk, Optional<Chunk>() );
+}
+
+Optional<RasterHandle> FramePlayer::decode( const Chunk & chunk, const Chunk & next_chunk )
+{
+  return decode( chunk, Optional<Chunk>( pipelining_, next_chunk ) );
+}
+
+Optional<RasterHandle> FramePlayer::decode( const Chunk & chunk, const Optional<Chunk> & next_chunk )
+{
+  shared_ptr<const ParsedFrame> parsed = move( parsed_next_ );
+  parsed_next_.reset();
+
+  /* a frame parsed ahead is stale if anything else has moved the decoder on */
+  if ( not parsed or not parsed->matches( decoder_, chunk ) ) {
+    if ( not next_chunk.initialized() ) {
+      return decoder_.parse_and_decode_frame( chunk );
+    }
+
+    parsed = make_shared<const ParsedFrame>( decoder_, chunk );
+  }
+
+  decoder_.set_state( parsed->state() );
+
+  /* parsing only needs the probabilities and segmentation that this frame
+     leaves behind, not its pixels, so the next frame can be parsed while
+     this one is reconstructed. The decoder's state is not touched until
+     the next call. */
+  future<shared_ptr<const ParsedFrame>> next_frame;
+  if ( next_chunk.initialized() ) {
+    next_frame = async( launch::async,
+                        [&]() { return make_shared<const ParsedFrame>( decoder_, next_chunk.get() ); } );
+  }
+
+  const pair<bool, RasterHandle> output = parsed->decode( decoder_ );
+
+  if ( next_frame.valid() ) {
+    try {
+      parsed_next_ = next_frame.get();
+    } catch ( const exception & ) {
+      /* leave it to be parsed (and the error reported) when it is decoded */
+    }
+  }
+
+  return make_optional( output.first, output.second );
 }
 
 const VP8Raster & FramePlayer::example_raster( void ) const
@@ -82,11 +128,11 @@ ostream& operator<<( ostream & out, const FramePlayer & player)
   return out << player.decoder_.get_hash().str();
 }
 
-FilePlayer::FilePlayer( const string & filename )
-  : FilePlayer( filename, IVF( filename ) )
+FilePlayer::FilePlayer( const string & filename, const unsigned int wait_ms )
+  : FilePlayer( filename, IVFStream( filename, wait_ms ) )
 {}
 
-FilePlayer::FilePlayer( const string & filename, IVF && file )
+FilePlayer::FilePlayer( const string & filename, IVFStream && file )
   : FramePlayer( file.width(), file.height() ),
     file_ ( move( file ) ),
     filename_( filename )
@@ -96,16 +142,17 @@ FilePlayer::FilePlayer( const string & filename, IVF && file )
   }
 
   // Start at first KeyFrame
-  while ( frame_no_ < file_.frame_count() ) {
+  while ( file_.has_frame( frame_no_ ) ) {
     UncompressedChunk uncompressed_chunk = decoder_.decompress_frame( file_.frame( frame_no_ ) );
     if ( uncompressed_chunk.key_frame() ) {
       break;
     }
     frame_no_++;
+    file_.release_before( frame_no_ );
   }
 }
 
-FilePlayer::FilePlayer(const string &filename, IVF &&file, EncoderStateDeserializer &idata)
+FilePlayer::FilePlayer(const string &filename, IVFStream &&file, EncoderStateDeserializer &idata)
   : FramePlayer(idata)
   , file_(move(file))
   , filename_(filename)
@@ -123,8 +170,9 @@ FilePlayer::FilePlayer(const string &filename, IVF &&file, EncoderStateDeseriali
   }
 }
 
-FilePlayer FilePlayer::deserialize(EncoderStateDeserializer &idata, const string &filename) {
-  return FilePlayer(filename, move(IVF(filename)), idata);
+FilePlayer FilePlayer::deserialize(EncoderStateDeserializer &idata, const string &filename,
+                                   const unsigned int wait_ms) {
+  return FilePlayer(filename, IVFStream(filename, wait_ms), idata);
 }
 
 size_t FilePlayer::serialize(EncoderStateSerializer &odata) {
@@ -134,7 +182,16 @@ size_t FilePlayer::serialize(EncoderStateSerializer &odata) {
 RasterHandle FilePlayer::advance( void )
 {
   while ( not eof() ) {
-    Optional<RasterHandle> raster = decode( file_.frame( frame_no_++ ) );
+    const unsigned int frame_no = frame_no_++;
+
+    /* keep only this frame (for original_size) and the next one buffered */
+    file_.release_before( frame_no );
+
+    /* only parse ahead if the next frame is already there, so that a pipe
+       or a growing file doesn't hold this one back while waiting for it */
+    Optional<RasterHandle> raster = file_.has_frame_now( frame_no_ )
+      ? decode( file_.frame( frame_no ), file_.frame( frame_no_ ) )
+      : decode( file_.frame( frame_no ) );
     if ( raster.initialized() ) {
       return raster.get();
     }
@@ -143,9 +200,99 @@ RasterHandle FilePlayer::advance( void )
   throw Unsupported( "hidden frames at end of file" );
 }
 
-bool FilePlayer::eof( void ) const
+const IVFIndex & FilePlayer::index( void )
+{
+  if ( not index_.initialized() ) {
+    if ( filename_ == "-" ) {
+      throw Unsupported( "cannot seek in standard input" );
+    }
+
+    index_.initialize( IVFIndex::open( filename_, IVF( filename_ ) ) );
+  }
+
+  return index_.get();
+}
+
+void FilePlayer::reposition( const unsigned int frame_no )
+{
+  file_.seek( frame_no, index().offset( frame_no ) );
+  frame_no_ = frame_no;
+  discard_parsed_frame();
+}
+
+void FilePlayer::decode_up_to( const unsigned int frame_no )
+{
+  while ( frame_no_ < frame_no ) {
+    if ( not file_.has_frame( frame_no_ ) ) {
+      throw Invalid( "IVF file truncated" );
+    }
+
+    file_.release_before( frame_no_ );
+
+    const unsigned int skipped_frame_no = frame_no_++;
+    if ( file_.has_frame_now( frame_no_ ) ) {
+      decode( file_.frame( skipped_frame_no ), file_.frame( frame_no_ ) );
+    } else {
+      decode( file_.frame( skipped_frame_no ) );
+    }
+  }
+}
+
+void FilePlayer::seek( const unsigned int frame_no )
+{
+  if ( frame_no >= index().frame_count() ) {
+    throw out_of_range( "seek past end of file" );
+  }
+
+  const Optional<uint32_t> key_frame = index().key_frame_before( frame_no );
+
+  /* everything up to frame_no_ has been decoded already */
+  const bool carry_on = frame_no_ <= frame_no
+    and ( not key_frame.initialized() or frame_no_ > key_frame.get() );
+
+  if ( not carry_on ) {
+    if ( not key_frame.initialized() ) {
+      throw Invalid( "no key frame to seek to" );
+    }
+
+    reposition( key_frame.get() );
+  }
+
+  decode_up_to( frame_no );
+}
+
+void FilePlayer::seek( const unsigned int frame_no, const Decoder & state )
+{
+  if ( frame_no >= index().frame_count() or not index().has_minihashes() ) {
+    return seek( frame_no );
+  }
+
+  /* only worth it if the state is later than both the key frame and where we are now */
+  const Optional<uint32_t> key_frame = index().key_frame_before( frame_no );
+  unsigned int earliest = key_frame.initialized() ? key_frame.get() + 1 : 0;
+  if ( frame_no_ <= frame_no ) {
+    earliest = max( earliest, frame_no_ + 1 );
+  }
+
+  const uint32_t minihash = state.minihash();
+
+  for ( unsigned int start = frame_no + 1; start > earliest; start-- ) {
+    const Optional<uint32_t> indexed_minihash = index().decoder_minihash( start - 1 );
+    if ( indexed_minihash.initialized() and indexed_minihash.get() == minihash ) {
+      Decoder decoder = state;
+      set_decoder( decoder );
+      reposition( start - 1 );
+      decode_up_to( frame_no );
+      return;
+    }
+  }
+
+  seek( frame_no );
+}
+
+bool FilePlayer::eof( void )
 {
-  return frame_no_ == file_.frame_count();
+  return not file_.has_frame( frame_no_ );
 }
 
 long unsigned int FilePlayer::original_size( void ) const
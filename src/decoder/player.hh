@@ -34,24 +34,45 @@
 #include <memory>
 
 #include "ivf.hh"
+#include "ivf_stream.hh"
+#include "ivf_index.hh"
 #include "decoder.hh"
 #include "enc_state_serializer.hh"
 
+class ParsedFrame;
+
 class FramePlayer
 {
 friend std::ostream& operator<<( std::ostream &, const FramePlayer &);
 private:
   uint16_t width_, height_;
 
+  bool pipelining_ { false };
+
+  /* the next frame, parsed ahead of time; only used if the decoder is still
+     in the state it was parsed against */
+  std::shared_ptr<const ParsedFrame> parsed_next_ {};
+
+  Optional<RasterHandle> decode( const Chunk & chunk, const Optional<Chunk> & next_chunk );
+
 protected:
   Decoder decoder_; // FIXME ideally this would be private
 
+  /* forget the frame parsed ahead of time, when playback moves elsewhere */
+  void discard_parsed_frame( void ) { parsed_next_.reset(); }
+
 public:
   FramePlayer( const uint16_t width, const uint16_t height );
   FramePlayer( EncoderStateDeserializer &idata );
 
   Optional<RasterHandle> decode( const Chunk & chunk );
 
+  /* with pipelining enabled, next_chunk (the frame that will be decoded
+     next) is parsed on a second thread while chunk is being reconstructed.
+     Its bytes are not copied, so they must stay where they are until it has
+     been passed back in as chunk. */
+  Optional<RasterHandle> decode( const Chunk & chunk, const Chunk & next_chunk );
+
   const VP8Raster & example_raster( void ) const;
 
   uint16_t width( void ) const { return width_; }
@@ -64,34 +85,70 @@ public:
   References current_references() const { return decoder_.get_references(); }
   DecoderState current_state() const { return decoder_.get_state(); }
 
-  void set_decoder( Decoder & decoder ) { decoder_ = decoder; }
+  void set_decoder( Decoder & decoder )
+  {
+    const unsigned int threads = decoder_.decode_threads();
+    parsed_next_.reset();
+    decoder_ = decoder;
+    decoder_.set_decode_threads( threads );
+  }
 
   size_t serialize(EncoderStateSerializer &odata);
   static FramePlayer deserialize(EncoderStateDeserializer &idata);
 
-  void set_error_concealment( const bool value ) { decoder_.set_error_concealment( value ); }
+  void set_error_concealment( const bool value )
+  {
+    parsed_next_.reset();
+    decoder_.set_error_concealment( value );
+  }
+
+  void set_decode_threads( const unsigned int threads ) { decoder_.set_decode_threads( threads ); }
+
+  /* overlap parsing each frame with the reconstruction of the one before it;
+     output is identical either way */
+  void set_pipelining( const bool value )
+  {
+    pipelining_ = value;
+    parsed_next_.reset();
+  }
 };
 
 class FilePlayer : public FramePlayer
 {
 private:
-  IVF file_;
+  IVFStream file_;
   unsigned int frame_no_ { 0 };
   std::string filename_;
-  FilePlayer( const std::string & filename, IVF && file );
-  FilePlayer( const std::string & filename, IVF && file, EncoderStateDeserializer & idata );
+  Optional<IVFIndex> index_ {};
+  FilePlayer( const std::string & filename, IVFStream && file );
+  FilePlayer( const std::string & filename, IVFStream && file, EncoderStateDeserializer & idata );
+
+  const IVFIndex & index( void );
+  void reposition( const unsigned int frame_no );
+  void decode_up_to( const unsigned int frame_no );
 
 public:
-  FilePlayer( const std::string & filename );
+  /* "-" reads from standard input; with wait_ms, a file that is still
+     being written is followed until it stops growing for that long */
+  FilePlayer( const std::string & filename, const unsigned int wait_ms = 0 );
 
   RasterHandle advance();
-  bool eof() const;
+  bool eof();
+
+  /* makes frame_no the next frame advance() returns, decoding from the last
+     key frame before it, or carrying on from here if that is closer */
+  void seek( const unsigned int frame_no );
+
+  /* same, but may also start from a decoder state that was serialized part of
+     the way through the file; it is found through the minihashes in the index */
+  void seek( const unsigned int frame_no, const Decoder & state );
   unsigned int cur_frame_no() const { return frame_no_ - 1; }
 
   long unsigned int original_size() const;
 
   size_t serialize(EncoderStateSerializer &odata);
-  static FilePlayer deserialize(EncoderStateDeserializer &idata, const std::string &filename);
+  static FilePlayer deserialize(EncoderStateDeserializer &idata, const std::string &filename,
+                                const unsigned int wait_ms = 0);
 };
 
 using Player = FilePlayer;
@@ -27,7 +27,7 @@
    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #include <memory>
-#include <queue>
+#include <vector>
 #include <functional>
 #include <unordered_map>
 #include <cassert>
@@ -38,15 +38,6 @@
 
 using namespace std;
 
-/* helper to dequeue front element from a queue */
-template <typename T>
-static T dequeue( queue<T> & q )
-{
-  T ret { move( q.front() ) };
-  q.pop();
-  return ret;
-}
-
 bool RasterPoolDebug::allow_resize = false;
 
 template<class RasterType>
@@ -56,7 +47,9 @@ public:
   typedef std::unique_ptr<RasterType, RasterDeleter<RasterType>> VP8RasterHolder;
 
 private:
-  queue<VP8RasterHolder> unused_rasters_ {};
+  /* most recently freed first, and no allocation once these have grown */
+  vector<VP8RasterHolder> unused_rasters_ {};
+  vector<void *> unused_control_blocks_ {};
 
   mutex mutex_ {};
 
@@ -71,18 +64,19 @@ public:
     if ( unused_rasters_.empty() ) {
       ret.reset( new RasterType( display_width, display_height ) );
     } else {
-      if ( (unused_rasters_.front()->display_width() != display_width )
-           or (unused_rasters_.front()->display_height() != display_height ) ) {
+      if ( (unused_rasters_.back()->display_width() != display_width )
+           or (unused_rasters_.back()->display_height() != display_height ) ) {
         if (RasterPoolDebug::allow_resize) {
           while (! unused_rasters_.empty()) {
-            dequeue(unused_rasters_);
+            unused_rasters_.pop_back();
           }
           ret.reset(new RasterType(display_width, display_height));
         } else {
           throw Unsupported( "raster size has changed" );
         }
       } else {
-        ret = dequeue( unused_rasters_ );
+        ret = move( unused_rasters_.back() );
+        unused_rasters_.pop_back();
       }
     }
 
@@ -96,10 +90,80 @@ public:
     unique_lock<mutex> lock { mutex_ };
 
     assert( raster );
-    unused_rasters_.emplace( raster );
+    unused_rasters_.emplace_back( raster );
+  }
+
+  /* the reference counts of shared RasterHandles are recycled as well */
+  void * make_control_block( const size_t size )
+  {
+    unique_lock<mutex> lock { mutex_ };
+
+    if ( unused_control_blocks_.empty() ) {
+      return ::operator new( size );
+    }
+
+    void * ret = unused_control_blocks_.back();
+    unused_control_blocks_.pop_back();
+    return ret;
+  }
+
+  void free_control_block( void * block )
+  {
+    unique_lock<mutex> lock { mutex_ };
+
+    unused_control_blocks_.push_back( block );
   }
 };
 
+/* gets a shared_ptr's control block from the raster pool
+   (every one for a given RasterType has the same size) */
+template<class T, class RasterType>
+class ControlBlockAllocator
+{
+public:
+  typedef T value_type;
+
+  RasterPool<RasterType> * raster_pool_;
+
+  ControlBlockAllocator( RasterPool<RasterType> * pool ) : raster_pool_( pool ) {}
+
+  template<class U>
+  ControlBlockAllocator( const ControlBlockAllocator<U, RasterType> & other )
+    : raster_pool_( other.raster_pool_ )
+  {}
+
+  T * allocate( const size_t n )
+  {
+    assert( n == 1 );
+    return static_cast<T *>( raster_pool_->make_control_block( n * sizeof( T ) ) );
+  }
+
+  void deallocate( T * block, const size_t )
+  {
+    raster_pool_->free_control_block( block );
+  }
+
+  template<class U>
+  bool operator==( const ControlBlockAllocator<U, RasterType> & other ) const { return raster_pool_ == other.raster_pool_; }
+
+  template<class U>
+  bool operator!=( const ControlBlockAllocator<U, RasterType> & other ) const { return not operator==( other ); }
+};
+
+template<class RasterType>
+static shared_ptr<const RasterType> share_raster( unique_ptr<RasterType, RasterDeleter<RasterType>> && raster )
+{
+  RasterPool<RasterType> * const pool = raster.get_deleter().get_raster_pool();
+
+  if ( not pool ) {
+    return shared_ptr<const RasterType>( move( raster ) );
+  }
+
+  const RasterDeleter<RasterType> deleter = raster.get_deleter();
+  return shared_ptr<const RasterType>( raster.release(), deleter,
+                                       ControlBlockAllocator<RasterType, RasterType>( pool ) );
+}
+
 template<class RasterType>
 void RasterDeleter<RasterType>::operator()( RasterType * raster ) const
 {
@@ -115,6 +179,7 @@ void RasterDeleter<HashCachedRaster>::operator()( HashCachedRaster * raster ) co
 {
   if ( raster_pool_ ) {
     raster->reset_cache();
+    raster->discard_extended();
     raster_pool_->free_raster( raster );
   } else {
     delete raster;
@@ -165,12 +230,12 @@ VP8MutableRasterHandle<HashCachedRaster>::VP8MutableRasterHandle( const unsigned
 
 template<class RasterType>
 VP8RasterHandle<RasterType>::VP8RasterHandle( VP8MutableRasterHandle<RasterType> && mutable_raster )
-  : raster_( move( mutable_raster.raster_ ) )
+  : raster_( share_raster( move( mutable_raster.raster_ ) ) )
 {}
 
 template<>
 VP8RasterHandle<HashCachedRaster>::VP8RasterHandle( VP8MutableRasterHandle<HashCachedRaster> && mutable_raster )
-  : raster_( move( mutable_raster.raster_ ) )
+  : raster_( share_raster( move( mutable_raster.raster_ ) ) )
 {
   assert( not raster_->has_cache() );
 }
@@ -199,7 +264,7 @@ size_t HashCachedRaster::hash() const
   unique_lock<mutex> lock { mutex_ };
 
   if ( not frozen_hash_.initialized() ) {
-    frozen_hash_.initialize( VP8Raster::raw_hash() );
+    frozen_hash_.initialize( strips_hashed_ == hash_strip_count() ? strips_hash_ : VP8Raster::raw_hash() );
   }
 
   return frozen_hash_.get();
@@ -208,6 +273,18 @@ size_t HashCachedRaster::hash() const
 void HashCachedRaster::reset_cache()
 {
   frozen_hash_.clear();
+  strips_hash_ = 0;
+  strips_hashed_ = 0;
+}
+
+void HashCachedRaster::hash_strip( const unsigned int strip )
+{
+  if ( strip != strips_hashed_ ) {
+    throw LogicError();
+  }
+
+  strips_hash_ = fold_strip_hash( strips_hash_, strip_hash( strip ) );
+  strips_hashed_++;
 }
 
 bool HashCachedRaster::has_cache() const
@@ -218,6 +295,3 @@ bool HashCachedRaster::has_cache() const
 template class VP8MutableRasterHandle<HashCachedRaster>;
 template class VP8RasterHandle<HashCachedRaster>;
 template class RasterDeleter<HashCachedRaster>;
-template class VP8MutableRasterHandle<SafeRaster>;
-template class VP8RasterHandle<SafeRaster>;
-template class RasterDeleter<SafeRaster>;
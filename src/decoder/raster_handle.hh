@@ -50,6 +50,10 @@ class HashCachedRaster : public VP8Raster
 private:
   mutable Optional<size_t> frozen_hash_ {};
 
+  /* the strips hashed so far by hash_strip(), folded together */
+  uint64_t strips_hash_ { 0 };
+  unsigned int strips_hashed_ { 0 };
+
   mutable std::mutex mutex_ {};
 
 public:
@@ -58,6 +62,10 @@ public:
   size_t hash() const;
   void reset_cache();
 
+  /* hashes a strip (see BaseRaster) while its pixels are still in cache, once
+     they are final. If every strip is hashed, in order, hash() is free. */
+  void hash_strip( const unsigned int strip );
+
   bool has_cache() const;
 };
 
@@ -119,7 +127,4 @@ public:
 using MutableRasterHandle = VP8MutableRasterHandle<HashCachedRaster>;
 using RasterHandle = VP8RasterHandle<HashCachedRaster>;
 
-using MutableSafeRasterHandle = VP8MutableRasterHandle<SafeRaster>;
-using SafeRasterHandle = VP8RasterHandle<SafeRaster>;
-
 #endif /* RASTER_POOL_HH */
@@ -1,9 +1,51 @@
 #ifndef SAD_SSE_HH
 #define SAD_SSE_HH
 
+#include <cstdint>
+
 extern "C" {
   unsigned int vpx_sad16x16_sse2( const uint8_t *src, int src_stride,
                                   const uint8_t *ref, int ref_stride );
 }
 
+/* variance_sse2.cc */
+void vpx_get4x4var_sse2( const uint8_t *src, int src_stride,
+                         const uint8_t *ref, int ref_stride,
+                         unsigned int *sse, int *sum );
+void vpx_get8x8var_sse2( const uint8_t *src, int src_stride,
+                         const uint8_t *ref, int ref_stride,
+                         unsigned int *sse, int *sum );
+void vpx_get16x16var_sse2( const uint8_t *src, int src_stride,
+                           const uint8_t *ref, int ref_stride,
+                           unsigned int *sse, int *sum );
+unsigned int vpx_variance4x4_sse2( const uint8_t *src, int src_stride,
+                                   const uint8_t *ref, int ref_stride,
+                                   unsigned int *sse );
+unsigned int vpx_variance8x8_sse2( const uint8_t *src, int src_stride,
+                                   const uint8_t *ref, int ref_stride,
+                                   unsigned int *sse );
+unsigned int vpx_variance16x16_sse2( const uint8_t *src, int src_stride,
+                                     const uint8_t *ref, int ref_stride,
+                                     unsigned int *sse );
+
+/* variance_avx2.cc; sad_x4d scores four reference blocks against one source block */
+#define AVX2_SIZED_KERNELS( n )                                         \
+  unsigned int vpx_sad##n##x##n##_avx2( const uint8_t *src, int src_stride, \
+                                        const uint8_t *ref, int ref_stride ); \
+  void vpx_sad##n##x##n##x4d_avx2( const uint8_t *src, int src_stride, \
+                                   const uint8_t * const ref[ 4 ], int ref_stride, \
+                                   unsigned int sad[ 4 ] );            \
+  void vpx_get##n##x##n##var_avx2( const uint8_t *src, int src_stride, \
+                                   const uint8_t *ref, int ref_stride, \
+                                   unsigned int *sse, int *sum );      \
+  unsigned int vpx_variance##n##x##n##_avx2( const uint8_t *src, int src_stride, \
+                                             const uint8_t *ref, int ref_stride, \
+                                             unsigned int *sse );
+
+AVX2_SIZED_KERNELS( 4 )
+AVX2_SIZED_KERNELS( 8 )
+AVX2_SIZED_KERNELS( 16 )
+
+#undef AVX2_SIZED_KERNELS
+
 #endif /* SAD_SSE_HH */
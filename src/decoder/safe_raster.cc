@@ -27,26 +27,68 @@
    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #include "vp8_raster.hh"
-#include "raster_handle.hh"
-#include "decoder.hh"
+#include "exception.hh"
 
-SafeRaster::SafeRaster( uint16_t width, uint16_t height )
-  : safe_Y_( width + MARGIN_WIDTH * 2, height + MARGIN_WIDTH * 2 ),
-    display_width_( width ), display_height_( height )
+using namespace std;
+
+SafeRaster::SafeRaster( const uint16_t width, const uint16_t height, const size_t margin_width )
+  : plane_( width + margin_width * 2, height + margin_width * 2 ),
+    display_width_( width ), display_height_( height ),
+    margin_width_( margin_width )
 {}
 
-SafeRaster::SafeRaster( const VP8Raster & source )
-  : SafeRaster( source.width(), source.height() )
+void SafeRaster::copy_plane( const TwoD<uint8_t> & source )
 {
-  copy_raster( source );
+  if ( source.width() != display_width_ or source.height() != display_height_ ) {
+    throw LogicError();
+  }
+
+  for ( size_t nrow = 0; nrow < display_height_; nrow++ ) {
+    memcpy( &plane_.at( margin_width_, margin_width_ + nrow ),
+            &source.at( 0, nrow ),
+            display_width_ );
+  }
+
+  extend_edges();
+
+  has_pyramid_ = false;
 }
 
-void SafeRaster::copy_raster( const VP8Raster & source )
+void SafeRaster::downsample( const SafeRaster & finer )
 {
-  const TwoD<uint8_t> & original_Y = source.Y();
-  const uint16_t original_width = original_Y.width();
-  const uint16_t original_height = original_Y.height();
+  /* an odd row or column at the edge of the finer level is averaged with its margin */
+  for ( int nrow = 0; nrow < display_height_; nrow++ ) {
+    const uint8_t * above = &finer.at( 0, nrow * 2 );
+    const uint8_t * below = &finer.at( 0, nrow * 2 + 1 );
+    uint8_t * target = &plane_.at( margin_width_, margin_width_ + nrow );
+
+    for ( int ncolumn = 0; ncolumn < display_width_; ncolumn++ ) {
+      target[ ncolumn ] = ( above[ ncolumn * 2 ] + above[ ncolumn * 2 + 1 ]
+                            + below[ ncolumn * 2 ] + below[ ncolumn * 2 + 1 ] + 2 ) >> 2;
+    }
+  }
+
+  extend_edges();
+}
 
+void SafeRaster::build_pyramid() const
+{
+  const SafeRaster * finer = this;
+
+  for ( unsigned int level = 1; level < PYRAMID_LEVELS; level++ ) {
+    if ( not finer->half_ ) {
+      finer->half_.reset( new SafeRaster( ( finer->display_width_ + 1 ) / 2,
+                                          ( finer->display_height_ + 1 ) / 2,
+                                          finer->margin_width_ / 2 ) );
+    }
+
+    finer->half_->downsample( *finer );
+    finer = finer->half_.get();
+  }
+}
+
+void SafeRaster::extend_edges()
+{
   /*
        1   |   2   |   3
     -----------------------
@@ -54,59 +96,98 @@ void SafeRaster::copy_raster( const VP8Raster & source )
     -----------------------
        7   |   8   |   9
 
-    The original image goes into 5.
+    The picture is in 5. Each row of it is extended into 4 and 6, and
+    then the first and last full rows are repeated into 1-3 and 7-9.
   */
 
-  for ( size_t nrow = 0; nrow < safe_Y_.height(); nrow++ ) {
-    if ( nrow < MARGIN_WIDTH ) {
-      memset( &safe_Y_.at( 0, nrow ),
-              original_Y.at( 0, 0 ),
-              MARGIN_WIDTH ); // (1)
+  for ( size_t nrow = margin_width_; nrow < margin_width_ + display_height_; nrow++ ) {
+    memset( &plane_.at( 0, nrow ),
+            plane_.at( margin_width_, nrow ),
+            margin_width_ ); // (4)
+
+    memset( &plane_.at( margin_width_ + display_width_, nrow ),
+            plane_.at( margin_width_ + display_width_ - 1, nrow ),
+            margin_width_ ); // (6)
+  }
 
-      memcpy( &safe_Y_.at( MARGIN_WIDTH, nrow ),
-              &original_Y.at( 0, 0 ),
-              original_width ); // (2)
+  for ( size_t nrow = 0; nrow < margin_width_; nrow++ ) {
+    memcpy( &plane_.at( 0, nrow ),
+            &plane_.at( 0, margin_width_ ),
+            stride() ); // (1, 2, 3)
 
-      memset( &safe_Y_.at( MARGIN_WIDTH + original_width, nrow ),
-              original_Y.at( original_width - 1, 0 ),
-              MARGIN_WIDTH ); // (3)
-    }
-    else if ( nrow >= MARGIN_WIDTH + original_Y.height() ) {
-      memset( &safe_Y_.at( 0, nrow ),
-              original_Y.at( 0, original_height - 1 ),
-              MARGIN_WIDTH ); // (7)
-
-      memcpy( &safe_Y_.at( MARGIN_WIDTH, nrow ),
-              &original_Y.at( 0, original_height - 1 ),
-              original_width ); // (8)
-
-      memset( &safe_Y_.at( MARGIN_WIDTH + original_width, nrow ),
-              original_Y.at( original_width - 1, original_height - 1 ),
-              MARGIN_WIDTH ); // (9)
-    }
-    else {
-      memset( &safe_Y_.at( 0, nrow ),
-              original_Y.at( 0, nrow - MARGIN_WIDTH ),
-              MARGIN_WIDTH ); // (4)
-
-      memcpy( &safe_Y_.at( MARGIN_WIDTH, nrow ),
-              &original_Y.at( 0, nrow - MARGIN_WIDTH ),
-              original_width ); // (5)
-
-      memset( &safe_Y_.at( MARGIN_WIDTH + original_width, nrow ),
-              original_Y.at( original_width - 1, nrow - MARGIN_WIDTH ),
-              MARGIN_WIDTH ); // (6)
-    }
+    memcpy( &plane_.at( 0, margin_width_ + display_height_ + nrow ),
+            &plane_.at( 0, margin_width_ + display_height_ - 1 ),
+            stride() ); // (7, 8, 9)
   }
 }
 
-const uint8_t & SafeRaster::at( int  column, int row ) const
+const uint8_t & SafeRaster::at( int column, int row ) const
 {
-  assert( (int)MARGIN_WIDTH + column >= 0 and (int)MARGIN_WIDTH + row >= 0 );
-  return safe_Y_.at( (int)MARGIN_WIDTH + column, (int)MARGIN_WIDTH + row );
+  assert( (int)margin_width_ + column >= 0 and (int)margin_width_ + row >= 0 );
+  return plane_.at( (int)margin_width_ + column, (int)margin_width_ + row );
 }
 
 unsigned int SafeRaster::stride() const
 {
-  return safe_Y_.width();
+  return plane_.width();
+}
+
+const SafeRaster & SafeRaster::level( const unsigned int level ) const
+{
+  if ( level >= PYRAMID_LEVELS ) {
+    throw LogicError();
+  }
+
+  /* several encoders can search the same reference at once */
+  if ( level > 0 and not has_pyramid_.load( memory_order_acquire ) ) {
+    lock_guard<mutex> lock { pyramid_mutex_ };
+
+    if ( not has_pyramid_.load( memory_order_relaxed ) ) {
+      build_pyramid();
+      has_pyramid_.store( true, memory_order_release );
+    }
+  }
+
+  const SafeRaster * ret = this;
+  for ( unsigned int i = 0; i < level; i++ ) {
+    ret = ret->half_.get();
+  }
+
+  return *ret;
+}
+
+VP8Raster::ExtendedPlanes::ExtendedPlanes( const VP8Raster & raster )
+  : Y( raster.Y().width(), raster.Y().height(), BORDER ),
+    U( raster.U().width(), raster.U().height(), BORDER / 2 ),
+    V( raster.V().width(), raster.V().height(), BORDER / 2 )
+{}
+
+void VP8Raster::extend_borders() const
+{
+  if ( has_extended_.load( memory_order_acquire ) ) {
+    return;
+  }
+
+  lock_guard<mutex> lock { extended_mutex_ };
+
+  if ( has_extended_.load( memory_order_relaxed ) ) {
+    return;
+  }
+
+  /* a raster from the pool keeps its extended planes for the next picture */
+  if ( not extended_ ) {
+    extended_.reset( new ExtendedPlanes( *this ) );
+  }
+
+  extended_->Y.copy_plane( Y() );
+  extended_->U.copy_plane( U() );
+  extended_->V.copy_plane( V() );
+
+  has_extended_.store( true, memory_order_release );
+}
+
+const VP8Raster::ExtendedPlanes & VP8Raster::extended() const
+{
+  extend_borders();
+  return *extended_;
 }
@@ -54,6 +54,8 @@ void Block< initial_block_type,
 {
   bool last_was_zero = false;
 
+  eob_ = 0;
+
   /* prediction context starts with number-not-zero count */
   char token_context = ( context().above.initialized() ? context().above.get()->has_nonzero() : 0 )
     + ( context().left.initialized() ? context().left.get()->has_nonzero() : 0 );
@@ -131,5 +133,6 @@ void Block< initial_block_type,
 
     /* assign to block storage */
     coefficients_.at( zigzag.at( index ) ) = value;
+    eob_ = index + 1;
   }
 }
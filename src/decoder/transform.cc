@@ -29,13 +29,13 @@
 #include "macroblock.hh"
 #include "block.hh"
 #include "safe_array.hh"
-#include "transform_sse.hh"
-#include "dct_sse.hh"
+#include "kernels.hh"
 
 template <>
 void YBlock::set_dc_coefficient( const int16_t & val )
 {
   coefficients_.set_dc_coefficient( val );
+  eob_ = std::max( eob_, uint8_t( 1 ) );
   set_Y_without_Y2();
 }
 
@@ -44,98 +44,77 @@ void DCTCoefficients::set_dc_coefficient( const int16_t & val )
   coefficients_.at( 0 ) = val;
 }
 
-void DCTCoefficients::iwht( SafeArray<SafeArray<DCTCoefficients, 4>, 4> & output ) const
+void DCTCoefficients::iwht( SafeArray<SafeArray<DCTCoefficients, 4>, 4> & output, const uint8_t eob ) const
 {
-#ifdef HAVE_SSE2
-
-  vp8_short_inv_walsh4x4_sse2( &at( 0 ), &output.at( 0 ).at( 0 ).at( 0 ) );
-
-#else
-
-  SafeArray< int16_t, 16 > intermediate;
-
-  for ( size_t i = 0; i < 4; i++ ) {
-    int a1 = coefficients_.at( i + 0 ) + coefficients_.at( i + 12 );
-    int b1 = coefficients_.at( i + 4 ) + coefficients_.at( i + 8  );
-    int c1 = coefficients_.at( i + 4 ) - coefficients_.at( i + 8  );
-    int d1 = coefficients_.at( i + 0 ) - coefficients_.at( i + 12 );
-
-    intermediate.at( i + 0  ) = a1 + b1;
-    intermediate.at( i + 4  ) = c1 + d1;
-    intermediate.at( i + 8  ) = a1 - b1;
-    intermediate.at( i + 12 ) = d1 - c1;
+  if ( eob > 1 ) {
+    iwht( output );
+    return;
   }
 
-  for ( size_t i = 0; i < 4; i++ ) {
-    const uint8_t offset = i * 4;
-    int a1 = intermediate.at( offset + 0 ) + intermediate.at( offset + 3 );
-    int b1 = intermediate.at( offset + 1 ) + intermediate.at( offset + 2 );
-    int c1 = intermediate.at( offset + 1 ) - intermediate.at( offset + 2 );
-    int d1 = intermediate.at( offset + 0 ) - intermediate.at( offset + 3 );
-
-    int a2 = a1 + b1;
-    int b2 = c1 + d1;
-    int c2 = a1 - b1;
-    int d2 = d1 - c1;
-
-    output.at( i ).at( 0 ).at( 0 ) = ( a2 + 3 ) >> 3;
-    output.at( i ).at( 1 ).at( 0 ) = ( b2 + 3 ) >> 3;
-    output.at( i ).at( 2 ).at( 0 ) = ( c2 + 3 ) >> 3;
-    output.at( i ).at( 3 ).at( 0 ) = ( d2 + 3 ) >> 3;
-  }
+  /* with only a DC coefficient, every output of the inverse WHT is the same */
+  const int16_t dc = ( coefficients_.at( 0 ) + 3 ) >> 3;
 
-#endif
+  for ( size_t row = 0; row < 4; row++ ) {
+    for ( size_t column = 0; column < 4; column++ ) {
+      output.at( row ).at( column ).at( 0 ) = dc;
+    }
+  }
 }
 
-#ifdef HAVE_SSE2
-
-void DCTCoefficients::idct_add( VP8Raster::Block4 & output ) const
+void DCTCoefficients::iwht( SafeArray<SafeArray<DCTCoefficients, 4>, 4> & output ) const
 {
-
-  vp8_short_idct4x4llm_mmx( &coefficients_.at( 0 ), &output.at( 0, 0 ), output.stride(), &output.at( 0, 0 ), output.stride() );
+  kernels().inverse_walsh4x4( &at( 0 ), &output.at( 0 ).at( 0 ).at( 0 ) );
 }
 
-#else
-
 static inline int MUL_20091( const int a ) { return ((((a)*20091) >> 16) + (a)); }
 static inline int MUL_35468( const int a ) { return (((a)*35468) >> 16); }
 
-void DCTCoefficients::idct_add( VP8Raster::Block4 & output ) const
+/* adds the same four residues (one per column) to each row of the block */
+static void add_row_residue( VP8Raster::Block4 & output, const SafeArray< int16_t, 4 > & residue )
 {
-  SafeArray< int16_t, 16 > intermediate;
+  kernels().add_row_residue( &output.at( 0, 0 ), output.stride(), &residue.at( 0 ) );
+}
 
-  /* Based on libav/ffmpeg vp8_idct_add_c */
+void DCTCoefficients::idct_dc_add( VP8Raster::Block4 & output ) const
+{
+  /* a lone DC coefficient adds ( DC + 4 ) >> 3 to every pixel */
+  const int16_t residue = ( coefficients_.at( 0 ) + 4 ) >> 3;
 
-  for ( int i = 0; i < 4; i++ ) {
-    int t0 = coefficients_.at( i + 0 ) + coefficients_.at( i + 8 );
-    int t1 = coefficients_.at( i + 0 ) - coefficients_.at( i + 8 );
-    int t2 = MUL_35468( coefficients_.at( i + 4 ) ) - MUL_20091( coefficients_.at( i + 12 ) );
-    int t3 = MUL_20091( coefficients_.at( i + 4 ) ) + MUL_35468( coefficients_.at( i + 12 ) );
+  add_row_residue( output, {{ residue, residue, residue, residue }} );
+}
 
-    intermediate.at( i * 4 + 0 ) = t0 + t3;
-    intermediate.at( i * 4 + 1 ) = t1 + t2;
-    intermediate.at( i * 4 + 2 ) = t1 - t2;
-    intermediate.at( i * 4 + 3 ) = t0 - t3;
-  }
+void DCTCoefficients::idct_row_add( VP8Raster::Block4 & output ) const
+{
+  /* if only the first row is nonzero, the vertical pass copies it down
+     unchanged and every row of the output gets the same residue */
+  const int t0 = coefficients_.at( 0 ) + coefficients_.at( 2 );
+  const int t1 = coefficients_.at( 0 ) - coefficients_.at( 2 );
+  const int t2 = MUL_35468( coefficients_.at( 1 ) ) - MUL_20091( coefficients_.at( 3 ) );
+  const int t3 = MUL_20091( coefficients_.at( 1 ) ) + MUL_35468( coefficients_.at( 3 ) );
+
+  add_row_residue( output, {{ int16_t( ( t0 + t3 + 4 ) >> 3 ),
+                              int16_t( ( t1 + t2 + 4 ) >> 3 ),
+                              int16_t( ( t1 - t2 + 4 ) >> 3 ),
+                              int16_t( ( t0 - t3 + 4 ) >> 3 ) }} );
+}
 
-  for ( int i = 0; i < 4; i++ ) {
-    int t0 = intermediate.at( i + 0 ) + intermediate.at( i + 8 );
-    int t1 = intermediate.at( i + 0 ) - intermediate.at( i + 8 );
-    int t2 = MUL_35468( intermediate.at( i + 4 ) ) - MUL_20091( intermediate.at( i + 12 ) );
-    int t3 = MUL_20091( intermediate.at( i + 4 ) ) + MUL_35468( intermediate.at( i + 12 ) );
-
-    uint8_t *target = &output.at( 0, i );
-
-    *target = clamp255( *target + ((t0 + t3 + 4) >> 3) );
-    target++;
-    *target = clamp255( *target + ((t1 + t2 + 4) >> 3) );
-    target++;
-    *target = clamp255( *target + ((t1 - t2 + 4) >> 3) );
-    target++;
-    *target = clamp255( *target + ((t0 - t3 + 4) >> 3) );
+void DCTCoefficients::idct_add( VP8Raster::Block4 & output, const uint8_t eob ) const
+{
+  /* zigzag indices 0 and 1 are coefficients 0 and 1, both in the first row */
+  if ( eob <= 1 ) {
+    idct_dc_add( output );
+  } else if ( eob <= 2 ) {
+    idct_row_add( output );
+  } else {
+    idct_add( output );
   }
 }
-#endif
+
+void DCTCoefficients::idct_add( VP8Raster::Block4 & output ) const
+{
+  kernels().idct4x4_add( &coefficients_.at( 0 ), &output.at( 0, 0 ), output.stride(),
+                         &output.at( 0, 0 ), output.stride() );
+}
 
 template <BlockType initial_block_type, class PredictionMode>
 void Block< initial_block_type, PredictionMode >::add_residue( VP8Raster::Block4 & output ) const
@@ -145,3 +124,14 @@ void Block< initial_block_type, PredictionMode >::add_residue( VP8Raster::Block4
                                           + coefficients_.at( zigzag.at( i ) ) );
   }
 }
+
+template <BlockType initial_block_type, class PredictionMode>
+void Block< initial_block_type, PredictionMode >::dequantize_idct_add( const Quantizer & quantizer,
+                                                                       VP8Raster::Block4 & output ) const
+{
+  if ( eob_ == 0 ) {
+    return;
+  }
+
+  dequantize( quantizer ).idct_add( output, eob_ );
+}
@@ -129,27 +129,23 @@ UncompressedChunk::UncompressedChunk( const Chunk & frame,
   }
 }
 
-const vector< Chunk > UncompressedChunk::dct_partitions( const uint8_t num ) const
+Chunk UncompressedChunk::dct_partition( const uint8_t num, const uint8_t index ) const
 {
-  /* extract the rest of the partitions */
-  Chunk rest_of_frame = rest_;
-
-  /* get the lengths of all DCT partitions except the last one */
-  vector< uint32_t > partition_lengths;
-  for ( uint8_t i = 0; i < num - 1; i++ ) {
-    partition_lengths.push_back( rest_of_frame.bits( 0, 24 ) );
-    rest_of_frame = rest_of_frame( 3 );
-  }
+  assert( index < num );
+
+  /* the lengths of all DCT partitions except the last one come first */
+  const Chunk partition_lengths = rest_( 0, 3 * ( num - 1 ) );
+  Chunk rest_of_frame = rest_( 3 * ( num - 1 ) );
 
-  /* make all the DCT partitions */
-  vector< Chunk > dct_partitions;
-  for ( const auto & length : partition_lengths ) {
-    dct_partitions.emplace_back( rest_of_frame( 0, length ) );
-    rest_of_frame = rest_of_frame( length );
+  /* skip the partitions before this one */
+  for ( uint8_t i = 0; i < index; i++ ) {
+    rest_of_frame = rest_of_frame( partition_lengths( 3 * i ).bits( 0, 24 ) );
   }
 
-  /* make the last DCT partition */
-  dct_partitions.emplace_back( rest_of_frame );
+  /* the last DCT partition takes up the rest of the frame */
+  if ( index == num - 1 ) {
+    return rest_of_frame;
+  }
 
-  return dct_partitions;
+  return rest_of_frame( 0, partition_lengths( 3 * index ).bits( 0, 24 ) );
 }
@@ -66,7 +66,10 @@ public:
   bool key_frame( void ) const { return key_frame_; }
 
   const Chunk & first_partition( void ) const { return first_partition_; }
-  const std::vector< Chunk > dct_partitions( const uint8_t num ) const;
+  /* a frame has 1, 2, 4 or 8 DCT partitions */
+  static constexpr uint8_t max_dct_partitions = 8;
+
+  Chunk dct_partition( const uint8_t num, const uint8_t index ) const;
 
   LoopFilterType loop_filter_type( void ) const { return loop_filter_; }
   bool show_frame( void ) const { return show_frame_; }
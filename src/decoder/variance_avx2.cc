@@ -0,0 +1,196 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* Copyright 2013-2018 the Alfalfa authors
+                       and the Massachusetts Institute of Technology
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+      1. Redistributions of source code must retain the above copyright
+         notice, this list of conditions and the following disclaimer.
+
+      2. Redistributions in binary form must reproduce the above copyright
+         notice, this list of conditions and the following disclaimer in the
+         documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+#include <config.h>
+
+#ifdef __SSE2__
+
+#include <immintrin.h>
+#include <cstring>
+
+#include "sad_sse.hh"
+
+/* These are compiled for AVX2 regardless of the build's flags, and are only
+   called once the CPU is known to support it (see kernels.cc). */
+#define AVX2 __attribute__(( target( "avx2" ) ))
+
+/* 16 bytes holding 16 / size consecutive rows of a block */
+template <unsigned int size>
+AVX2 static inline __m128i load_rows( const uint8_t * p, const int stride );
+
+template <>
+AVX2 inline __m128i load_rows<16>( const uint8_t * p, const int )
+{
+  return _mm_loadu_si128( reinterpret_cast<const __m128i *>( p ) );
+}
+
+template <>
+AVX2 inline __m128i load_rows<8>( const uint8_t * p, const int stride )
+{
+  return _mm_unpacklo_epi64( _mm_loadl_epi64( reinterpret_cast<const __m128i *>( p ) ),
+                             _mm_loadl_epi64( reinterpret_cast<const __m128i *>( p + stride ) ) );
+}
+
+template <>
+AVX2 inline __m128i load_rows<4>( const uint8_t * p, const int stride )
+{
+  int32_t rows[ 4 ];
+  for ( unsigned int row = 0; row < 4; row++ ) {
+    memcpy( &rows[ row ], p + row * stride, sizeof( int32_t ) );
+  }
+  return _mm_set_epi32( rows[ 3 ], rows[ 2 ], rows[ 1 ], rows[ 0 ] );
+}
+
+/* 32 bytes holding 32 / size consecutive rows (all four rows for a 4x4 block,
+   in the low half) */
+template <unsigned int size>
+AVX2 static inline __m256i load_rows_256( const uint8_t * p, const int stride )
+{
+  constexpr unsigned int rows = 16 / size;
+  return _mm256_inserti128_si256( _mm256_castsi128_si256( load_rows<size>( p, stride ) ),
+                                  size == 4 ? _mm_setzero_si128()
+                                            : load_rows<size>( p + rows * stride, stride ), 1 );
+}
+
+/* rows of the block covered by one load_rows_256 */
+template <unsigned int size>
+constexpr unsigned int rows_per_256( void ) { return size == 4 ? 4 : 32 / size; }
+
+AVX2 static inline unsigned int sum_epi64( const __m256i v )
+{
+  const __m128i halves = _mm_add_epi64( _mm256_castsi256_si128( v ), _mm256_extracti128_si256( v, 1 ) );
+  return _mm_cvtsi128_si32( _mm_add_epi64( halves, _mm_srli_si128( halves, 8 ) ) );
+}
+
+AVX2 static inline int sum_epi32( const __m256i v )
+{
+  __m128i sum = _mm_add_epi32( _mm256_castsi256_si128( v ), _mm256_extracti128_si256( v, 1 ) );
+  sum = _mm_add_epi32( sum, _mm_srli_si128( sum, 8 ) );
+  sum = _mm_add_epi32( sum, _mm_srli_si128( sum, 4 ) );
+  return _mm_cvtsi128_si32( sum );
+}
+
+template <unsigned int size>
+AVX2 static inline unsigned int sad_avx2( const uint8_t * src, const int src_stride,
+                                          const uint8_t * ref, const int ref_stride )
+{
+  __m256i sad = _mm256_setzero_si256();
+
+  for ( unsigned int row = 0; row < size; row += rows_per_256<size>() ) {
+    sad = _mm256_add_epi64( sad, _mm256_sad_epu8( load_rows_256<size>( src + row * src_stride, src_stride ),
+                                                  load_rows_256<size>( ref + row * ref_stride, ref_stride ) ) );
+  }
+
+  return sum_epi64( sad );
+}
+
+/* each source row is loaded once and compared with all four references */
+template <unsigned int size>
+AVX2 static inline void sad_x4_avx2( const uint8_t * src, const int src_stride,
+                                     const uint8_t * const ref[ 4 ], const int ref_stride,
+                                     unsigned int sad[ 4 ] )
+{
+  __m256i sad0 = _mm256_setzero_si256();
+  __m256i sad1 = _mm256_setzero_si256();
+  __m256i sad2 = _mm256_setzero_si256();
+  __m256i sad3 = _mm256_setzero_si256();
+
+  for ( unsigned int row = 0; row < size; row += rows_per_256<size>() ) {
+    const __m256i source = load_rows_256<size>( src + row * src_stride, src_stride );
+    const int offset = row * ref_stride;
+
+    sad0 = _mm256_add_epi64( sad0, _mm256_sad_epu8( source, load_rows_256<size>( ref[ 0 ] + offset, ref_stride ) ) );
+    sad1 = _mm256_add_epi64( sad1, _mm256_sad_epu8( source, load_rows_256<size>( ref[ 1 ] + offset, ref_stride ) ) );
+    sad2 = _mm256_add_epi64( sad2, _mm256_sad_epu8( source, load_rows_256<size>( ref[ 2 ] + offset, ref_stride ) ) );
+    sad3 = _mm256_add_epi64( sad3, _mm256_sad_epu8( source, load_rows_256<size>( ref[ 3 ] + offset, ref_stride ) ) );
+  }
+
+  sad[ 0 ] = sum_epi64( sad0 );
+  sad[ 1 ] = sum_epi64( sad1 );
+  sad[ 2 ] = sum_epi64( sad2 );
+  sad[ 3 ] = sum_epi64( sad3 );
+}
+
+/* the differences are widened to 16 bits, sixteen at a time */
+template <unsigned int size>
+AVX2 static inline void get_variance_avx2( const uint8_t * src, const int src_stride,
+                                           const uint8_t * ref, const int ref_stride,
+                                           unsigned int * sse, int * sum )
+{
+  constexpr unsigned int rows = 16 / size;
+
+  __m256i differences = _mm256_setzero_si256();
+  __m256i squares = _mm256_setzero_si256();
+
+  for ( unsigned int row = 0; row < size; row += rows ) {
+    const __m256i diff = _mm256_sub_epi16( _mm256_cvtepu8_epi16( load_rows<size>( src + row * src_stride, src_stride ) ),
+                                           _mm256_cvtepu8_epi16( load_rows<size>( ref + row * ref_stride, ref_stride ) ) );
+    differences = _mm256_add_epi16( differences, diff );
+    squares = _mm256_add_epi32( squares, _mm256_madd_epi16( diff, diff ) );
+  }
+
+  *sse = sum_epi32( squares );
+  if ( sum ) {
+    *sum = sum_epi32( _mm256_madd_epi16( differences, _mm256_set1_epi16( 1 ) ) );
+  }
+}
+
+template <unsigned int size>
+AVX2 static inline unsigned int variance_avx2( const uint8_t * src, const int src_stride,
+                                               const uint8_t * ref, const int ref_stride,
+                                               unsigned int * sse )
+{
+  int sum;
+  get_variance_avx2<size>( src, src_stride, ref, ref_stride, sse, &sum );
+  return *sse - ( int64_t( sum ) * sum ) / ( size * size );
+}
+
+#define SIZED_KERNELS( n )                                              \
+  AVX2 unsigned int vpx_sad##n##x##n##_avx2( const uint8_t * src, int src_stride, \
+                                             const uint8_t * ref, int ref_stride ) \
+  { return sad_avx2<n>( src, src_stride, ref, ref_stride ); }          \
+                                                                        \
+  AVX2 void vpx_sad##n##x##n##x4d_avx2( const uint8_t * src, int src_stride, \
+                                        const uint8_t * const ref[ 4 ], int ref_stride, \
+                                        unsigned int sad[ 4 ] )        \
+  { sad_x4_avx2<n>( src, src_stride, ref, ref_stride, sad ); }         \
+                                                                        \
+  AVX2 void vpx_get##n##x##n##var_avx2( const uint8_t * src, int src_stride, \
+                                        const uint8_t * ref, int ref_stride, \
+                                        unsigned int * sse, int * sum ) \
+  { get_variance_avx2<n>( src, src_stride, ref, ref_stride, sse, sum ); } \
+                                                                        \
+  AVX2 unsigned int vpx_variance##n##x##n##_avx2( const uint8_t * src, int src_stride, \
+                                                  const uint8_t * ref, int ref_stride, \
+                                                  unsigned int * sse ) \
+  { return variance_avx2<n>( src, src_stride, ref, ref_stride, sse ); }
+
+SIZED_KERNELS( 4 )
+SIZED_KERNELS( 8 )
+SIZED_KERNELS( 16 )
+
+#endif
@@ -29,6 +29,7 @@
 #ifndef VP8_HEADER_STRUCTURES_HH
 #define VP8_HEADER_STRUCTURES_HH
 
+#include <array>
 #include <vector>
 #include <type_traits>
 
@@ -97,26 +98,23 @@ public:
 };
 
 /* An Array of VP8 header elements.
-   A header element may optionally take its position in the array as an argument. */
+   A header element may optionally take its position in the array as an argument.
+   The elements are stored inline, so parsing a header doesn't allocate. */
 
 template <class T, unsigned int len>
 class Array
 {
 protected:
-  std::vector< T > storage_;
-
-  Array( const bool ) : storage_() {}
+  std::array< T, len > storage_ {};
 
 public:
-  Array() : storage_( len, T() ) {}
+  Array() {}
 
   template < typename... Targs >
   Array( BoolDecoder & data, Targs&&... Fargs )
-    : storage_()
   {
-    storage_.reserve( len );
     for ( unsigned int i = 0; i < len; i++ ) {
-      storage_.emplace_back( data, std::forward<Targs>( Fargs )... );
+      storage_[ i ] = T( data, std::forward<Targs>( Fargs )... );
     }
   }
 
@@ -151,11 +149,10 @@ public:
 
   template < typename... Targs >
   Enumerate( BoolDecoder & data, Targs&&... Fargs )
-    : Array<T,size>( false )
+    : Array<T,size>()
   {
-    Array<T, size>::storage_.reserve( size );
     for ( unsigned int i = 0; i < size; i++ ) {
-      Array<T, size>::storage_.emplace_back( data, i, std::forward<Targs>( Fargs )... );
+      Array<T, size>::storage_[ i ] = T( data, i, std::forward<Targs>( Fargs )... );
     }
   }
 };
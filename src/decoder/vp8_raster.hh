@@ -30,14 +30,13 @@
 #define VP8_RASTER_H
 
 #include <iostream>
+#include <memory>
+#include <atomic>
+#include <mutex>
 
 #include "config.h"
 #include "raster.hh"
 
-#ifdef HAVE_SSE2
-#include "predictor_sse.hh"
-#endif
-
 class MotionVector;
 
 template <class integer>
@@ -48,7 +47,55 @@ static inline uint8_t clamp255( const integer value )
   return value;
 }
 
-class SafeRaster;
+/* A plane with its edge pixels replicated into a margin all around it, like
+   libvpx's frame borders, so that a block partly or wholly outside of the
+   picture can be read without bounds checks. */
+class SafeRaster
+{
+private:
+  TwoD<uint8_t> plane_;
+
+  uint16_t display_width_;
+  uint16_t display_height_;
+
+  size_t margin_width_;
+
+  /* the same plane at half the resolution (and so on), for coarse motion
+     searches. They are only made the first time they are asked for. */
+  mutable std::unique_ptr<SafeRaster> half_ {};
+  mutable std::atomic<bool> has_pyramid_ { false };
+  mutable std::mutex pyramid_mutex_ {};
+
+  /* fills the margins from the edges of the picture */
+  void extend_edges();
+
+  /* averages each 2x2 square of the finer level into one pixel */
+  void downsample( const SafeRaster & finer );
+
+  void build_pyramid() const;
+
+public:
+  /* the full-resolution plane and two downsampled ones */
+  static const unsigned int PYRAMID_LEVELS = 3;
+
+  SafeRaster( const uint16_t width, const uint16_t height, const size_t margin_width );
+
+  uint16_t display_width() const { return display_width_; }
+  uint16_t display_height() const { return display_height_; }
+  size_t margin_width() const { return margin_width_; }
+
+  /* Copies the given plane to the target buffer and does the edge extension.
+     The downsampled levels are rebuilt when they are next asked for. */
+  void copy_plane( const TwoD<uint8_t> & source );
+
+  const uint8_t & at( int column, int row ) const;
+
+  unsigned int stride() const;
+
+  /* level 0 is this plane; each level has half the resolution of the one before,
+     and a margin that covers the same distance in full-resolution pixels */
+  const SafeRaster & level( const unsigned int level ) const;
+};
 
 class VP8Raster : public BaseRaster
 {
@@ -122,42 +169,13 @@ public:
                         TwoDSubRange<uint8_t, size, size> & output ) const;
 
     void inter_predict( const MotionVector & mv,
-                        const TwoD<uint8_t> & reference ) { inter_predict( mv, reference, this->contents_ ); }
-
-    void inter_predict( const MotionVector & mv,
-                        const TwoD<uint8_t> & reference,
-                        TwoDSubRange<uint8_t, size, size> & output ) const;
-
-    /* for encoder use */
-    void inter_predict( const MotionVector & mv,
-                        const TwoD<uint8_t> & reference,
-                        TwoD<uint8_t> & output ) const;
+                        const SafeRaster & reference ) { inter_predict( mv, reference, this->contents_ ); }
 
+    /* reads the reference without bounds checks, for any motion vector */
     void inter_predict( const MotionVector & mv,
                         const SafeRaster & reference,
                         TwoDSubRange<uint8_t, size, size> & output ) const;
 
-    template <class ReferenceType>
-    void safe_inter_predict( const MotionVector & mv,
-                             const ReferenceType & reference,
-                             const int source_column, const int source_row,
-                             TwoDSubRange<uint8_t, size, size> & output ) const;
-
-    void unsafe_inter_predict( const MotionVector & mv,
-                               const TwoD<uint8_t> & reference,
-                               const int source_column, const int source_row,
-                               TwoDSubRange<uint8_t, size, size> & output ) const;
-
-#ifdef HAVE_SSE2
-    static void sse_horiz_inter_predict( const uint8_t * src, const unsigned int pixels_per_line,
-                                         const uint8_t * dst, const unsigned int dst_pitch,
-                                         const unsigned int dst_height, const unsigned int filter_idx );
-
-    static void sse_vert_inter_predict( const uint8_t * src, const unsigned int pixels_per_line,
-                                        const uint8_t * dst, const unsigned int dst_pitch,
-                                        const unsigned int dst_height, const unsigned int filter_idx );
-#endif
-
     static constexpr unsigned int dimension { size };
 
     SafeArray<SafeArray<int16_t, size>, size> operator-( const Block & other ) const;
@@ -279,9 +297,36 @@ public:
     }
   };
 
+  /* copies of the planes with their edges extended, for inter prediction */
+  struct ExtendedPlanes
+  {
+    SafeRaster Y, U, V;
+
+    ExtendedPlanes( const VP8Raster & raster );
+  };
+
+private:
+  mutable std::unique_ptr<ExtendedPlanes> extended_ {};
+  mutable std::atomic<bool> has_extended_ { false };
+  mutable std::mutex extended_mutex_ {};
+
 public:
+  /* the luma margin of the extended planes (the chroma ones get half). A
+     block farther out than this from the edge, less its filter taps, only
+     reads replicated edge pixels, so it can be moved in to the margin. */
+  static const unsigned int BORDER = 32;
+
   VP8Raster( const unsigned int display_width, const unsigned int display_height );
 
+  /* fills the extended planes from this raster, once its pixels are final */
+  void extend_borders() const;
+
+  /* the extended planes, which are filled first if they haven't been */
+  const ExtendedPlanes & extended() const;
+
+  /* for when the raster is about to be written again */
+  void discard_extended() { has_extended_ = false; }
+
   Macroblock macroblock( const unsigned int column, const unsigned int row )
   {
     return { column, row, *this };
@@ -315,53 +360,4 @@ public:
   }
 };
 
-class EdgeExtendedRaster
-{
-private:
-  const TwoD<uint8_t> & master_;
-
-public:
-  EdgeExtendedRaster( const TwoD<uint8_t> & master )
-    : master_( master ) {}
-
-  uint8_t at( const int column, const int row ) const
-  {
-    int bounded_column = column;
-    if ( bounded_column < 0 ) bounded_column = 0;
-    if ( bounded_column > int(master_.width() - 1) ) bounded_column = master_.width() - 1;
-
-    int bounded_row = row;
-    if ( bounded_row < 0 ) bounded_row = 0;
-    if ( bounded_row > int(master_.height() - 1) ) bounded_row = master_.height() - 1;
-
-    return master_.at( bounded_column, bounded_row );
-  }
-};
-
-class SafeRaster
-{
-private:
-  TwoD<uint8_t> safe_Y_;
-  
-  uint16_t display_width_;
-  uint16_t display_height_;
-
-public:
-  static const size_t MARGIN_WIDTH = 256;
-
-  SafeRaster( uint16_t width, uint16_t height );
-  SafeRaster( const VP8Raster & source );
-
-  uint16_t display_width() const { return display_width_; }
-  uint16_t display_height() const { return display_height_; }
-
-  /* Copies the Y plane of the given raster to the target buffer and automatically
-     does the edge extension. */
-  void copy_raster( const VP8Raster & source );
-
-  const uint8_t & at( int row, int column ) const;
-
-  unsigned int stride() const;
-};
-
 #endif //
@@ -60,7 +60,10 @@ const uint8_t vp8_norm[ 256 ] = {
 class BoolEncoder
 {
 private:
-  std::vector< uint8_t > output_ {};
+  /* the buffer is shared with whatever comes before this partition in the
+     frame; the encoder only appends to it */
+  std::vector< uint8_t > & output_;
+  size_t start_;
 
   uint32_t range_ { 255 }, bottom_ { 0 };
   char bit_count_ { -24 };
@@ -70,7 +73,7 @@ private:
     auto it = output_.end();
     while ( *--it == 255 ) {
       *it = 0;
-      assert( it != output_.begin() );
+      assert( it != output_.begin() + start_ );
     }
     ++*it;
   }
@@ -102,10 +105,9 @@ private:
   }
 
 public:
-  BoolEncoder() 
-  {
-    output_.reserve( 1024 * 1024 ); //allocate a lot of space so we never have to realloc
-  }
+  BoolEncoder( std::vector< uint8_t > & output )
+    : output_( output ), start_( output.size() )
+  {}
 
   void put( const bool value, const Probability probability = 128 )
   {
@@ -142,12 +144,11 @@ public:
     bottom_ <<= shift;
   }
 
-  std::vector< uint8_t > finish( void )
+  /* returns the length of the partition */
+  size_t finish( void )
   {
     flush();
-    std::vector< uint8_t > ret( move( output_ ) );
-    *this = BoolEncoder();
-    return ret;
+    return output_.size() - start_;
   }
 };
 
@@ -2,6 +2,9 @@
 
 #include <algorithm>
 #include <cmath>
+#include <list>
+#include <mutex>
+#include <boost/functional/hash.hpp>
 
 #include "costs.hh"
 
@@ -110,42 +113,165 @@ uint32_t Costs::mv_component_cost( const int16_t num,
   return cost;
 }
 
-void Costs::fill_mv_component_costs( const SafeArray<SafeArray<Probability, MV_PROB_CNT>, 2> & motion_vector_probs )
+namespace {
+
+/* The tables made for the probabilities that were used most recently, most
+   recent first. Looking one up compares the probabilities themselves, so a
+   hash collision can't hand out the wrong table. */
+template<class ProbabilitiesType, class TableType>
+class CostsCache
 {
-  enum { IS_SHORT, SIGN, SHORT, BITS = SHORT + 8 - 1, LONG_MV_WIDTH = 10 };
+private:
+  struct Entry
+  {
+    size_t hash;
+    ProbabilitiesType probabilities;
+    shared_ptr<const TableType> table;
+  };
+
+  static constexpr size_t MAX_ENTRIES = 32;
+
+  mutex mutex_ {};
+  list<Entry> entries_ {};
+
+public:
+  template<class MakeTable>
+  shared_ptr<const TableType> get( const ProbabilitiesType & probabilities,
+                                        const size_t hash,
+                                        const MakeTable & make_table )
+  {
+    {
+      lock_guard<mutex> lock { mutex_ };
+
+      for ( auto it = entries_.begin(); it != entries_.end(); it++ ) {
+        if ( it->hash == hash and it->probabilities == probabilities ) {
+          entries_.splice( entries_.begin(), entries_, it );
+          return it->table;
+        }
+      }
+    }
 
-  mv_component_costs.at( 0 ).at( 0 ).at( 0 ) = mv_component_costs.at( 0 ).at( 1 ).at( 0 )
-                                             = mv_component_cost( 0, motion_vector_probs.at( 0 ) );
-  mv_component_costs.at( 1 ).at( 0 ).at( 0 ) = mv_component_costs.at( 1 ).at( 1 ).at( 0 )
-                                             = mv_component_cost( 0, motion_vector_probs.at( 1 ) );
+    /* made outside the lock; two threads that miss at once make the same table */
+    shared_ptr<const TableType> table = make_table();
 
-  for ( size_t i = 1; i <= 1023; i++ ) {
-    uint32_t cost_0 = mv_component_cost( i, motion_vector_probs.at( 0 ) );
-    uint32_t cost_1 = mv_component_cost( i, motion_vector_probs.at( 1 ) );
+    lock_guard<mutex> lock { mutex_ };
 
-    mv_component_costs.at( 0 ).at( 0 ).at( i ) = cost_0 + cost_zero( motion_vector_probs.at( 0 ).at( SIGN ) );
-    mv_component_costs.at( 0 ).at( 1 ).at( i ) = cost_0 +  cost_one( motion_vector_probs.at( 0 ).at( SIGN ) );
+    entries_.push_front( { hash, probabilities, table } );
+    if ( entries_.size() > MAX_ENTRIES ) {
+      entries_.pop_back();
+    }
 
-    mv_component_costs.at( 1 ).at( 0 ).at( i ) = cost_1 + cost_zero( motion_vector_probs.at( 1 ).at( SIGN ) );
-    mv_component_costs.at( 1 ).at( 1 ).at( i ) = cost_1 +  cost_one( motion_vector_probs.at( 1 ).at( SIGN ) );
+    return table;
   }
+};
+
+typedef decltype( ProbabilityTables::coeff_probs ) CoeffProbs;
+typedef SafeArray<SafeArray<Probability, MV_PROB_CNT>, 2> MVProbs;
+
+/* the parts of ProbabilityTables::hash() that each table depends on */
+size_t coeff_probs_hash( const CoeffProbs & coeff_probs )
+{
+  size_t hash_val = 0;
+
+  for ( auto const & block_sub : coeff_probs ) {
+    for ( auto const & bands_sub : block_sub ) {
+      for ( auto const & contexts_sub : bands_sub ) {
+        boost::hash_range( hash_val, contexts_sub.begin(), contexts_sub.end() );
+      }
+    }
+  }
+
+  return hash_val;
 }
 
-// libvpx:vp8/encoder/onyx_if.c:1698
-void Costs::fill_mv_sad_costs()
+size_t mv_probs_hash( const MVProbs & motion_vector_probs )
 {
-  mv_sad_costs.at( 0 ).at( 0 ).at( 0 ) = 300;
-  mv_sad_costs.at( 0 ).at( 1 ).at( 0 ) = 300;
-  mv_sad_costs.at( 1 ).at( 0 ).at( 0 ) = 300;
-  mv_sad_costs.at( 1 ).at( 1 ).at( 0 ) = 300;
-
-  for ( size_t i = 1; i <= 255; i++ ) {
-    size_t cost = 256 * ( 2 * log2f( 8 * i ) + 0.6 );
-    mv_sad_costs.at( 0 ).at( 0 ).at( i ) = cost;
-    mv_sad_costs.at( 0 ).at( 1 ).at( i ) = cost;
-    mv_sad_costs.at( 1 ).at( 0 ).at( i ) = cost;
-    mv_sad_costs.at( 1 ).at( 1 ).at( i ) = cost;
+  size_t hash_val = 0;
+
+  for ( auto const & sub : motion_vector_probs ) {
+    boost::hash_range( hash_val, sub.begin(), sub.end() );
   }
+
+  return hash_val;
+}
+
+template<class TableType>
+shared_ptr<const TableType> zero_table()
+{
+  static const shared_ptr<const TableType> table = make_shared<const TableType>();
+  return table;
+}
+
+// libvpx:vp8/encoder/onyx_if.c:1698
+shared_ptr<const Costs::MVSADCosts> shared_mv_sad_costs()
+{
+  static const shared_ptr<const Costs::MVSADCosts> table = [] ()
+    {
+      shared_ptr<Costs::MVSADCosts> mv_sad_costs = make_shared<Costs::MVSADCosts>();
+
+      mv_sad_costs->at( 0 ).at( 0 ).at( 0 ) = 300;
+      mv_sad_costs->at( 0 ).at( 1 ).at( 0 ) = 300;
+      mv_sad_costs->at( 1 ).at( 0 ).at( 0 ) = 300;
+      mv_sad_costs->at( 1 ).at( 1 ).at( 0 ) = 300;
+
+      for ( size_t i = 1; i <= 255; i++ ) {
+        size_t cost = 256 * ( 2 * log2f( 8 * i ) + 0.6 );
+        mv_sad_costs->at( 0 ).at( 0 ).at( i ) = cost;
+        mv_sad_costs->at( 0 ).at( 1 ).at( i ) = cost;
+        mv_sad_costs->at( 1 ).at( 0 ).at( i ) = cost;
+        mv_sad_costs->at( 1 ).at( 1 ).at( i ) = cost;
+      }
+
+      return mv_sad_costs;
+    } ();
+
+  return table;
+}
+
+shared_ptr<const Costs::ModeCosts> shared_mode_costs()
+{
+  static const shared_ptr<const Costs::ModeCosts> table = make_shared<const Costs::ModeCosts>();
+  return table;
+}
+
+}
+
+Costs::Costs()
+  : token_costs_( zero_table<TokenCosts>() ),
+    mv_component_costs_( zero_table<MVComponentCosts>() ),
+    mv_sad_costs_( shared_mv_sad_costs() ),
+    mode_costs_( shared_mode_costs() )
+{}
+
+void Costs::fill_mv_component_costs( const MVProbs & motion_vector_probs )
+{
+  static CostsCache<MVProbs, MVComponentCosts> cache;
+
+  mv_component_costs_ = cache.get( motion_vector_probs, mv_probs_hash( motion_vector_probs ),
+    [&] ()
+    {
+      enum { IS_SHORT, SIGN, SHORT, BITS = SHORT + 8 - 1, LONG_MV_WIDTH = 10 };
+
+      shared_ptr<MVComponentCosts> mv_component_costs = make_shared<MVComponentCosts>();
+
+      mv_component_costs->at( 0 ).at( 0 ).at( 0 ) = mv_component_costs->at( 0 ).at( 1 ).at( 0 )
+                                                  = mv_component_cost( 0, motion_vector_probs.at( 0 ) );
+      mv_component_costs->at( 1 ).at( 0 ).at( 0 ) = mv_component_costs->at( 1 ).at( 1 ).at( 0 )
+                                                  = mv_component_cost( 0, motion_vector_probs.at( 1 ) );
+
+      for ( size_t i = 1; i <= 1023; i++ ) {
+        uint32_t cost_0 = mv_component_cost( i, motion_vector_probs.at( 0 ) );
+        uint32_t cost_1 = mv_component_cost( i, motion_vector_probs.at( 1 ) );
+
+        mv_component_costs->at( 0 ).at( 0 ).at( i ) = cost_0 + cost_zero( motion_vector_probs.at( 0 ).at( SIGN ) );
+        mv_component_costs->at( 0 ).at( 1 ).at( i ) = cost_0 +  cost_one( motion_vector_probs.at( 0 ).at( SIGN ) );
+
+        mv_component_costs->at( 1 ).at( 0 ).at( i ) = cost_1 + cost_zero( motion_vector_probs.at( 1 ).at( SIGN ) );
+        mv_component_costs->at( 1 ).at( 1 ).at( i ) = cost_1 +  cost_one( motion_vector_probs.at( 1 ).at( SIGN ) );
+      }
+
+      return mv_component_costs;
+    } );
 }
 
 template<unsigned int array_size, unsigned int prob_nodes, unsigned int token_count>
@@ -171,24 +297,36 @@ void Costs::compute_cost( SafeArray<uint16_t, array_size> & costs_nodes,
 
 void Costs::fill_token_costs( const ProbabilityTables & probability_tables )
 {
-  for ( size_t i = 0; i < BLOCK_TYPES; i++ ) {
-    for ( size_t j = 0; j < COEF_BANDS; j++ ) {
-      for ( size_t k = 0; k < PREV_COEF_CONTEXTS; k++ ) {
-        auto & costs_array = token_costs.at( i ).at( j ).at( k );
-        auto & probabilities = probability_tables.coeff_probs.at( i ).at( j ).at( k );
-
-        if ( k == 0 and j > ( i == 0 ) ) {
-          compute_cost( costs_array, probabilities, vp8_coef_tree, 2 );
-        }
-        else {
-          compute_cost( costs_array, probabilities, vp8_coef_tree );
+  static CostsCache<CoeffProbs, TokenCosts> cache;
+
+  const CoeffProbs & coeff_probs = probability_tables.coeff_probs;
+
+  token_costs_ = cache.get( coeff_probs, coeff_probs_hash( coeff_probs ),
+    [&] ()
+    {
+      shared_ptr<TokenCosts> token_costs = make_shared<TokenCosts>();
+
+      for ( size_t i = 0; i < BLOCK_TYPES; i++ ) {
+        for ( size_t j = 0; j < COEF_BANDS; j++ ) {
+          for ( size_t k = 0; k < PREV_COEF_CONTEXTS; k++ ) {
+            auto & costs_array = token_costs->at( i ).at( j ).at( k );
+            auto & probabilities = coeff_probs.at( i ).at( j ).at( k );
+
+            if ( k == 0 and j > ( i == 0 ) ) {
+              compute_cost( costs_array, probabilities, vp8_coef_tree, 2 );
+            }
+            else {
+              compute_cost( costs_array, probabilities, vp8_coef_tree );
+            }
+          }
         }
       }
-    }
-  }
+
+      return token_costs;
+    } );
 }
 
-void Costs::fill_mode_costs()
+Costs::ModeCosts::ModeCosts()
 {
   // filling bmode_costs
   for ( size_t i = 0; i < num_intra_b_modes; i++ ) {
@@ -211,9 +349,11 @@ void Costs::fill_mode_costs()
  * Fill the mode costs for macroblocks predicted with motion vectors
  * (NEARESTMV to SPLITMV).
  */
-void Costs::fill_mv_ref_costs( const ProbabilityArray<num_mv_refs> & mv_mode_probs )
+SafeArray<uint16_t, num_y_modes + num_mv_refs> Costs::inter_mode_costs( const ProbabilityArray<num_mv_refs> & mv_mode_probs ) const
 {
-  compute_cost( mbmode_costs.at( 1 ), mv_mode_probs, mv_ref_tree );
+  SafeArray<uint16_t, num_y_modes + num_mv_refs> costs = mbmode_costs().at( 1 );
+  compute_cost( costs, mv_mode_probs, mv_ref_tree );
+  return costs;
 }
 
 /*
@@ -221,8 +361,8 @@ void Costs::fill_mv_ref_costs( const ProbabilityArray<num_mv_refs> & mv_mode_pro
  */
 uint32_t Costs::motion_vector_cost( const MotionVector & mv, size_t weight ) const
 {
-  return ( ( mv_component_costs.at( 0 ).at( mv.y() < 0 ).at( abs( mv.y() ) )
-           + mv_component_costs.at( 1 ).at( mv.x() < 0 ).at( abs( mv.x() ) ) ) * weight ) / 128;
+  return ( ( mv_component_costs_->at( 0 ).at( mv.y() < 0 ).at( abs( mv.y() ) )
+           + mv_component_costs_->at( 1 ).at( mv.x() < 0 ).at( abs( mv.x() ) ) ) * weight ) / 128;
 }
 
 /*
@@ -235,8 +375,8 @@ uint32_t Costs::sad_motion_vector_cost( const MotionVector & mv,
   int x = max( min ( ( mv.x() - base.x() ) >> 2, 255 ), -255 );
   int y = max( min ( ( mv.y() - base.y() ) >> 2, 255 ), -255 );
 
-  return ( ( mv_sad_costs.at( 0 ).at( y < 0 ).at( abs( y ) )
-           + mv_sad_costs.at( 1 ).at( x < 0 ).at( abs( x ) ) ) * weight + 128 ) / 256 ;
+  return ( ( mv_sad_costs_->at( 0 ).at( y < 0 ).at( abs( y ) )
+           + mv_sad_costs_->at( 1 ).at( x < 0 ).at( abs( x ) ) ) * weight + 128 ) / 256 ;
 }
 
 uint8_t Costs::token_for_coeff( int16_t coeff )
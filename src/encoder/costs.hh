@@ -4,6 +4,7 @@
 #define TOKEN_COSTS_HH
 
 #include <array>
+#include <memory>
 
 #include "safe_array.hh"
 #include "decoder.hh"
@@ -21,42 +22,77 @@ private:
                                      const SafeArray<Probability, MV_PROB_CNT> & probs );
 
   template<unsigned int array_size, unsigned int prob_nodes, unsigned int token_count>
-  void compute_cost( SafeArray<uint16_t, array_size> & costs_nodes,
-                     const SafeArray<Probability, prob_nodes> & probabilities,
-                     const SafeArray<TreeNode, token_count> & tree,
-                     size_t tree_index = 0, uint16_t current_cost = 0 );
+  static void compute_cost( SafeArray<uint16_t, array_size> & costs_nodes,
+                            const SafeArray<Probability, prob_nodes> & probabilities,
+                            const SafeArray<TreeNode, token_count> & tree,
+                            size_t tree_index = 0, uint16_t current_cost = 0 );
 
 public:
-  SafeArray<SafeArray<SafeArray<SafeArray<uint16_t,
-                                          MAX_ENTROPY_TOKENS>,
-                                PREV_COEF_CONTEXTS>,
-                      COEF_BANDS>,
-            BLOCK_TYPES> token_costs;
-
-  SafeArray<SafeArray<uint16_t, num_y_modes + num_mv_refs>, 2> mbmode_costs;
+  typedef SafeArray<SafeArray<SafeArray<SafeArray<uint16_t,
+                                                  MAX_ENTROPY_TOKENS>,
+                                        PREV_COEF_CONTEXTS>,
+                              COEF_BANDS>,
+                    BLOCK_TYPES> TokenCosts;
 
   /* mv_component_costs[a][b][c]:
    * a is the axis, 0 for y and 1 for x,
    * b is the sign of the component, 0 for positive and 1 for negative,
    * c is the absolute value of the component.
    */
-  SafeArray<SafeArray<SafeArray<uint32_t, 1024>, 2>, 2> mv_component_costs;
-  SafeArray<SafeArray<SafeArray<uint32_t, 256>, 2>, 2> mv_sad_costs;
+  typedef SafeArray<SafeArray<SafeArray<uint32_t, 1024>, 2>, 2> MVComponentCosts;
+  typedef SafeArray<SafeArray<SafeArray<uint32_t, 256>, 2>, 2> MVSADCosts;
 
+  /* the costs of the modes, whose probabilities are fixed */
+  struct ModeCosts
+  {
+    SafeArray<SafeArray<uint16_t, num_y_modes + num_mv_refs>, 2> mbmode_costs {};
 
-  SafeArray<SafeArray<SafeArray<uint16_t,
-                                num_intra_b_modes>,
-                      num_intra_b_modes>,
-            num_intra_b_modes> bmode_costs;
+    SafeArray<SafeArray<SafeArray<uint16_t,
+                                  num_intra_b_modes>,
+                        num_intra_b_modes>,
+              num_intra_b_modes> bmode_costs {};
 
-  SafeArray<SafeArray<uint16_t, num_uv_modes>, 2> intra_uv_mode_costs;
+    SafeArray<SafeArray<uint16_t, num_uv_modes>, 2> intra_uv_mode_costs {};
 
-  void fill_token_costs( const ProbabilityTables & probability_tables );
+    ModeCosts();
+  };
+
+private:
+  /* The tables are immutable once made, and shared by every encoder in the
+     process: the ones that depend on probabilities come from a cache keyed
+     by those probabilities, and the rest are made only once. */
+  std::shared_ptr<const TokenCosts> token_costs_;
+  std::shared_ptr<const MVComponentCosts> mv_component_costs_;
+  std::shared_ptr<const MVSADCosts> mv_sad_costs_;
+  std::shared_ptr<const ModeCosts> mode_costs_;
+
+public:
+  /* all-zero token and motion-vector costs until they are filled */
+  Costs();
 
-  void fill_mode_costs();
-  void fill_mv_ref_costs( const ProbabilityArray< num_mv_refs > & mv_ref_probs );
+  const TokenCosts & token_costs() const { return *token_costs_; }
+  const MVComponentCosts & mv_component_costs() const { return *mv_component_costs_; }
+  const MVSADCosts & mv_sad_costs() const { return *mv_sad_costs_; }
+
+  const SafeArray<SafeArray<uint16_t, num_y_modes + num_mv_refs>, 2> & mbmode_costs() const
+  { return mode_costs_->mbmode_costs; }
+
+  const SafeArray<SafeArray<SafeArray<uint16_t, num_intra_b_modes>, num_intra_b_modes>,
+                  num_intra_b_modes> & bmode_costs() const
+  { return mode_costs_->bmode_costs; }
+
+  const SafeArray<SafeArray<uint16_t, num_uv_modes>, 2> & intra_uv_mode_costs() const
+  { return mode_costs_->intra_uv_mode_costs; }
+
+  /* these look the tables up first, and only compute them when no encoder
+     has used the same probabilities recently */
+  void fill_token_costs( const ProbabilityTables & probability_tables );
   void fill_mv_component_costs( const SafeArray<SafeArray<Probability, MV_PROB_CNT>, 2> & motion_vector_probs );
-  void fill_mv_sad_costs();
+
+  /* interframe mode costs (mbmode_costs[ 1 ]) with the costs of the
+     motion-vector modes filled in for one macroblock's mv_ref_probs.
+     Doesn't touch the tables, so macroblocks can be costed concurrently. */
+  SafeArray<uint16_t, num_y_modes + num_mv_refs> inter_mode_costs( const ProbabilityArray< num_mv_refs > & mv_ref_probs ) const;
 
   uint32_t motion_vector_cost( const MotionVector & mv, size_t weight ) const;
   uint32_t sad_motion_vector_cost( const MotionVector & mv,
@@ -93,10 +129,10 @@ uint32_t Costs::block_cost( const Block & block ) const
     const int16_t coeff = block.coefficients().at( zigzag.at( i ) );
     const int16_t token = token_for_coeff( coeff );
 
-    cost += token_costs.at( block.type() )
-                       .at( coefficient_to_band.at( i ) )
-                       .at( token_context )
-                       .at( token );
+    cost += token_costs().at( block.type() )
+                         .at( coefficient_to_band.at( i ) )
+                         .at( token_context )
+                         .at( token );
 
     cost += coeff_base_cost( coeff );
 
@@ -104,10 +140,10 @@ uint32_t Costs::block_cost( const Block & block ) const
   }
 
   if ( coded_length < 16 ) {
-    cost += token_costs.at( block.type() )
-                       .at( coefficient_to_band.at( i ) )
-                       .at( token_context )
-                       .at( DCT_EOB_TOKEN );
+    cost += token_costs().at( block.type() )
+                         .at( coefficient_to_band.at( i ) )
+                         .at( token_context )
+                         .at( DCT_EOB_TOKEN );
   }
 
   return cost;
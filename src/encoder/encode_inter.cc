@@ -30,6 +30,7 @@
 
 #include "encoder.hh"
 #include "scorer.hh"
+#include "kernels.hh"
 
 using namespace std;
 
@@ -154,25 +155,54 @@ static const array<int, 128> sad_per_bit16lut = {
 template<>
 void Encoder::update_decoder_state( const InterFrame & frame )
 {
+  DecoderState & decoder_state = mutable_state().decoder_state;
+
   if ( frame.header().refresh_entropy_probs ) {
-    decoder_state_.probability_tables.update( frame.header() );
+    decoder_state.probability_tables.update( frame.header() );
   }
 
   if ( frame.header().mode_lf_adjustments.initialized() ) {
-    if ( decoder_state_.filter_adjustments.initialized() ) {
-      decoder_state_.filter_adjustments.get().update( frame.header() );
+    if ( decoder_state.filter_adjustments.initialized() ) {
+      decoder_state.filter_adjustments.get().update( frame.header() );
     } else {
-      decoder_state_.filter_adjustments.initialize( frame.header() );
+      decoder_state.filter_adjustments.initialize( frame.header() );
     }
   } else {
-    decoder_state_.filter_adjustments.clear();
+    decoder_state.filter_adjustments.clear();
+  }
+}
+
+Encoder::MotionHistory::MotionHistory( const InterFrame & frame )
+  : width( frame.macroblocks().width() ), height( frame.macroblocks().height() ),
+    motion_vectors( width * height )
+{
+  vector<int16_t> x, y;
+
+  frame.macroblocks().forall_ij(
+    [&]( const InterFrameMacroblock & frame_mb, const unsigned int column, const unsigned int row )
+    {
+      if ( frame_mb.inter_coded() and frame_mb.header().reference() == LAST_FRAME ) {
+        motion_vectors.at( row * width + column ).reset( frame_mb.base_motion_vector() );
+        x.push_back( frame_mb.base_motion_vector().x() );
+        y.push_back( frame_mb.base_motion_vector().y() );
+      }
+    } );
+
+  if ( not x.empty() ) {
+    nth_element( x.begin(), x.begin() + x.size() / 2, x.end() );
+    nth_element( y.begin(), y.begin() + y.size() / 2, y.end() );
+    global_motion = MotionVector( x.at( x.size() / 2 ), y.at( y.size() / 2 ) );
   }
 }
 
+template<>
+void Encoder::update_motion_history( const InterFrame & frame )
+{
+  mutable_state().motion_history = make_shared<const MotionHistory>( frame );
+}
+
 Encoder::MVSearchResult Encoder::diamond_search( const VP8Raster::Macroblock & original_mb,
-                                                 VP8Raster::Macroblock & temp_mb,
                                                  InterFrameMacroblock & frame_mb,
-                                                 const VP8Raster & reference,
                                                  const SafeRaster & safe_reference,
                                                  MotionVector base_mv,
                                                  MotionVector origin,
@@ -181,35 +211,93 @@ Encoder::MVSearchResult Encoder::diamond_search( const VP8Raster::Macroblock & o
 {
   size_t first_step = step_size / 2;
 
-  auto reference_mb = reference.macroblock( original_mb.Y.column(),
-                                            original_mb.Y.row() );
+  const BlockKernels & block_kernels = kernels().block<16>();
+  const uint8_t * source = &original_mb.Y.contents().at( 0, 0 );
+  const int source_stride = original_mb.Y.contents().stride();
 
-  TwoDSubRange<uint8_t, 16, 16> & prediction = temp_mb.Y.mutable_contents();
+  const int column = original_mb.Y.column() * 16;
+  const int row = original_mb.Y.row() * 16;
 
   base_mv = Scorer::clamp( base_mv, frame_mb.context() );
 
+  /* the center site comes third, and the others are scored together */
   constexpr array<array<int16_t, 2>, 5> check_sites = {{
     { -1, 0 }, { 0, -1 }, { 0, 0 }, { 0, 1 }, { 1, 0 }
   }};
+  constexpr size_t CENTER = 2;
+  constexpr array<size_t, 4> outer_sites = {{ 0, 1, 3, 4 }};
+
+  /* sites that are not on whole pixels are interpolated into here */
+  alignas( 16 ) array<array<uint8_t, 16 * 16>, check_sites.size()> predictions {};
+
+  /* the center of each step is the best site of the one before */
+  Optional<uint32_t> center_distortion;
 
   while ( step_size > 1 ) {
-    MBPredictionData best_pred;
-    MBPredictionData pred;
+    array<MotionVector, check_sites.size()> site_mvs;
+    array<MotionVector, check_sites.size()> clamped_mvs;
+    array<bool, check_sites.size()> in_bounds;
+    bool whole_pixels = true;
+
+    for ( size_t i = 0; i < check_sites.size(); i++ ) {
+      site_mvs[ i ] = origin + MotionVector( step_size * check_sites[ i ][ 0 ],
+                                             step_size * check_sites[ i ][ 1 ] );
+      in_bounds[ i ] = not out_of_bounds( site_mvs[ i ] );
+      clamped_mvs[ i ] = Scorer::clamp( site_mvs[ i ] + base_mv, frame_mb.context() );
+
+      if ( in_bounds[ i ] and ( ( clamped_mvs[ i ].x() | clamped_mvs[ i ].y() ) & 7 ) ) {
+        whole_pixels = false;
+      }
+    }
+
+    /* every site is read with the same stride, either in the reference or in predictions */
+    array<const uint8_t *, check_sites.size()> references {};
+    const int reference_stride = whole_pixels ? safe_reference.stride() : 16;
+
+    for ( size_t i = 0; i < check_sites.size(); i++ ) {
+      if ( not in_bounds[ i ] ) {
+        references[ i ] = whole_pixels ? &safe_reference.at( column, row ) : predictions[ i ].data();
+        continue;
+      }
+
+      const MotionVector & mv = clamped_mvs[ i ];
+      const uint8_t * reference = &safe_reference.at( column + ( mv.x() >> 3 ), row + ( mv.y() >> 3 ) );
+
+      if ( whole_pixels ) {
+        references[ i ] = reference;
+      } else if ( i != CENTER or not center_distortion.initialized() ) {
+        sixtap_predict<16>( reference, safe_reference.stride(), predictions[ i ].data(), 16,
+                            mv.x() & 7, mv.y() & 7 );
+        references[ i ] = predictions[ i ].data();
+      }
+    }
 
-    for ( const auto & check_site : check_sites ) {
-      pred.mv = MotionVector();
-      MotionVector direction( step_size * check_site[ 0 ],
-                              step_size * check_site[ 1 ] );
+    array<uint32_t, check_sites.size()> distortions;
 
-      pred.mv += origin + direction;
+    array<const uint8_t *, 4> outer_references;
+    array<unsigned int, 4> outer_distortions;
+    for ( size_t i = 0; i < outer_sites.size(); i++ ) {
+      outer_references[ i ] = references[ outer_sites[ i ] ];
+    }
+    block_kernels.sad_x4( source, source_stride, outer_references.data(), reference_stride,
+                          outer_distortions.data() );
+    for ( size_t i = 0; i < outer_sites.size(); i++ ) {
+      distortions[ outer_sites[ i ] ] = outer_distortions[ i ];
+    }
 
-      if ( out_of_bounds( pred.mv ) ) continue;
+    distortions[ CENTER ] = center_distortion.initialized()
+      ? center_distortion.get()
+      : block_kernels.sad( source, source_stride, references[ CENTER ], reference_stride );
+
+    MBPredictionData best_pred;
+    MBPredictionData pred;
 
-      MotionVector this_mv( Scorer::clamp( pred.mv + base_mv, frame_mb.context() ) );
+    for ( size_t i = 0; i < check_sites.size(); i++ ) {
+      if ( not in_bounds[ i ] ) continue;
 
-      reference_mb.Y().inter_predict( this_mv, safe_reference, prediction );
-      pred.distortion = sad( original_mb.Y, prediction );
-      pred.rate = costs_.sad_motion_vector_cost( pred.mv, MotionVector(), sad_per_bit16lut[ y_ac_qi ] );
+      pred.mv = site_mvs[ i ];
+      pred.distortion = distortions[ i ];
+      pred.rate = costs().sad_motion_vector_cost( pred.mv, MotionVector(), sad_per_bit16lut[ y_ac_qi ] );
       pred.cost = rdcost( pred.rate, pred.distortion, 1, 1 );
 
       if ( pred.cost < best_pred.cost  ) {
@@ -223,11 +311,220 @@ Encoder::MVSearchResult Encoder::diamond_search( const VP8Raster::Macroblock & o
 
     origin = best_pred.mv;
     step_size /= 2;
+
+    center_distortion.clear();
+    if ( best_pred.cost != numeric_limits<uint32_t>::max() ) {
+      center_distortion.initialize( best_pred.distortion );
+    }
   }
 
   return { origin, first_step };
 }
 
+template<unsigned int size>
+pair<MotionVector, uint32_t> Encoder::best_site( const uint8_t * source, const int source_stride,
+                                                 const SafeRaster & reference,
+                                                 const InterFrameMacroblock & frame_mb,
+                                                 const MotionVector & base_mv,
+                                                 const vector<MotionVector> & sites,
+                                                 const size_t y_ac_qi ) const
+{
+  /* a pixel on this level is unit in motion vector units, and its distortion
+     is scaled up to be comparable with the rate of a full-resolution vector */
+  constexpr unsigned int level = ( size == 4 ) ? 2 : ( size == 8 ) ? 1 : 0;
+  constexpr int unit = 8 << level;
+
+  const BlockKernels & block_kernels = kernels().block<size>();
+
+  const int column = frame_mb.context().column * size;
+  const int row = frame_mb.context().row * size;
+
+  MotionVector best_mv = base_mv;
+  uint32_t best_distortion = numeric_limits<uint32_t>::max();
+  uint32_t best_cost = numeric_limits<uint32_t>::max();
+
+  /* sites are scored four at a time */
+  array<MotionVector, 4> site_mvs;
+  array<const uint8_t *, 4> references {};
+  size_t site_count = 0;
+
+  auto score_sites = [&]()
+    {
+      array<unsigned int, 4> distortions;
+
+      if ( site_count == references.size() ) {
+        block_kernels.sad_x4( source, source_stride, references.data(), reference.stride(),
+                              distortions.data() );
+      } else {
+        for ( size_t i = 0; i < site_count; i++ ) {
+          distortions[ i ] = block_kernels.sad( source, source_stride, references[ i ], reference.stride() );
+        }
+      }
+
+      for ( size_t i = 0; i < site_count; i++ ) {
+        const uint32_t distortion = distortions[ i ] << ( 2 * level );
+        const uint32_t rate = costs().sad_motion_vector_cost( site_mvs[ i ] - base_mv, MotionVector(),
+                                                             sad_per_bit16lut[ y_ac_qi ] );
+        const uint32_t cost = rdcost( rate, distortion, 1, 1 );
+
+        if ( cost < best_cost ) {
+          best_cost = cost;
+          best_distortion = distortion;
+          best_mv = site_mvs[ i ];
+        }
+      }
+
+      site_count = 0;
+    };
+
+  for ( const MotionVector & mv : sites ) {
+    if ( out_of_bounds( mv - base_mv ) or not ( Scorer::clamp( mv, frame_mb.context() ) == mv ) ) {
+      continue;
+    }
+
+    site_mvs[ site_count ] = mv;
+    references[ site_count ] = &reference.at( column + mv.x() / unit, row + mv.y() / unit );
+    site_count++;
+
+    if ( site_count == references.size() ) {
+      score_sites();
+    }
+  }
+
+  if ( site_count > 0 ) {
+    score_sites();
+  }
+
+  return { best_mv, best_distortion };
+}
+
+template<unsigned int size>
+MotionVector Encoder::pyramid_search( const uint8_t * source, const int source_stride,
+                                      const SafeRaster & reference,
+                                      const InterFrameMacroblock & frame_mb,
+                                      const MotionVector & base_mv,
+                                      const MotionVector & center,
+                                      const int radius,
+                                      const size_t y_ac_qi ) const
+{
+  static_assert( size == 4 or size == 8, "only the downsampled levels are searched exhaustively" );
+
+  constexpr int unit = 8 * 16 / size;
+
+  vector<MotionVector> sites;
+  sites.reserve( ( 2 * radius + 1 ) * ( 2 * radius + 1 ) );
+
+  for ( int dy = -radius; dy <= radius; dy++ ) {
+    for ( int dx = -radius; dx <= radius; dx++ ) {
+      sites.emplace_back( center + MotionVector( dx * unit, dy * unit ) );
+    }
+  }
+
+  return best_site<size>( source, source_stride, reference, frame_mb, base_mv, sites, y_ac_qi ).first;
+}
+
+vector<MotionVector> Encoder::motion_seeds( const InterFrameMacroblock & frame_mb,
+                                            const MotionVector & base_mv ) const
+{
+  vector<MotionVector> seeds { base_mv, MotionVector() };
+
+  /* the history is only usable on a frame of the same size (and not, say,
+     on the subsampled frames that estimate a frame's size) */
+  const auto & context = frame_mb.context();
+  const auto & motion_history = state().motion_history;
+  if ( motion_history and context.width == motion_history->width
+       and context.height == motion_history->height ) {
+    seeds.push_back( motion_history->global_motion );
+
+    /* the same macroblock in the last frame, and its neighbours */
+    constexpr array<array<int, 2>, 5> neighbours = {{ { 0, 0 }, { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } }};
+
+    for ( const auto & neighbour : neighbours ) {
+      const int column = context.column + neighbour[ 0 ];
+      const int row = context.row + neighbour[ 1 ];
+
+      if ( column < 0 or column >= int( context.width ) or row < 0 or row >= int( context.height ) ) {
+        continue;
+      }
+
+      const Optional<MotionVector> & mv = state().motion_history->motion_vectors.at( row * context.width + column );
+      if ( mv.initialized() ) {
+        seeds.push_back( mv.get() );
+      }
+    }
+  }
+
+  /* the seeds are scored on whole pixels, once each */
+  for ( MotionVector & seed : seeds ) {
+    seed = MotionVector( ( ( seed.x() + 4 ) >> 3 ) * 8, ( ( seed.y() + 4 ) >> 3 ) * 8 );
+  }
+
+  vector<MotionVector> unique_seeds;
+  for ( const MotionVector & seed : seeds ) {
+    if ( find( unique_seeds.begin(), unique_seeds.end(), seed ) == unique_seeds.end() ) {
+      unique_seeds.push_back( seed );
+    }
+  }
+
+  return unique_seeds;
+}
+
+MotionVector Encoder::motion_search( const VP8Raster::Macroblock & original_mb,
+                                     InterFrameMacroblock & frame_mb,
+                                     const SafeRaster & safe_reference,
+                                     const MotionVector & base_mv,
+                                     const Quantizer & quantizer,
+                                     const size_t y_ac_qi ) const
+{
+  const auto & original = original_mb.Y.contents();
+
+  /* the predicted vectors, and the motion of the last frame around this macroblock */
+  const pair<MotionVector, uint32_t> seed = best_site<16>( &original.at( 0, 0 ), original.stride(),
+                                                           safe_reference, frame_mb, base_mv,
+                                                           motion_seeds( frame_mb, base_mv ), y_ac_qi );
+
+  /* if one of them is already about as good as the quantizer can tell, it
+     only needs the half- and quarter-pixel steps of the diamond search */
+  if ( seed.second <= 16 * 16 * quantizer.y_ac / EARLY_EXIT_DIVISOR ) {
+    return diamond_search( original_mb, frame_mb, safe_reference,
+                           base_mv, seed.first - base_mv, 4, y_ac_qi ).mv;
+  }
+
+  /* the macroblock at half and quarter resolution, averaged like the reference's pyramid */
+  alignas( 16 ) array<uint8_t, 8 * 8> half;
+  alignas( 16 ) array<uint8_t, 4 * 4> quarter;
+
+  for ( unsigned int row = 0; row < 8; row++ ) {
+    for ( unsigned int column = 0; column < 8; column++ ) {
+      half[ row * 8 + column ] = ( original.at( column * 2, row * 2 ) + original.at( column * 2 + 1, row * 2 )
+                                   + original.at( column * 2, row * 2 + 1 )
+                                   + original.at( column * 2 + 1, row * 2 + 1 ) + 2 ) >> 2;
+    }
+  }
+
+  for ( unsigned int row = 0; row < 4; row++ ) {
+    for ( unsigned int column = 0; column < 4; column++ ) {
+      quarter[ row * 4 + column ] = ( half[ row * 16 + column * 2 ] + half[ row * 16 + column * 2 + 1 ]
+                                      + half[ row * 16 + 8 + column * 2 ]
+                                      + half[ row * 16 + 8 + column * 2 + 1 ] + 2 ) >> 2;
+    }
+  }
+
+  /* A wide window at quarter resolution, around the best seed, finds large
+     motions for a fraction of the cost of searching them at full resolution.
+     Each finer level only has to correct the rounding of the one before, and
+     the diamond search takes the result down to a quarter pixel. */
+  const MotionVector coarse_center( seed.first.x() / 32 * 32, seed.first.y() / 32 * 32 );
+
+  MotionVector mv = pyramid_search<4>( quarter.data(), 4, safe_reference.level( 2 ), frame_mb,
+                                       base_mv, coarse_center, COARSE_SEARCH_RADIUS, y_ac_qi );
+  mv = pyramid_search<8>( half.data(), 8, safe_reference.level( 1 ), frame_mb,
+                          base_mv, mv, 1, y_ac_qi );
+
+  return diamond_search( original_mb, frame_mb, safe_reference,
+                         base_mv, mv - base_mv, REFINE_STEP, y_ac_qi ).mv;
+}
+
 void Encoder::luma_mb_inter_predict( const VP8Raster::Macroblock & original_mb,
                                      VP8Raster::Macroblock & reconstructed_mb,
                                      VP8Raster::Macroblock & temp_mb,
@@ -248,8 +545,8 @@ void Encoder::luma_mb_inter_predict( const VP8Raster::Macroblock & original_mb,
   frame_mb.mutable_header().set_reference( frame_ref );
 
   MotionVector best_mv;
-  const VP8Raster & reference = references_.at( frame_ref );
-  const SafeRaster & safe_reference = safe_references_.get( frame_ref );
+  const VP8Raster & reference = references().at( frame_ref );
+  const SafeRaster & safe_reference = reference.extended().Y;
 
   const auto reference_mb = reference.macroblock( original_mb.Y.column(),
                                                   original_mb.Y.row() );
@@ -264,7 +561,9 @@ void Encoder::luma_mb_inter_predict( const VP8Raster::Macroblock & original_mb,
                                                           mv_counts_to_probs.at( counts.at( 2 ) ).at( 2 ),
                                                           mv_counts_to_probs.at( counts.at( 3 ) ).at( 3 ) }};
 
-  costs_.fill_mv_ref_costs( mv_ref_probs );
+  const auto mode_costs = costs().inter_mode_costs( mv_ref_probs );
+
+  MacroblockAnalysis * const analysis = macroblock_analysis( frame_mb );
 
   constexpr array<mbmode, 4> inter_modes = { ZEROMV, NEARESTMV, NEARMV, NEWMV, /* SPLIMV */ };
 
@@ -284,21 +583,20 @@ void Encoder::luma_mb_inter_predict( const VP8Raster::Macroblock & original_mb,
         }
       }
 
-      for ( int step = 512; step > 1; ) {
-        MVSearchResult result = diamond_search( original_mb, temp_mb, frame_mb,
-                                                reference, safe_reference,
-                                                best_ref, mv, step, y_ac_qi );
+      /* the recorded vector is only usable if it can be coded against this probe's best_ref */
+      if ( analysis_mode_ == REUSE_ANALYSIS and analysis->new_mv.at( frame_ref ).initialized()
+           and not out_of_bounds( analysis->new_mv.at( frame_ref ).get() - best_ref ) ) {
+        mv = analysis->new_mv.at( frame_ref ).get();
+      }
+      else {
+        mv = motion_search( original_mb, frame_mb, safe_reference, best_ref, quantizer, y_ac_qi );
+        mv += best_ref;
 
-        if ( result.mv == mv ) {
-          break; // there's no need to continue the search
+        if ( analysis_mode_ == RECORD_ANALYSIS ) {
+          analysis->new_mv.at( frame_ref ).reset( mv );
         }
-
-        mv = result.mv;
-        step = result.first_step;
       }
 
-      mv += best_ref;
-
       if ( mv.empty() ) {
         continue;
       }
@@ -328,10 +626,10 @@ void Encoder::luma_mb_inter_predict( const VP8Raster::Macroblock & original_mb,
     reference_mb.macroblock().Y.inter_predict( mv, safe_reference, prediction );
 
     pred.distortion = variance( original_mb.Y, prediction );
-    pred.rate = costs_.mbmode_costs.at( 1 ).at( prediction_mode );
+    pred.rate = mode_costs.at( prediction_mode );
 
     if ( prediction_mode == NEWMV ) {
-      pred.rate += costs_.motion_vector_cost( mv - best_ref, 96 );
+      pred.rate += costs().motion_vector_cost( mv - best_ref, 96 );
     }
 
     /* chroma_mb_inter_predict( original_mb, reconstructed_mb, temp_mb, frame_mb,
@@ -443,7 +741,7 @@ void Encoder::chroma_mb_inter_predict( const VP8Raster::Macroblock & original_mb
 {
   assert( frame_mb.inter_coded() );
 
-  const VP8Raster & reference = references_.at( frame_mb.header().reference() );
+  const VP8Raster & reference = references().at( frame_mb.header().reference() );
 
   auto reference_mb = reference.macroblock( original_mb.Y.column(),
                                             original_mb.Y.row() );
@@ -463,18 +761,18 @@ void Encoder::chroma_mb_inter_predict( const VP8Raster::Macroblock & original_mb
     frame_mb.U().forall_ij(
       [&] ( UVBlock & block, const unsigned int column, const unsigned int row )
       {
-        reference_mb.U_sub_at( column, row ).inter_predict( block.motion_vector(), reference.U(),
+        reference_mb.U_sub_at( column, row ).inter_predict( block.motion_vector(), reference.extended().U,
                                                             reconstructed_mb.U_sub_at( column, row ).mutable_contents() );
-        reference_mb.V_sub_at( column, row ).inter_predict( block.motion_vector(), reference.V(),
+        reference_mb.V_sub_at( column, row ).inter_predict( block.motion_vector(), reference.extended().V,
                                                             reconstructed_mb.V_sub_at( column, row ).mutable_contents() );
       }
     );
   }
   else {
     reference_mb.U().inter_predict( frame_mb.U().at( 0, 0 ).motion_vector(),
-                                  reference.U(), reconstructed_mb.U.mutable_contents() );
+                                  reference.extended().U, reconstructed_mb.U.mutable_contents() );
     reference_mb.V().inter_predict( frame_mb.U().at( 0, 0 ).motion_vector(),
-                                  reference.V(), reconstructed_mb.V.mutable_contents() );
+                                  reference.extended().V, reconstructed_mb.V.mutable_contents() );
   }
 
   frame_mb.U().forall_ij(
@@ -515,7 +813,7 @@ void Encoder::optimize_mv_probs( InterFrame & frame, const MVComponentCounts & c
 
       const uint32_t prob = Encoder::calc_prob( false_count, false_count + true_count );
 
-      if ( prob > 1 and prob != decoder_state_.probability_tables.motion_vector_probs.at( i ).at( j ) ) {
+      if ( prob > 1 and prob != decoder_state().probability_tables.motion_vector_probs.at( i ).at( j ) ) {
         frame.mutable_header().mv_prob_update.at( i ).at( j ) = MVProbUpdate( true, ( prob >> 1 ) << 1 );
       }
     }
@@ -580,29 +878,31 @@ pair<InterFrame &, double> Encoder::encode_raster<InterFrame>( const VP8Raster &
                                                                const bool update_state,
                                                                const bool compute_ssim )
 {
-  DecoderState decoder_state_copy = decoder_state_;
+  const shared_ptr<State> saved_state = state_;
 
-  InterFrame & frame = inter_frame_;
+  InterFrame & frame = workspace().inter_frame;
 
   frame.mutable_header().quant_indices = quant_indices;
   frame.mutable_header().refresh_entropy_probs = true;
   frame.mutable_header().refresh_last = true;
+  frame.mutable_header().filter_type = simple_loop_filter_;
+  frame.mutable_header().log2_number_of_dct_partitions = log2_dct_partitions_;
 
   Quantizer quantizer( frame.header().quant_indices );
   MutableRasterHandle reconstructed_raster_handle { width(), height() };
 
   update_rd_multipliers( quantizer );
 
-  costs_.fill_token_costs( ProbabilityTables() );
+  workspace().costs.fill_token_costs( ProbabilityTables() );
 
   TokenBranchCounts token_branch_counts;
   MVComponentCounts component_counts;
 
-  costs_.fill_mv_component_costs( decoder_state_.probability_tables.motion_vector_probs );
-  costs_.fill_mv_sad_costs();
+  workspace().costs.fill_mv_component_costs( decoder_state().probability_tables.motion_vector_probs );
 
-  raster.macroblocks_forall_ij(
-    [&] ( VP8Raster::ConstMacroblock original_mb, unsigned int mb_column, unsigned int mb_row )
+  encode_macroblocks( raster, token_branch_counts,
+    [&] ( VP8Raster::ConstMacroblock original_mb, unsigned int mb_column, unsigned int mb_row,
+          TokenBranchCounts & token_counts )
     {
       auto reconstructed_mb = reconstructed_raster_handle.get().macroblock( mb_column, mb_row );
       auto temp_mb = temp_raster().macroblock( mb_column, mb_row );
@@ -625,13 +925,13 @@ pair<InterFrame &, double> Encoder::encode_raster<InterFrame>( const VP8Raster &
       frame_mb.calculate_has_nonzero();
 
       if ( frame_mb.inter_coded() ) {
-        frame_mb.reconstruct_inter( quantizer, references_, reconstructed_mb );
+        frame_mb.reconstruct_inter( quantizer, references(), reconstructed_mb );
       }
       else {
         frame_mb.reconstruct_intra( quantizer, reconstructed_mb );
       }
 
-      frame_mb.accumulate_token_branches( token_branch_counts );
+      frame_mb.accumulate_token_branches( token_counts );
     }
   );
 
@@ -645,7 +945,7 @@ pair<InterFrame &, double> Encoder::encode_raster<InterFrame>( const VP8Raster &
   RasterHandle immutable_raster( move( reconstructed_raster_handle ) );
 
   if ( not update_state ) {
-    decoder_state_ = decoder_state_copy;
+    state_ = saved_state;
   }
 
   return { frame,
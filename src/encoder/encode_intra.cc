@@ -26,6 +26,7 @@
    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
+#include <array>
 #include <limits>
 #include <typeinfo>
 
@@ -37,14 +38,21 @@ template<>
 void Encoder::update_decoder_state( const KeyFrame & frame )
 {
   // this is a keyframe! reset the decoder state
-  decoder_state_ = DecoderState( frame.header(), width(), height() );
-  references_ = References( width(), height() );
+  State & state = mutable_state();
+  state.decoder_state = DecoderState( frame.header(), width(), height() );
+  state.references = References( width(), height() );
 
   if ( frame.header().refresh_entropy_probs ) {
-    decoder_state_.probability_tables.coeff_prob_update( frame.header() );
+    state.decoder_state.probability_tables.coeff_prob_update( frame.header() );
   }
 }
 
+template<>
+void Encoder::update_motion_history( const KeyFrame & )
+{
+  /* a key frame has no motion, so the last inter frame's still seeds the next one */
+}
+
 void Encoder::luma_sb_apply_intra_prediction( const VP8Raster::Block4 & original_sb,
                                               VP8Raster::Block4 & reconstructed_sb,
                                               YBlock & frame_sb,
@@ -101,16 +109,26 @@ Encoder::MBPredictionData Encoder::luma_mb_best_prediction_mode( const VP8Raster
     total_modes = B_PRED - 1;
   }
 
+  MacroblockAnalysis * const analysis = macroblock_analysis( frame_mb );
+  const uint16_t analysed_y_modes = analysis ? analysis->y_modes : 0;
+
+  array<uint32_t, num_y_modes> mode_costs;
+  mode_costs.fill( numeric_limits<uint32_t>::max() );
+
   /* Because of the way that reconstructed_mb is used as a buffer to store the
    * best prediction result, it is necessary to first examine the B_PRED and
    * then the other prediction modes. */
   for ( unsigned int prediction_mode = total_modes; prediction_mode < num_y_modes; prediction_mode-- ) {
+    if ( not analysed_mode( analysed_y_modes, prediction_mode ) ) {
+      continue;
+    }
+
     MBPredictionData pred;
     pred.prediction_mode = ( mbmode )prediction_mode;
 
     if ( prediction_mode == B_PRED ) {
       pred.cost = 0;
-      pred.rate = costs_.mbmode_costs.at( interframe ? 1 : 0 ).at( B_PRED );
+      pred.rate = costs().mbmode_costs().at( interframe ? 1 : 0 ).at( B_PRED );
       pred.distortion = 0;
 
       reconstructed_mb.Y_sub_forall_ij(
@@ -126,9 +144,10 @@ Encoder::MBPredictionData Encoder::luma_mb_best_prediction_mode( const VP8Raster
             ? frame_sb.context().left.get()->prediction_mode() : B_DC_PRED;
 
           bmode sb_prediction_mode = luma_sb_intra_predict( original_sb,
-            reconstructed_sb, temp_sb, costs_.bmode_costs.at( above_mode ).at( left_mode ) );
+            reconstructed_sb, temp_sb, costs().bmode_costs().at( above_mode ).at( left_mode ),
+            analysis ? &analysis->b_modes.at( sb_column + 4 * sb_row ) : nullptr );
 
-          pred.rate += costs_.bmode_costs.at( above_mode ).at( left_mode ).at( sb_prediction_mode );
+          pred.rate += costs().bmode_costs().at( above_mode ).at( left_mode ).at( sb_prediction_mode );
           pred.distortion += sse( original_sb, reconstructed_sb.contents() );
 
           luma_sb_apply_intra_prediction( original_sb, reconstructed_sb, frame_sb,
@@ -146,17 +165,23 @@ Encoder::MBPredictionData Encoder::luma_mb_best_prediction_mode( const VP8Raster
        * the average will be taken out from Y2 block into the Y2 block. */
       pred.distortion = variance( original_mb.Y, prediction );
 
-      pred.rate = costs_.mbmode_costs.at( interframe ? 1 : 0 ).at( prediction_mode );
+      pred.rate = costs().mbmode_costs().at( interframe ? 1 : 0 ).at( prediction_mode );
       pred.cost = rdcost( pred.rate, pred.distortion, RATE_MULTIPLIER,
                           DISTORTION_MULTIPLIER );
     }
 
+    mode_costs.at( prediction_mode ) = pred.cost;
+
     if ( pred.cost < best_pred.cost ) {
       reconstructed_mb.Y.mutable_contents().copy_from( prediction );
       best_pred = pred;
     }
   }
 
+  if ( analysis_mode_ == RECORD_ANALYSIS ) {
+    analysis->y_modes = best_modes( mode_costs );
+  }
+
   return best_pred;
 }
 
@@ -248,6 +273,7 @@ void Encoder::luma_mb_intra_predict( const VP8Raster::Macroblock & original_mb,
 Encoder::MBPredictionData Encoder::chroma_mb_best_prediction_mode( const VP8Raster::Macroblock & original_mb,
                                                                    VP8Raster::Macroblock & reconstructed_mb,
                                                                    VP8Raster::Macroblock & temp_mb,
+                                                                   MacroblockAnalysis * const analysis,
                                                                    const bool interframe ) const
 {
   MBPredictionData best_pred;
@@ -258,7 +284,16 @@ Encoder::MBPredictionData Encoder::chroma_mb_best_prediction_mode( const VP8Rast
   auto u_predictors = reconstructed_mb.U.predictors();
   auto v_predictors = reconstructed_mb.V.predictors();
 
+  const uint16_t analysed_uv_modes = analysis ? analysis->uv_modes : 0;
+
+  array<uint32_t, num_uv_modes> mode_distortions;
+  mode_distortions.fill( numeric_limits<uint32_t>::max() );
+
   for ( unsigned int prediction_mode = 0; prediction_mode < num_uv_modes; prediction_mode++ ) {
+    if ( not analysed_mode( analysed_uv_modes, prediction_mode ) ) {
+      continue;
+    }
+
     MBPredictionData pred;
     pred.prediction_mode = ( mbmode )prediction_mode;
 
@@ -268,10 +303,12 @@ Encoder::MBPredictionData Encoder::chroma_mb_best_prediction_mode( const VP8Rast
     pred.distortion = sse( original_mb.U, u_prediction )
                     + sse( original_mb.V, v_prediction );
 
-    pred.rate = costs_.intra_uv_mode_costs.at( interframe ).at( prediction_mode );
+    pred.rate = costs().intra_uv_mode_costs().at( interframe ).at( prediction_mode );
     pred.cost = rdcost( pred.rate, pred.distortion, RATE_MULTIPLIER,
                         DISTORTION_MULTIPLIER );
 
+    mode_distortions.at( prediction_mode ) = pred.distortion;
+
     if ( pred.distortion < best_pred.distortion ) {
       reconstructed_mb.U.mutable_contents().copy_from( u_prediction );
       reconstructed_mb.V.mutable_contents().copy_from( v_prediction );
@@ -280,6 +317,10 @@ Encoder::MBPredictionData Encoder::chroma_mb_best_prediction_mode( const VP8Rast
     }
   }
 
+  if ( analysis_mode_ == RECORD_ANALYSIS ) {
+    analysis->uv_modes = best_modes( mode_distortions );
+  }
+
   return best_pred;
 }
 
@@ -346,6 +387,7 @@ void Encoder::chroma_mb_intra_predict( const VP8Raster::Macroblock & original_mb
   MBPredictionData best_pred = chroma_mb_best_prediction_mode( original_mb,
                                                                reconstructed_mb,
                                                                temp_mb,
+                                                               macroblock_analysis( frame_mb ),
                                                                interframe );
 
   // Apply
@@ -360,7 +402,8 @@ void Encoder::chroma_mb_intra_predict( const VP8Raster::Macroblock & original_mb
 bmode Encoder::luma_sb_intra_predict( const VP8Raster::Block4 & original_sb,
                                       VP8Raster::Block4 & reconstructed_sb,
                                       VP8Raster::Block4 & temp_sb,
-                                      const SafeArray<uint16_t, num_intra_b_modes> & mode_costs ) const
+                                      const SafeArray<uint16_t, num_intra_b_modes> & mode_costs,
+                                      uint16_t * const analysed_modes ) const
 {
   uint32_t min_error = numeric_limits<uint32_t>::max();
   bmode min_prediction_mode = B_DC_PRED;
@@ -368,13 +411,22 @@ bmode Encoder::luma_sb_intra_predict( const VP8Raster::Block4 & original_sb,
 
   auto predictors = reconstructed_sb.predictors();
 
+  array<uint32_t, num_intra_b_modes> errors;
+  errors.fill( numeric_limits<uint32_t>::max() );
+
   for ( unsigned int prediction_mode = 0; prediction_mode < num_intra_b_modes; prediction_mode++ ) {
+    if ( analysed_modes and not analysed_mode( *analysed_modes, prediction_mode ) ) {
+      continue;
+    }
+
     reconstructed_sb.intra_predict( ( bmode )prediction_mode, predictors, prediction );
 
     uint32_t distortion = sse( original_sb, prediction );
     uint32_t error_val = rdcost( mode_costs.at( prediction_mode ), distortion,
                                  RATE_MULTIPLIER, DISTORTION_MULTIPLIER );
 
+    errors.at( prediction_mode ) = error_val;
+
     if ( error_val < min_error ) {
       reconstructed_sb.mutable_contents().copy_from( prediction );
       min_prediction_mode = ( bmode )prediction_mode;
@@ -382,6 +434,10 @@ bmode Encoder::luma_sb_intra_predict( const VP8Raster::Block4 & original_sb,
     }
   }
 
+  if ( analysed_modes and analysis_mode_ == RECORD_ANALYSIS ) {
+    *analysed_modes = best_modes( errors );
+  }
+
   return min_prediction_mode;
 }
 
@@ -391,13 +447,15 @@ pair<KeyFrame &, double> Encoder::encode_raster<KeyFrame>( const VP8Raster & ras
                                                            const bool update_state,
                                                            const bool compute_ssim )
 {
-  DecoderState decoder_state_copy = decoder_state_;
-  decoder_state_ = DecoderState( width(), height() );
+  const shared_ptr<State> saved_state = state_;
+  mutable_state().decoder_state = DecoderState( width(), height() );
 
-  KeyFrame & frame = key_frame_;
+  KeyFrame & frame = workspace().key_frame;
 
   frame.mutable_header().quant_indices = quant_indices;
   frame.mutable_header().refresh_entropy_probs = true;
+  frame.mutable_header().filter_type = simple_loop_filter_;
+  frame.mutable_header().log2_number_of_dct_partitions = log2_dct_partitions_;
 
   Quantizer quantizer( frame.header().quant_indices );
   MutableRasterHandle reconstructed_raster_handle { width(), height() };
@@ -411,12 +469,13 @@ pair<KeyFrame &, double> Encoder::encode_raster<KeyFrame>( const VP8Raster & ras
         pass++ ) {
 
     if ( pass == SECOND_PASS ) {
-      costs_.fill_token_costs( decoder_state_.probability_tables );
+      workspace().costs.fill_token_costs( decoder_state().probability_tables );
       token_branch_counts = TokenBranchCounts();
     }
 
-    raster.macroblocks_forall_ij(
-      [&] ( VP8Raster::ConstMacroblock original_mb, unsigned int mb_column, unsigned int mb_row )
+    encode_macroblocks( raster, token_branch_counts,
+      [&] ( VP8Raster::ConstMacroblock original_mb, unsigned int mb_column, unsigned int mb_row,
+            TokenBranchCounts & token_counts )
       {
         auto reconstructed_mb = reconstructed_raster_handle.get().macroblock( mb_column, mb_row );
         auto temp_mb = temp_raster().macroblock( mb_column, mb_row );
@@ -431,7 +490,7 @@ pair<KeyFrame &, double> Encoder::encode_raster<KeyFrame>( const VP8Raster & ras
         frame_mb.calculate_has_nonzero();
         frame_mb.reconstruct_intra( quantizer, reconstructed_mb );
 
-        frame_mb.accumulate_token_branches( token_branch_counts );
+        frame_mb.accumulate_token_branches( token_counts );
       }
     );
 
@@ -448,7 +507,7 @@ pair<KeyFrame &, double> Encoder::encode_raster<KeyFrame>( const VP8Raster & ras
   RasterHandle immutable_raster( move( reconstructed_raster_handle ) );
 
   if ( not update_state ) {
-    decoder_state_ = decoder_state_copy;
+    state_ = saved_state;
   }
 
   return { frame,
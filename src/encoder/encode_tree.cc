@@ -26,9 +26,10 @@
    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
-#include <vector>
+#include <utility>
 
 #include "bool_encoder.hh"
+#include "safe_array.hh"
 
 using namespace std;
 
@@ -43,18 +44,21 @@ static void encode( BoolEncoder & encoder,
     value_to_index.at( 128 + nodes.at( i ) - 1 ) = i;
   }
 
-  vector< pair< bool, Probability > > bits;
+  /* no path is longer than the alphabet, so it fits on the stack */
+  SafeArray< pair< bool, Probability >, alphabet_size > bits;
+  uint8_t bit_count = 0;
 
   /* find the path to the node */
   uint8_t node_index = value_to_index.at( 128 - value - 1 );
-  bits.emplace_back( node_index & 1, probs.at( node_index >> 1 ) );
+  bits.at( bit_count++ ) = make_pair( node_index & 1, probs.at( node_index >> 1 ) );
   while ( node_index > 1 ) {
     node_index = value_to_index.at( 128 + (node_index & 0xfe) - 1 );
-    bits.emplace_back( node_index & 1, probs.at( node_index >> 1 ) );
+    bits.at( bit_count++ ) = make_pair( node_index & 1, probs.at( node_index >> 1 ) );
   }
 
   /* encode the path */
-  for ( auto it = bits.rbegin(); it != bits.rend(); it++ ) {
-    encoder.put( it->first, it->second );
+  while ( bit_count > 0 ) {
+    bit_count--;
+    encoder.put( bits.at( bit_count ).first, bits.at( bit_count ).second );
   }
 }
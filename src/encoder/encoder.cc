@@ -32,6 +32,7 @@
 #include <limits>
 #include <utility>
 #include <chrono>
+#include <future>
 
 #include "block.hh"
 #include "encoder.hh"
@@ -58,89 +59,100 @@ QuantIndices::QuantIndices()
   : y_ac_qi(), y_dc(), y2_dc(), y2_ac(), uv_dc(), uv_ac()
 {}
 
-template <unsigned int size>
-void VP8Raster::Block<size>::inter_predict( const MotionVector & mv,
-                                            const TwoD<uint8_t> & reference,
-                                            TwoD<uint8_t> & output ) const
-{
-  TwoDSubRange<uint8_t, size, size> subrange( output, 0, 0 );
-  inter_predict( mv, reference, subrange );
-}
-
 /* Encoder */
+Encoder::State::State( const DecoderState & s_decoder_state, const References & s_references )
+  : decoder_state( s_decoder_state ), references( s_references )
+{}
+
+Encoder::Workspace::Workspace( const uint16_t width, const uint16_t height )
+  : temp_raster( width, height ),
+    key_frame( width, height ),
+    subsampled_key_frame( uint16_t( width / WIDTH_SAMPLE_DIMENSION_FACTOR ),
+                          uint16_t( height / HEIGHT_SAMPLE_DIMENSION_FACTOR ),
+                          subsampled_frame_pool<KeyFrame>() ),
+    inter_frame( width, height ),
+    subsampled_inter_frame( uint16_t( width / WIDTH_SAMPLE_DIMENSION_FACTOR ),
+                            uint16_t( height / HEIGHT_SAMPLE_DIMENSION_FACTOR ),
+                            subsampled_frame_pool<InterFrame>() )
+{}
+
 Encoder::Encoder( const uint16_t s_width,
                   const uint16_t s_height,
                   const bool two_pass,
                   const EncoderQuality quality )
-  : decoder_state_( s_width, s_height ),
-    references_( width(), height() ),
-    safe_references_( references_ ), has_state_( false ), costs_(),
+  : state_( make_shared<State>( DecoderState( s_width, s_height ),
+                                References( s_width, s_height ) ) ),
+    has_state_( false ),
     two_pass_encoder_( two_pass ), encode_quality_( quality )
-{
-  costs_.fill_mode_costs();
-}
+{}
 
 Encoder::Encoder( const Decoder & decoder, const bool two_pass,
                   const EncoderQuality quality )
-  : decoder_state_( decoder.get_state() ), references_( decoder.get_references() ),
-    safe_references_( references_ ), has_state_( true ), costs_(),
+  : state_( make_shared<State>( decoder.get_state(), decoder.get_references() ) ),
+    has_state_( true ),
     two_pass_encoder_( two_pass ), encode_quality_( quality )
-{
-  costs_.fill_mode_costs();
-}
+{}
 
 Encoder::Encoder( const Encoder & encoder )
-  : decoder_state_( encoder.decoder_state_ ),
-    references_( encoder.references_ ),
-    safe_references_( encoder.safe_references_ ),
-    has_state_( encoder.has_state_ ), costs_( encoder.costs_ ),
+  : state_( encoder.state_ ),
+    has_state_( encoder.has_state_ ),
     two_pass_encoder_( encoder.two_pass_encoder_ ),
     encode_quality_( encoder.encode_quality_ ),
-    loop_filter_level_( encoder.loop_filter_level_ ),
-    last_y_ac_qi_( encoder.last_y_ac_qi_ ),
+    simple_loop_filter_( encoder.simple_loop_filter_ ),
+    log2_dct_partitions_( encoder.log2_dct_partitions_ ),
+    encode_threads_( encoder.encode_threads_ ),
     encode_stats_( encoder.encode_stats_ )
 {}
 
 Encoder::Encoder( Encoder && encoder )
-  : decoder_state_( move( encoder.decoder_state_ ) ),
-    references_( move( encoder.references_ ) ),
-    safe_references_( move( encoder.safe_references_ ) ),
-    has_state_( encoder.has_state_ ), costs_( move( encoder.costs_ ) ),
+  : state_( move( encoder.state_ ) ),
+    workspace_( move( encoder.workspace_ ) ),
+    has_state_( encoder.has_state_ ),
     two_pass_encoder_( encoder.two_pass_encoder_ ),
     encode_quality_( encoder.encode_quality_ ),
-    key_frame_( move( encoder.key_frame_ ) ),
-    subsampled_key_frame_( move( encoder.subsampled_key_frame_ ) ),
-    inter_frame_( move( encoder.inter_frame_ ) ),
-    subsampled_inter_frame_( move( encoder.subsampled_inter_frame_ ) ),
-    loop_filter_level_( move( encoder.loop_filter_level_ ) ),
-    last_y_ac_qi_( move( encoder.last_y_ac_qi_ ) ),
+    simple_loop_filter_( encoder.simple_loop_filter_ ),
+    log2_dct_partitions_( encoder.log2_dct_partitions_ ),
+    encode_threads_( encoder.encode_threads_ ),
     encode_stats_( move( encoder.encode_stats_ ) )
 {}
 
 Encoder & Encoder::operator=( Encoder && encoder )
 {
-  decoder_state_ = move( encoder.decoder_state_ );
-  references_ = move( encoder.references_ );
-  safe_references_ = move( encoder.safe_references_ );
+  state_ = move( encoder.state_ );
+  workspace_ = move( encoder.workspace_ );
   has_state_ = encoder.has_state_;
-  costs_ = move( encoder.costs_ );
   two_pass_encoder_ = encoder.two_pass_encoder_;
   encode_quality_ = encoder.encode_quality_;
-  key_frame_ = move( encoder.key_frame_ );
-  subsampled_key_frame_ = move( encoder.subsampled_key_frame_ );
-  inter_frame_ = move( encoder.inter_frame_ );
-  subsampled_inter_frame_ = move( encoder.subsampled_inter_frame_ );
-  loop_filter_level_ = move( encoder.loop_filter_level_ );
-  last_y_ac_qi_ = move( encoder.last_y_ac_qi_ );
+  simple_loop_filter_ = encoder.simple_loop_filter_;
+  log2_dct_partitions_ = encoder.log2_dct_partitions_;
+  encode_threads_ = encoder.encode_threads_;
   encode_stats_ = move( encoder.encode_stats_ );
 
   return *this;
 }
 
+Encoder::State & Encoder::mutable_state()
+{
+  if ( state_.use_count() > 1 ) {
+    state_ = make_shared<State>( *state_ );
+  }
+
+  return *state_;
+}
+
+Encoder::Workspace & Encoder::workspace() const
+{
+  if ( not workspace_ ) {
+    workspace_.reset( new Workspace( width(), height() ) );
+  }
+
+  return *workspace_;
+}
+
 uint32_t Encoder::minihash() const
 {
-  return static_cast<uint32_t>( DecoderHash( decoder_state_.hash(), references_.last.hash(),
-                                references_.golden.hash(), references_.alternative.hash() ).hash() );
+  return static_cast<uint32_t>( DecoderHash( decoder_state().hash(), references().last.hash(),
+                                references().golden.hash(), references().alternative.hash() ).hash() );
 }
 
 template<class FrameType>
@@ -149,30 +161,48 @@ vector<uint8_t> Encoder::write_frame( const FrameType & frame,
 {
   // update the state
   update_decoder_state( frame );
+  update_motion_history( frame );
 
   // update the references
+  State & state = mutable_state();
   MutableRasterHandle raster { width(), height() };
-  frame.decode( decoder_state_.segmentation, references_, raster );
-  frame.loopfilter( decoder_state_.segmentation, decoder_state_.filter_adjustments, raster );
+  frame.decode( state.decoder_state.segmentation, state.references, raster );
+  frame.loopfilter( state.decoder_state.segmentation, state.decoder_state.filter_adjustments, raster );
+  raster.get().extend_borders();
   RasterHandle immutable_raster( move( raster ) );
-  frame.copy_to( immutable_raster, references_ );
-
-  safe_references_.last = move( SafeReferences::load( references_.last ) );
-  safe_references_.golden = move( SafeReferences::load( references_.golden ) );
-  safe_references_.alternative = move( SafeReferences::load( references_.alternative ) );
+  frame.copy_to( immutable_raster, state.references );
 
   if ( encode_quality_ == REALTIME_QUALITY ) {
-    loop_filter_level_.reset( frame.header().loop_filter_level );
-    last_y_ac_qi_.reset( frame.header().quant_indices.y_ac_qi );
+    state.loop_filter_level.reset( frame.header().loop_filter_level );
+    state.last_y_ac_qi.reset( frame.header().quant_indices.y_ac_qi );
   }
 
-  return frame.serialize( prob_tables );
+  /* most frames are about as large as the one before */
+  vector<uint8_t> output;
+  output.reserve( workspace().last_frame_size + workspace().last_frame_size / 4 );
+  frame.serialize( prob_tables, output, encode_threads_ );
+  workspace().last_frame_size = output.size();
+
+  return output;
 }
 
 template<class FrameType>
 vector<uint8_t> Encoder::write_frame( const FrameType & frame )
 {
-  return write_frame( frame, decoder_state_.probability_tables );
+  /* writing the frame updates these tables in place, so they must already
+     be this encoder's own rather than shared with a copy */
+  return write_frame( frame, mutable_state().decoder_state.probability_tables );
+}
+
+void Encoder::set_dct_partitions( const unsigned int partitions )
+{
+  switch ( partitions ) {
+  case 1: log2_dct_partitions_ = 0; break;
+  case 2: log2_dct_partitions_ = 1; break;
+  case 4: log2_dct_partitions_ = 2; break;
+  case 8: log2_dct_partitions_ = 3; break;
+  default: throw Invalid( "the number of DCT partitions must be 1, 2, 4 or 8" );
+  }
 }
 
 void Encoder::update_rd_multipliers( const Quantizer & quantizer )
@@ -335,10 +365,10 @@ void Encoder::trellis_quantize( FrameSubblockType & frame_sb,
           size_t current_context = prev_token_class.at( current_node.token );
 
           // cost of the next token based on the *current* context
-          rates[ next ] += costs_.token_costs.at( frame_sb.type() )
-                                             .at( next_band )
-                                             .at( current_context )
-                                             .at( next_node.token );
+          rates[ next ] += costs().token_costs().at( frame_sb.type() )
+                                               .at( next_band )
+                                               .at( current_context )
+                                               .at( next_node.token );
         }
 
         rd_costs[ next ] = rdcost( rates[ next ], distortions[ next ],
@@ -373,10 +403,10 @@ void Encoder::trellis_quantize( FrameSubblockType & frame_sb,
 
   for ( size_t i = 0; i < LEVELS; i++ ) {
     TrellisNode & node = trellis.at( first_index ).at( i );
-    node.rate += costs_.token_costs.at( frame_sb.type() )
-                                   .at( coefficient_to_band.at( first_index ) )
-                                   .at( token_context )
-                                   .at( node.token );
+    node.rate += costs().token_costs().at( frame_sb.type() )
+                                     .at( coefficient_to_band.at( first_index ) )
+                                     .at( token_context )
+                                     .at( node.token );
 
     node.cost = rdcost( node.rate, node.distortion, RATE_MULTIPLIER,
                         DISTORTION_MULTIPLIER );
@@ -429,7 +459,7 @@ void Encoder::optimize_probability_tables( FrameType & frame, const TokenBranchC
 
           assert( prob <= 255 );
 
-          if ( prob > 0 and prob != decoder_state_.probability_tables.coeff_probs.at( i ).at( j ).at( k ).at( l ) ) {
+          if ( prob > 0 and prob != decoder_state().probability_tables.coeff_probs.at( i ).at( j ).at( k ).at( l ) ) {
             frame.mutable_header().token_prob_update.at( i ).at( j ).at( k ).at( l ) = TokenProbUpdate( true, prob );
           }
         }
@@ -475,15 +505,15 @@ void Encoder::apply_best_loopfilter_settings( const VP8Raster & original,
   uint8_t min_lf_level = 0;
   uint8_t max_lf_level = 63;
 
-  if ( loop_filter_level_.initialized() ) {
-    if ( loop_filter_level_.get() > 0 ) {
-      min_lf_level = loop_filter_level_.get() - 1;
+  if ( state().loop_filter_level.initialized() ) {
+    if ( state().loop_filter_level.get() > 0 ) {
+      min_lf_level = state().loop_filter_level.get() - 1;
     }
     else {
       min_lf_level = 0;
     }
 
-    max_lf_level = min( 63u, loop_filter_level_.get() + 1u );
+    max_lf_level = min( 63u, state().loop_filter_level.get() + 1u );
   }
 
   for ( uint8_t lf_level = min_lf_level; lf_level <= max_lf_level; lf_level++ ) {
@@ -491,9 +521,9 @@ void Encoder::apply_best_loopfilter_settings( const VP8Raster & original,
 
     frame.mutable_header().loop_filter_level = lf_level;
 
-    decoder_state_.filter_adjustments.reset( frame.header() );
+    mutable_state().decoder_state.filter_adjustments.reset( frame.header() );
 
-    frame.loopfilter( decoder_state_.segmentation, decoder_state_.filter_adjustments, temp_raster() );
+    frame.loopfilter( decoder_state().segmentation, decoder_state().filter_adjustments, temp_raster() );
 
     /* XXX This is taking too much time and is very inefficient. */
     double ssim = temp_raster().quality( original );
@@ -508,52 +538,159 @@ void Encoder::apply_best_loopfilter_settings( const VP8Raster & original,
   }
 
   frame.mutable_header().loop_filter_level = best_lf_level;
-  decoder_state_.filter_adjustments.reset( frame.header() );
+  mutable_state().decoder_state.filter_adjustments.reset( frame.header() );
 
-  frame.loopfilter( decoder_state_.segmentation, decoder_state_.filter_adjustments, reconstructed );
+  frame.loopfilter( decoder_state().segmentation, decoder_state().filter_adjustments, reconstructed );
 
   encode_stats_.ssim.reset( best_ssim );
 }
 
-template<class FrameType>
-FrameType & Encoder::encode_with_quantizer_search( const VP8Raster & raster,
-                                                   const double minimum_ssim )
+/* Searches [ min, max ] for the quantizer at the edge of the accepted ones:
+   the largest accepted quantizer if `ascending`, the smallest otherwise.
+   Each round probes up to `width` quantizers that split the range evenly,
+   calling accept( round, slot, y_ac_qi ) concurrently for distinct slots, and keeps
+   the part of the range between the last accepted and the first rejected
+   probe. With a width of one, this is a binary search. If the range narrows
+   to a single quantizer before any is accepted, that one is taken. */
+template<class AcceptFunction>
+static Optional<int> quantizer_search( int min, int max, const bool ascending,
+                                       const unsigned int width,
+                                       const AcceptFunction & accept )
 {
-  int y_ac_qi_min = 0;
-  int y_ac_qi_max = 127;
+  Optional<int> best;
+
+  for ( unsigned int round = 0; min <= max; round++ ) {
+    vector<int> probes;
+    for ( unsigned int i = 1; i <= width; i++ ) {
+      const int y_ac_qi = min + i * ( max - min ) / ( width + 1 );
+      if ( probes.empty() or probes.back() != y_ac_qi ) {
+        probes.push_back( y_ac_qi );
+      }
+    }
 
-  QuantIndices quant_indices;
+    if ( not ascending ) {
+      reverse( probes.begin(), probes.end() );
+    }
 
-  bool found = false;
-  size_t best_y_ac_qi = 0;
+    vector<future<bool>> pending;
+    for ( size_t i = 1; i < probes.size(); i++ ) {
+      pending.emplace_back( async( launch::async, [&accept, &probes, round, i]() { return accept( round, i, probes.at( i ) ); } ) );
+    }
 
-  while ( y_ac_qi_min <= y_ac_qi_max ) {
-    quant_indices.y_ac_qi = ( y_ac_qi_min + y_ac_qi_max ) / 2;
+    vector<bool> accepted { accept( round, 0, probes.at( 0 ) ) };
+    for ( auto & result : pending ) {
+      accepted.push_back( result.get() );
+    }
 
-    pair<FrameType &, double> encoded_frame = encode_raster<FrameType>( raster, quant_indices, true );
+    const bool last_candidate = ( min == max );
 
-    double current_ssim = encoded_frame.second;
+    for ( size_t i = 0; i < probes.size(); i++ ) {
+      const int y_ac_qi = probes.at( i );
 
-    if ( current_ssim >= minimum_ssim || ( y_ac_qi_min == y_ac_qi_max && not found ) ) {
-      // this is a potential answer, let's save it
-      found = true;
-      best_y_ac_qi = quant_indices.y_ac_qi;
-    }
+      if ( accepted.at( i ) or ( last_candidate and not best.initialized() ) ) {
+        best.reset( y_ac_qi );
 
-    if ( y_ac_qi_min == y_ac_qi_max ) {
-      break;
+        if ( ascending ) {
+          min = y_ac_qi + 1;
+        }
+        else {
+          max = y_ac_qi - 1;
+        }
+      }
+      else {
+        if ( ascending ) {
+          max = y_ac_qi - 1;
+        }
+        else {
+          min = y_ac_qi + 1;
+        }
+
+        break;
+      }
     }
+  }
 
-    if ( current_ssim < minimum_ssim ) {
-      y_ac_qi_max = quant_indices.y_ac_qi - 1;
+  return best;
+}
+
+vector<Encoder> Encoder::scratch_encoders( const shared_ptr<FrameAnalysis> & analysis ) const
+{
+  /* one probe per thread, each encoding its macroblocks serially */
+  vector<Encoder> encoders( encode_threads_, *this );
+  vector<unique_ptr<Workspace>> & spares = workspace().scratch_workspaces;
+
+  for ( Encoder & encoder : encoders ) {
+    encoder.encode_threads_ = 1;
+    encoder.analysis_ = analysis;
+
+    if ( not spares.empty() ) {
+      encoder.workspace_ = move( spares.back() );
+      spares.pop_back();
+    } else {
+      /* made here rather than on the probe's thread */
+      encoder.workspace();
     }
-    else {
-      y_ac_qi_min = quant_indices.y_ac_qi + 1;
+  }
+
+  return encoders;
+}
+
+/* hand the probes' workspaces back for the next frame's probes */
+void Encoder::keep_scratch_workspaces( vector<Encoder> & scratch ) const
+{
+  for ( Encoder & encoder : scratch ) {
+    if ( encoder.workspace_ ) {
+      workspace().scratch_workspaces.push_back( move( encoder.workspace_ ) );
     }
   }
+}
 
-  quant_indices.y_ac_qi = best_y_ac_qi;
-  return encode_raster<FrameType>( raster, quant_indices, false ).first;
+Encoder::AnalysisMode Encoder::probe_analysis_mode( const unsigned int round, const size_t slot )
+{
+  /* the first probe records the analysis, the others in its round go
+     without, and every later probe reuses it. This doesn't depend on
+     the order in which the probes finish, so neither does the output. */
+  if ( round > 0 ) {
+    return REUSE_ANALYSIS;
+  }
+
+  return slot == 0 ? RECORD_ANALYSIS : NO_ANALYSIS;
+}
+
+template<class FrameType>
+FrameType & Encoder::encode_with_quantizer_search( const VP8Raster & raster,
+                                                   const double minimum_ssim )
+{
+  const auto analysis = make_shared<FrameAnalysis>( VP8Raster::macroblock_dimension( width() ),
+                                                    VP8Raster::macroblock_dimension( height() ) );
+  vector<Encoder> scratch = scratch_encoders( analysis );
+
+  const Optional<int> best_y_ac_qi = quantizer_search( 0, 127, true, scratch.size(),
+    [&]( const unsigned int round, const size_t slot, const int y_ac_qi )
+    {
+      QuantIndices quant_indices;
+      quant_indices.y_ac_qi = y_ac_qi;
+
+      Encoder & encoder = scratch.at( slot );
+      encoder.analysis_mode_ = probe_analysis_mode( round, slot );
+
+      return encoder.encode_raster<FrameType>( raster, quant_indices, false, true ).second >= minimum_ssim;
+    } );
+
+  keep_scratch_workspaces( scratch );
+
+  QuantIndices quant_indices;
+  quant_indices.y_ac_qi = best_y_ac_qi.get_or( 0 );
+
+  analysis_ = analysis;
+  analysis_mode_ = REUSE_ANALYSIS;
+
+  FrameType & frame = encode_raster<FrameType>( raster, quant_indices, false ).first;
+
+  analysis_.reset();
+  analysis_mode_ = NO_ANALYSIS;
+
+  return frame;
 }
 
 vector<uint8_t> Encoder::encode_with_quantizer( const VP8Raster & raster, const uint8_t y_ac_qi )
@@ -597,35 +734,34 @@ vector<uint8_t> Encoder::encode_with_target_size( const VP8Raster & raster, cons
   int y_qi_min = 4;
   int y_qi_max = 127;
 
-  if ( last_y_ac_qi_.initialized() ) {
+  if ( state().last_y_ac_qi.initialized() ) {
     const int radius = 16;
 
-    if ( last_y_ac_qi_.get() - radius >= y_qi_min ) {
-      y_qi_min = last_y_ac_qi_.get() - radius;
+    if ( state().last_y_ac_qi.get() - radius >= y_qi_min ) {
+      y_qi_min = state().last_y_ac_qi.get() - radius;
     }
 
-    y_qi_max = min( y_qi_max, last_y_ac_qi_.get() + radius );
+    y_qi_max = min( y_qi_max, state().last_y_ac_qi.get() + radius );
   }
 
-  uint8_t best_y_qi = numeric_limits<uint8_t>::max();
-
-  size_t estimated_size = target_size;
+  /* the estimates are made on a subsampled frame, so the analysis is too */
+  const auto analysis = make_shared<FrameAnalysis>(
+    VP8Raster::macroblock_dimension( width() / WIDTH_SAMPLE_DIMENSION_FACTOR ),
+    VP8Raster::macroblock_dimension( height() / HEIGHT_SAMPLE_DIMENSION_FACTOR ) );
+  vector<Encoder> scratch = scratch_encoders( analysis );
 
-  while ( y_qi_min <= y_qi_max ) {
-    size_t y_qi = ( y_qi_min + y_qi_max ) / 2;
-    estimated_size = estimate_frame_size( raster, y_qi );
+  const Optional<int> best_y_qi = quantizer_search( y_qi_min, y_qi_max, false, scratch.size(),
+    [&]( const unsigned int round, const size_t slot, const int y_ac_qi )
+    {
+      Encoder & encoder = scratch.at( slot );
+      encoder.analysis_mode_ = probe_analysis_mode( round, slot );
 
-    if ( estimated_size <= target_size or ( y_qi_min == y_qi_max and best_y_qi == numeric_limits<uint8_t>::max() ) ) {
-      best_y_qi = y_qi;
+      return encoder.estimate_frame_size( raster, y_ac_qi ) <= target_size;
+    } );
 
-      y_qi_max = y_qi - 1;
-    }
-    else if ( estimated_size > target_size ) {
-      y_qi_min = y_qi + 1;
-    }
-  }
+  keep_scratch_workspaces( scratch );
 
-  return encode_with_quantizer( raster, best_y_qi );
+  return encode_with_quantizer( raster, best_y_qi.get_or( numeric_limits<uint8_t>::max() ) );
 }
 
 template <class FrameHeaderType, class MacroblockHeaderType>
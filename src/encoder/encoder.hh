@@ -31,6 +31,8 @@
 
 #include <vector>
 #include <string>
+#include <memory>
+#include <array>
 #include <tuple>
 #include <limits>
 
@@ -44,6 +46,7 @@
 #include "file_descriptor.hh"
 #include "block.hh"
 #include "frame_pool.hh"
+#include "wavefront.hh"
 
 const uint8_t DEFAULT_QUANTIZER = 64;
 
@@ -67,24 +70,6 @@ enum EncoderMode
   REENCODE
 };
 
-class SafeReferences
-{
-public:
-  /* For now, we only need the Y planes to do the diamond search, so we only
-     keep them in our safe references. */
-  SafeRasterHandle last, golden, alternative;
-
-private:
-  SafeReferences( const uint16_t width, const uint16_t height );
-
-public:
-  SafeReferences( const References & references );
-
-  const SafeRaster & get( reference_frame reference_id ) const;
-
-  static MutableSafeRasterHandle load( const VP8Raster & source );
-};
-
 template<class FrameType>
 static FramePool<FrameType> & subsampled_frame_pool()
 {
@@ -111,47 +96,157 @@ private:
     size_t first_step;
   };
 
+  /* A quantizer search encodes the same frame many times, and the costliest
+     decisions (the motion search and the choice of intra modes) barely
+     change with the quantizer. So one probe records them for every
+     macroblock and the others only try what it found, redoing just the
+     quantization and reconstruction. */
+  enum AnalysisMode
+  {
+    NO_ANALYSIS,
+    RECORD_ANALYSIS,
+    REUSE_ANALYSIS
+  };
+
+  struct MacroblockAnalysis
+  {
+    /* how many of the recorded best modes are tried again */
+    static const unsigned int MODE_CANDIDATES { 2 };
+
+    /* result of the motion-vector search against each reference */
+    SafeArray<Optional<MotionVector>, num_reference_frames> new_mv {};
+
+    /* bitmasks of the best modes; empty if nothing was recorded */
+    uint16_t y_modes { 0 };
+    uint16_t uv_modes { 0 };
+    SafeArray<uint16_t, 16> b_modes {{}};
+  };
+
+  struct FrameAnalysis
+  {
+    unsigned int width, height;
+    std::vector<MacroblockAnalysis> macroblocks;
+
+    FrameAnalysis( const unsigned int s_width, const unsigned int s_height )
+      : width( s_width ), height( s_height ), macroblocks( s_width * s_height )
+    {}
+  };
+
+  /* the motion of the last inter frame written, which seeds the motion
+     searches of the next one */
+  struct MotionHistory
+  {
+    unsigned int width, height;
+
+    /* the vector of every macroblock that was predicted from LAST_FRAME */
+    std::vector<Optional<MotionVector>> motion_vectors;
+
+    /* the median of those, component by component */
+    MotionVector global_motion {};
+
+    MotionHistory( const InterFrame & frame );
+  };
+
   static const size_t WIDTH_SAMPLE_DIMENSION_FACTOR { 4 };
   static const size_t HEIGHT_SAMPLE_DIMENSION_FACTOR { 4 };
 
+  /* the motion search covers 48 pixels each way at quarter resolution,
+     and refines from a whole pixel at full resolution (in 1/8 pixels) */
+  static const int COARSE_SEARCH_RADIUS { 12 };
+  static const int REFINE_STEP { 8 };
+
+  /* a seed whose mean absolute difference per pixel is within this fraction
+     of the quantizer's step is refined without searching the pyramid */
+  static const unsigned int EARLY_EXIT_DIVISOR { 4 };
+
   typedef SafeArray<SafeArray<std::pair<uint32_t, uint32_t>,
                               MV_PROB_CNT>,
                     2> MVComponentCounts;
 
-  DecoderState decoder_state_;
-  uint16_t width() const { return decoder_state_.width; }
-  uint16_t height() const { return decoder_state_.height; }
-  MutableRasterHandle temp_raster_handle_ { width(), height() };
-  References references_;
-  SafeReferences safe_references_;
+  /* what an encoder carries from one frame to the next. It is shared by
+     copies of the encoder (forking one is a pointer copy), and cloned by
+     the first of them to change it. */
+  struct State
+  {
+    DecoderState decoder_state;
+    References references;
 
-  bool has_state_;
+    Optional<uint8_t> loop_filter_level {};
+
+    /* if set, while encoding with max target size, the search scope for the
+       proper quantizer will be:
+       last_y_ac_qi - a <= y_ac_qi <= last_y_ac_qi + a */
+    Optional<uint8_t> last_y_ac_qi {};
+
+    std::shared_ptr<const MotionHistory> motion_history {};
+
+    State( const DecoderState & s_decoder_state, const References & s_references );
+  };
+
+  /* scratch space for encoding a frame. It isn't copied with the encoder;
+     each encoder makes its own the first time it encodes, except for the
+     quantizer probes, which get theirs from scratch_encoders(). */
+  struct Workspace
+  {
+    MutableRasterHandle temp_raster;
+
+    Costs costs {};
+
+    KeyFrameHandle key_frame;
+    KeyFrameHandle subsampled_key_frame;
+    InterFrameHandle inter_frame;
+    InterFrameHandle subsampled_inter_frame;
+
+    /* the size estimates serialize into this, which keeps its capacity */
+    std::vector<uint8_t> bitstream {};
+    size_t last_frame_size { 0 };
+
+    /* the quantizer probes' workspaces, kept from one frame to the next */
+    std::vector<std::unique_ptr<Workspace>> scratch_workspaces {};
+
+    Workspace( const uint16_t width, const uint16_t height );
+  };
+
+  std::shared_ptr<State> state_;
+  mutable std::unique_ptr<Workspace> workspace_ {};
+
+  const State & state() const { return *state_; }
+  State & mutable_state();
 
-  Costs costs_;
+  const DecoderState & decoder_state() const { return state_->decoder_state; }
+  const References & references() const { return state_->references; }
+
+  uint16_t width() const { return state_->decoder_state.width; }
+  uint16_t height() const { return state_->decoder_state.height; }
+
+  /* created on first use, which must not be from the encoding threads */
+  Workspace & workspace() const;
+  const Costs & costs() const { return workspace().costs; }
+
+  bool has_state_;
 
   bool two_pass_encoder_;
   EncoderQuality encode_quality_;
 
-  KeyFrameHandle key_frame_ { width(), height() };
-  KeyFrameHandle subsampled_key_frame_ { uint16_t( width() / WIDTH_SAMPLE_DIMENSION_FACTOR ),
-      uint16_t( height() / HEIGHT_SAMPLE_DIMENSION_FACTOR ),
-      subsampled_frame_pool<KeyFrame>() };
-  InterFrameHandle inter_frame_ { width(), height() };
-  InterFrameHandle subsampled_inter_frame_ { uint16_t( width() / WIDTH_SAMPLE_DIMENSION_FACTOR ),
-      uint16_t( height() / HEIGHT_SAMPLE_DIMENSION_FACTOR ),
-      subsampled_frame_pool<InterFrame>() };
-
-  Optional<uint8_t> loop_filter_level_ {};
+  /* use VP8's "simple" (luma-only) in-loop deblocking filter, which is much
+     cheaper for the receiver to apply */
+  bool simple_loop_filter_ { false };
 
-  /* if set, while encoding with max target size, the search scope for the
-     proper quantizer will be:
-     last_y_ac_qi_ - a <= y_ac_qi <= last_y_ac_qi_ + a */
-  Optional<uint8_t> last_y_ac_qi_ {};
+  /* the frames' tokens are split into 2^log2_dct_partitions_ partitions,
+     by macroblock row */
+  uint8_t log2_dct_partitions_ { 0 };
 
   // TODO: Where did these come from?
   uint32_t RATE_MULTIPLIER { 300 };
   uint32_t DISTORTION_MULTIPLIER { 1 };
 
+  /* number of threads that encode the macroblocks of each frame */
+  unsigned int encode_threads_ { 1 };
+
+  /* shared by the encoders taking part in a quantizer search */
+  std::shared_ptr<FrameAnalysis> analysis_ {};
+  AnalysisMode analysis_mode_ { NO_ANALYSIS };
+
   /* this struct will hold stats about the latest encoded frame */
   struct EncodeStats
   {
@@ -175,15 +270,46 @@ private:
                             const TwoDSubRange<uint8_t, size, size> & prediction );
 
   MVSearchResult diamond_search( const VP8Raster::Macroblock & original_mb,
-                                 VP8Raster::Macroblock & temp_mb,
                                  InterFrameMacroblock & frame_mb,
-                                 const VP8Raster & reference,
                                  const SafeRaster & safe_reference,
                                  MotionVector base_mv,
                                  MotionVector origin,
                                  size_t step_size,
                                  const size_t y_ac_qi ) const;
 
+  /* scores whole-pixel sites on the level of the reference's pyramid where a
+     macroblock is size pixels wide, and returns the best one (not relative to
+     base_mv, unlike motion_search) with its SAD scaled to full resolution */
+  template<unsigned int size>
+  std::pair<MotionVector, uint32_t> best_site( const uint8_t * source, const int source_stride,
+                                               const SafeRaster & reference,
+                                               const InterFrameMacroblock & frame_mb,
+                                               const MotionVector & base_mv,
+                                               const std::vector<MotionVector> & sites,
+                                               const size_t y_ac_qi ) const;
+
+  /* the best of the sites within radius of center */
+  template<unsigned int size>
+  MotionVector pyramid_search( const uint8_t * source, const int source_stride,
+                               const SafeRaster & reference,
+                               const InterFrameMacroblock & frame_mb,
+                               const MotionVector & base_mv,
+                               const MotionVector & center,
+                               const int radius,
+                               const size_t y_ac_qi ) const;
+
+  /* whole-pixel vectors to start the motion search of a macroblock from */
+  std::vector<MotionVector> motion_seeds( const InterFrameMacroblock & frame_mb,
+                                          const MotionVector & base_mv ) const;
+
+  /* returns the best motion vector relative to base_mv */
+  MotionVector motion_search( const VP8Raster::Macroblock & original_mb,
+                              InterFrameMacroblock & frame_mb,
+                              const SafeRaster & safe_reference,
+                              const MotionVector & base_mv,
+                              const Quantizer & quantizer,
+                              const size_t y_ac_qi ) const;
+
   void luma_mb_inter_predict( const VP8Raster::Macroblock & original_mb,
                               VP8Raster::Macroblock & constructed_mb,
                               VP8Raster::Macroblock & temp_mb,
@@ -236,6 +362,7 @@ private:
   MBPredictionData chroma_mb_best_prediction_mode( const VP8Raster::Macroblock & original_mb,
                                                    VP8Raster::Macroblock & reconstructed_mb,
                                                    VP8Raster::Macroblock & temp_mb,
+                                                   MacroblockAnalysis * const analysis,
                                                    const bool interframe = false ) const;
 
   template<class MacroblockType>
@@ -260,7 +387,8 @@ private:
   bmode luma_sb_intra_predict( const VP8Raster::Block4 & original_sb,
                                VP8Raster::Block4 & constructed_sb,
                                VP8Raster::Block4 & temp_sb,
-                               const SafeArray<uint16_t, num_intra_b_modes> & mode_costs ) const;
+                               const SafeArray<uint16_t, num_intra_b_modes> & mode_costs,
+                               uint16_t * const analysed_modes ) const;
 
   void luma_sb_apply_intra_prediction( const VP8Raster::Block4 & original_sb,
                                        VP8Raster::Block4 & reconstructed_sb,
@@ -275,7 +403,15 @@ private:
 
   void check_reset_y2( Y2Block & y2, const Quantizer & quantizer ) const;
 
-  VP8Raster & temp_raster() { return temp_raster_handle_.get(); }
+  VP8Raster & temp_raster() const { return workspace().temp_raster.get(); }
+
+  /* calls f( original_mb, column, row, counts ) for every macroblock of the
+     raster, in a wavefront over encode_threads_ threads. Each call accumulates
+     into a per-thread `counts`, which are summed into token_branch_counts. */
+  template<class lambda>
+  void encode_macroblocks( const VP8Raster & raster,
+                           TokenBranchCounts & token_branch_counts,
+                           const lambda & f ) const;
 
   /* this function returns the ssim value as the output */
   template<class FrameType>
@@ -330,12 +466,34 @@ private:
   template<class FrameType>
   void update_decoder_state( const FrameType & frame );
 
+  template<class FrameType>
+  void update_motion_history( const FrameType & frame );
+
   template<class FrameType>
   std::pair<FrameType &, double> encode_raster( const VP8Raster & raster,
                                                 const QuantIndices & quant_indices,
                                                 const bool update_state = false,
                                                 const bool compute_ssim = false );
 
+  /* the analysis of frame_mb, or nullptr if there is none */
+  template<class MacroblockType>
+  MacroblockAnalysis * macroblock_analysis( const MacroblockType & frame_mb ) const;
+
+  /* whether mode is among the analysed ones (always true with no analysis to reuse) */
+  bool analysed_mode( const uint16_t analysed_modes, const unsigned int mode ) const
+  {
+    return analysis_mode_ != REUSE_ANALYSIS or analysed_modes == 0 or ( analysed_modes & ( 1 << mode ) );
+  }
+
+  /* bitmask of the MODE_CANDIDATES modes with the lowest cost */
+  template<size_t mode_count>
+  static uint16_t best_modes( const std::array<uint32_t, mode_count> & costs );
+
+  /* copies of this encoder for probing quantizers, one per thread */
+  std::vector<Encoder> scratch_encoders( const std::shared_ptr<FrameAnalysis> & analysis ) const;
+  void keep_scratch_workspaces( std::vector<Encoder> & scratch ) const;
+  static AnalysisMode probe_analysis_mode( const unsigned int round, const size_t slot );
+
   template<class FrameType>
   FrameType & encode_with_quantizer_search( const VP8Raster & raster,
                                             const double minimum_ssim );
@@ -375,11 +533,107 @@ public:
 
   size_t estimate_frame_size( const VP8Raster & raster, const size_t y_ac_qi );
 
-  Decoder export_decoder() const { return { decoder_state_, references_ }; }
+  Decoder export_decoder() const { return { decoder_state(), references() }; }
 
   EncodeStats stats() { return encode_stats_; }
 
   uint32_t minihash() const;
+
+  void set_simple_loop_filter( const bool value ) { simple_loop_filter_ = value; }
+  bool simple_loop_filter() const { return simple_loop_filter_; }
+
+  /* 1, 2, 4 or 8. The partitions are serialized concurrently over the
+     encoding threads, and can be parsed concurrently by the receiver. */
+  void set_dct_partitions( const unsigned int partitions );
+  unsigned int dct_partitions() const { return 1 << log2_dct_partitions_; }
+
+  /* macroblocks are encoded in a wavefront, and the quantizer searches
+     probe this many quantizers at a time. Only the searches' output can
+     change with the number of threads. */
+  void set_encode_threads( const unsigned int threads ) { encode_threads_ = std::max( 1u, threads ); }
+  unsigned int encode_threads() const { return encode_threads_; }
 };
 
+template<class lambda>
+void Encoder::encode_macroblocks( const VP8Raster & raster,
+                                  TokenBranchCounts & token_branch_counts,
+                                  const lambda & f ) const
+{
+  /* a macroblock's modes, contexts and intra prediction only depend on its
+     left, above-left, above and above-right neighbours, which the wavefront
+     finishes first. Rows are dealt round-robin, so row r always goes to the
+     thread that owns slot r % encode_threads_. */
+  std::vector<TokenBranchCounts> row_counts( encode_threads_ );
+
+  /* the threads share the workspace, so it has to exist before they start */
+  workspace();
+
+  wavefront_forall_ij( raster.width() / 16, raster.height() / 16, encode_threads_,
+                       [&]( const unsigned int column, const unsigned int row )
+                       {
+                         f( raster.macroblock( column, row ), column, row,
+                            row_counts.at( row % encode_threads_ ) );
+                       },
+                       [&]( const unsigned int row )
+                       {
+                         /* sums are the same in any order, so the counts
+                            (and the probabilities) match a raster scan */
+                         TokenBranchCounts & counts = row_counts.at( row % encode_threads_ );
+
+                         for ( size_t i = 0; i < BLOCK_TYPES; i++ ) {
+                           for ( size_t j = 0; j < COEF_BANDS; j++ ) {
+                             for ( size_t k = 0; k < PREV_COEF_CONTEXTS; k++ ) {
+                               for ( size_t l = 0; l < ENTROPY_NODES; l++ ) {
+                                 auto & total = token_branch_counts.at( i ).at( j ).at( k ).at( l );
+                                 auto & count = counts.at( i ).at( j ).at( k ).at( l );
+                                 total.first += count.first;
+                                 total.second += count.second;
+                                 count = std::make_pair( 0, 0 );
+                               }
+                             }
+                           }
+                         }
+                       } );
+}
+
+template<class MacroblockType>
+Encoder::MacroblockAnalysis * Encoder::macroblock_analysis( const MacroblockType & frame_mb ) const
+{
+  if ( analysis_mode_ == NO_ANALYSIS ) {
+    return nullptr;
+  }
+
+  const auto & context = frame_mb.context();
+
+  if ( context.width != analysis_->width or context.height != analysis_->height ) {
+    throw LogicError();
+  }
+
+  return &analysis_->macroblocks.at( context.row * context.width + context.column );
+}
+
+template<size_t mode_count>
+uint16_t Encoder::best_modes( const std::array<uint32_t, mode_count> & costs )
+{
+  uint16_t modes = 0;
+
+  for ( unsigned int candidate = 0; candidate < MacroblockAnalysis::MODE_CANDIDATES; candidate++ ) {
+    Optional<unsigned int> best;
+
+    for ( unsigned int mode = 0; mode < mode_count; mode++ ) {
+      if ( not ( modes & ( 1 << mode ) )
+           and costs.at( mode ) != std::numeric_limits<uint32_t>::max()
+           and ( not best.initialized() or costs.at( mode ) < costs.at( best.get() ) ) ) {
+        best.reset( mode );
+      }
+    }
+
+    if ( best.initialized() ) {
+      modes |= 1 << best.get();
+    }
+  }
+
+  return modes;
+}
+
 #endif /* ENCODER_HH */
@@ -49,6 +49,7 @@ InterFrame Encoder::reencode_as_interframe( const VP8Raster & original_raster,
   }
 
   if_header.filter_type             = kf_header.filter_type;
+  if_header.log2_number_of_dct_partitions = log2_dct_partitions_;
   if_header.update_segmentation     = kf_header.update_segmentation;
   if_header.loop_filter_level       = kf_header.loop_filter_level;
   if_header.sharpness_level         = kf_header.sharpness_level;
@@ -79,12 +80,13 @@ InterFrame Encoder::reencode_as_interframe( const VP8Raster & original_raster,
   MVComponentCounts component_counts;
   TokenBranchCounts token_branch_counts;
 
-  ProbabilityTables temp_tables = decoder_state_.probability_tables;
+  ProbabilityTables temp_tables = decoder_state().probability_tables;
   temp_tables.update( if_header );
-  costs_.fill_mv_component_costs( temp_tables.motion_vector_probs );
+  workspace().costs.fill_mv_component_costs( temp_tables.motion_vector_probs );
 
-  original_raster.macroblocks_forall_ij(
-    [&] ( VP8Raster::ConstMacroblock original_mb, unsigned int mb_column, unsigned int mb_row )
+  encode_macroblocks( original_raster, token_branch_counts,
+    [&] ( VP8Raster::ConstMacroblock original_mb, unsigned int mb_column, unsigned int mb_row,
+          TokenBranchCounts & token_counts )
     {
       auto reconstructed_mb = reconstructed_raster.macroblock( mb_column, mb_row );
       auto temp_mb = temp_raster().macroblock( mb_column, mb_row );
@@ -107,13 +109,13 @@ InterFrame Encoder::reencode_as_interframe( const VP8Raster & original_raster,
       frame_mb.calculate_has_nonzero();
 
       if ( frame_mb.inter_coded() ) {
-        frame_mb.reconstruct_inter( quantizer, references_, reconstructed_mb );
+        frame_mb.reconstruct_inter( quantizer, references(), reconstructed_mb );
       }
       else {
         frame_mb.reconstruct_intra( quantizer, reconstructed_mb );
       }
 
-      frame_mb.accumulate_token_branches( token_branch_counts );
+      frame_mb.accumulate_token_branches( token_counts );
     }
   );
 
@@ -172,16 +174,16 @@ void Encoder::update_macroblock( const VP8Raster::Macroblock & original_mb,
   case ZEROMV:
   case NEWMV:
   {
-    const VP8Raster & reference = references_.at( frame_mb.header().reference() );
+    const VP8Raster & reference = references().at( frame_mb.header().reference() );
     best_mv = original_fmb.base_motion_vector();
 
-    reconstructed_mb.Y.inter_predict( best_mv, reference.Y() );
+    reconstructed_mb.Y.inter_predict( best_mv, reference.extended().Y );
     break;
   }
 
   case SPLITMV:
   {
-    const VP8Raster & reference = references_.at( frame_mb.header().reference() );
+    const VP8Raster & reference = references().at( frame_mb.header().reference() );
     best_mv = original_fmb.base_motion_vector();
     frame_mb.set_base_motion_vector( best_mv );
 
@@ -192,7 +194,7 @@ void Encoder::update_macroblock( const VP8Raster::Macroblock & original_mb,
         block.set_Y_without_Y2();
         block.set_prediction_mode( original_fmb.Y().at( column, row ).prediction_mode() );
 
-        reconstructed_mb.Y_sub_at( column, row ).inter_predict( block.motion_vector(), reference.Y() );
+        reconstructed_mb.Y_sub_at( column, row ).inter_predict( block.motion_vector(), reference.extended().Y );
       }
     );
 
@@ -212,7 +214,7 @@ void Encoder::update_macroblock( const VP8Raster::Macroblock & original_mb,
                              frame_mb, quantizer, FIRST_PASS );
 
     frame_mb.calculate_has_nonzero();
-    frame_mb.reconstruct_inter( quantizer, references_, reconstructed_mb );
+    frame_mb.reconstruct_inter( quantizer, references(), reconstructed_mb );
   }
   else {
     luma_mb_apply_intra_prediction( original_mb, reconstructed_mb, temp_mb,
@@ -245,6 +247,7 @@ InterFrame Encoder::update_residues( const VP8Raster & original_raster,
 
   if_header.update_segmentation      = of_header.update_segmentation;
   if_header.filter_type              = of_header.filter_type;
+  if_header.log2_number_of_dct_partitions = log2_dct_partitions_;
   if_header.loop_filter_level        = of_header.loop_filter_level;
   if_header.sharpness_level          = of_header.sharpness_level;
   if_header.mode_lf_adjustments      = of_header.mode_lf_adjustments;
@@ -277,8 +280,9 @@ InterFrame Encoder::update_residues( const VP8Raster & original_raster,
 
   TokenBranchCounts token_branch_counts;
 
-  original_raster.macroblocks_forall_ij(
-    [&] ( VP8Raster::ConstMacroblock original_mb, unsigned int mb_column, unsigned int mb_row )
+  encode_macroblocks( original_raster, token_branch_counts,
+    [&] ( VP8Raster::ConstMacroblock original_mb, unsigned int mb_column, unsigned int mb_row,
+          TokenBranchCounts & token_counts )
     {
       auto reconstructed_mb = reconstructed_raster.macroblock( mb_column, mb_row );
       auto temp_mb = temp_raster().macroblock( mb_column, mb_row );
@@ -289,7 +293,7 @@ InterFrame Encoder::update_residues( const VP8Raster & original_raster,
                          original_fmb, quantizer );
 
       frame_mb.calculate_has_nonzero();
-      frame_mb.accumulate_token_branches( token_branch_counts );
+      frame_mb.accumulate_token_branches( token_counts );
     }
   );
 
@@ -26,6 +26,8 @@
    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
+#include <future>
+
 #include "uncompressed_chunk.hh"
 #include "frame.hh"
 #include "bool_encoder.hh"
@@ -385,9 +387,10 @@ void Macroblock< FrameHeaderType, MacroblockheaderType >::serialize( BoolEncoder
 }
 
 template <class FrameHeaderType, class MacroblockType>
-vector< uint8_t > Frame< FrameHeaderType, MacroblockType >::serialize_first_partition( const ProbabilityTables & probability_tables ) const
+size_t Frame< FrameHeaderType, MacroblockType >::serialize_first_partition( const ProbabilityTables & probability_tables,
+                                                                            vector< uint8_t > & output ) const
 {
-  BoolEncoder encoder;
+  BoolEncoder encoder( output );
 
   /* encode frame header */
   encode( encoder, header() );
@@ -404,25 +407,93 @@ vector< uint8_t > Frame< FrameHeaderType, MacroblockType >::serialize_first_part
   return encoder.finish();
 }
 
+static void write_partition_length( const uint32_t length, uint8_t * const target )
+{
+  target[ 0 ] = length & 0xff;
+  target[ 1 ] = ( length & 0xff00 ) >> 8;
+  target[ 2 ] = ( length & 0xff0000 ) >> 16;
+}
+
 template <class FrameHeaderType, class MacroblockType>
-vector< vector< uint8_t > > Frame< FrameHeaderType, MacroblockType >::serialize_tokens( const ProbabilityTables & probability_tables ) const
-{
-  vector< BoolEncoder > dct_partitions( dct_partition_count() );
-
-  /* serialize every macroblock's tokens */
-  macroblock_headers_.get().forall_ij( [&]( const MacroblockType & macroblock,
-                                            const unsigned int column __attribute((unused)),
-                                            const unsigned int row )
-                                       {
-                                         macroblock.serialize_tokens( dct_partitions.at( row % dct_partition_count() ),
-                                                                      probability_tables ); } );
-
-  /* finish encoding and return the resulting octet sequences */
-  vector< vector< uint8_t > > ret;
-  for ( auto & x : dct_partitions ) {
-    ret.emplace_back( x.finish() );
+size_t Frame< FrameHeaderType, MacroblockType >::serialize_partition( const unsigned int partition,
+                                                                     const ProbabilityTables & probability_tables,
+                                                                     vector< uint8_t > & output ) const
+{
+  BoolEncoder encoder( output );
+
+  /* macroblock rows go to the partitions in turn */
+  for ( unsigned int row = partition; row < macroblock_height_; row += dct_partition_count() ) {
+    for ( unsigned int column = 0; column < macroblock_width_; column++ ) {
+      macroblock_headers_.get().at( column, row ).serialize_tokens( encoder, probability_tables );
+    }
+  }
+
+  return encoder.finish();
+}
+
+template <class FrameHeaderType, class MacroblockType>
+void Frame< FrameHeaderType, MacroblockType >::serialize_tokens( const ProbabilityTables & probability_tables,
+                                                                 vector< uint8_t > & output,
+                                                                 const unsigned int thread_count ) const
+{
+  const unsigned int partition_count = dct_partition_count();
+  const unsigned int worker_count = min( thread_count, partition_count );
+
+  /* the lengths of all partitions but the last, filled in as they are finished */
+  const size_t lengths_start = output.size();
+  output.resize( lengths_start + 3 * ( partition_count - 1 ) );
+
+  if ( worker_count <= 1 ) {
+    /* each partition is written in place after the one before it */
+    for ( unsigned int partition = 0; partition < partition_count; partition++ ) {
+      const size_t length = serialize_partition( partition, probability_tables, output );
+
+      if ( partition + 1 < partition_count ) {
+        write_partition_length( length, &output.at( lengths_start + 3 * partition ) );
+      }
+    }
+
+    return;
+  }
+
+  /* The partitions don't depend on each other. The first is written in
+     place by this thread, and the rest into buffers of their own by
+     `worker_count` workers (this thread among them); they are appended
+     once they are all done. */
+  vector< vector< uint8_t > > partitions( partition_count );
+  vector< future< void > > helpers;
+
+  auto worker = [&]( const unsigned int first_partition )
+    {
+      for ( unsigned int partition = first_partition; partition < partition_count; partition += worker_count ) {
+        if ( partition > 0 ) {
+          serialize_partition( partition, probability_tables, partitions.at( partition ) );
+        }
+      }
+    };
+
+  for ( unsigned int i = 1; i < worker_count; i++ ) {
+    helpers.emplace_back( async( launch::async, worker, i ) );
+  }
+
+  const size_t first_length = serialize_partition( 0, probability_tables, output );
+  worker( 0 );
+
+  for ( auto & helper : helpers ) {
+    helper.get();
+  }
+
+  write_partition_length( first_length, &output.at( lengths_start ) );
+
+  for ( unsigned int partition = 1; partition < partition_count; partition++ ) {
+    const vector< uint8_t > & tokens = partitions.at( partition );
+
+    if ( partition + 1 < partition_count ) {
+      write_partition_length( tokens.size(), &output.at( lengths_start + 3 * partition ) );
+    }
+
+    output.insert( output.end(), tokens.begin(), tokens.end() );
   }
-  return ret;
 }
 
 template <class FrameHeaderType, class MacroblockheaderType >
@@ -738,92 +809,78 @@ void Block< initial_block_type,
   }
 }
 
-static vector< uint8_t > make_frame( const bool key_frame,
-                                     const bool show_frame,
-                                     const bool experimental,
-                                     const bool reference_update,
-                                     const uint16_t width,
-                                     const uint16_t height,
-                                     const vector< uint8_t > & first_partition,
-                                     const vector< vector< uint8_t > > & dct_partitions )
+template <class FrameHeaderType, class MacroblockType>
+void Frame< FrameHeaderType, MacroblockType >::write_frame( const bool key_frame,
+                                                            const ProbabilityTables & frame_probability_tables,
+                                                            vector< uint8_t > & output,
+                                                            const unsigned int thread_count ) const
 {
-  if ( width > 16383 or height > 16383 ) {
-    throw Invalid( "VP8 frame dimensions too large." );
-  }
+  const bool experimental = false;
+  const bool reference_update = false;
 
-  if ( dct_partitions.empty() ) {
-    throw Invalid( "at least one DCT partition is required." );
+  if ( display_width_ > 16383 or display_height_ > 16383 ) {
+    throw Invalid( "VP8 frame dimensions too large." );
   }
 
-  vector< uint8_t > ret;
-
-  const uint32_t first_partition_length = first_partition.size();
+  output.clear();
 
-  /* frame tag */
-  ret.emplace_back( ( !key_frame ) | ( reference_update << 2 ) | ( experimental << 3 ) |
-                    ( show_frame << 4 ) | ( first_partition_length & 0x7 ) << 5 );
-  ret.emplace_back( ( first_partition_length & 0x7f8 ) >> 3 );
-  ret.emplace_back( ( first_partition_length & 0x7f800 ) >> 11 );
+  /* frame tag, with the length of the first partition filled in below */
+  output.emplace_back( ( !key_frame ) | ( reference_update << 2 ) | ( experimental << 3 ) |
+                       ( show_ << 4 ) );
+  output.emplace_back( 0 );
+  output.emplace_back( 0 );
 
   if ( key_frame ) {
     /* start code */
-    ret.emplace_back( 0x9d );
-    ret.emplace_back( 0x01 );
-    ret.emplace_back( 0x2a );
+    output.emplace_back( 0x9d );
+    output.emplace_back( 0x01 );
+    output.emplace_back( 0x2a );
 
     /* width */
-    ret.emplace_back( width & 0xff );
-    ret.emplace_back( (width & 0x3f00) >> 8 );
+    output.emplace_back( display_width_ & 0xff );
+    output.emplace_back( (display_width_ & 0x3f00) >> 8 );
 
     /* height */
-    ret.emplace_back( height & 0xff );
-    ret.emplace_back( (height & 0x3f00) >> 8 );
+    output.emplace_back( display_height_ & 0xff );
+    output.emplace_back( (display_height_ & 0x3f00) >> 8 );
   }
 
-  /* first partition */
-  ret.insert( ret.end(), first_partition.begin(), first_partition.end() );
+  const uint32_t first_partition_length = serialize_first_partition( frame_probability_tables, output );
 
-  /* DCT partition lengths */
-  for ( unsigned int i = 0; i < dct_partitions.size() - 1; i++ ) {
-    const uint32_t length = dct_partitions.at( i ).size();
-    ret.emplace_back( length & 0xff );
-    ret.emplace_back( (length & 0xff00) >> 8 );
-    ret.emplace_back( (length & 0xff0000) >> 16 );
-  }
-
-  for ( const auto & dct_partition : dct_partitions ) {
-    ret.insert( ret.end(), dct_partition.begin(), dct_partition.end() );
-  }
+  output.at( 0 ) |= ( first_partition_length & 0x7 ) << 5;
+  output.at( 1 ) = ( first_partition_length & 0x7f8 ) >> 3;
+  output.at( 2 ) = ( first_partition_length & 0x7f800 ) >> 11;
 
-  return ret;
+  serialize_tokens( frame_probability_tables, output, thread_count );
 }
 
 template <>
-vector<uint8_t> KeyFrame::serialize( const ProbabilityTables & probability_tables ) const
+void KeyFrame::serialize( const ProbabilityTables & probability_tables, vector< uint8_t > & output,
+                          const unsigned int thread_count ) const
 {
   ProbabilityTables frame_probability_tables( probability_tables );
   frame_probability_tables.coeff_prob_update( header() );
 
-  return make_frame( true,
-                     show_,
-                     false,
-                     false,
-                     display_width_, display_height_,
-                     serialize_first_partition( frame_probability_tables ),
-                     serialize_tokens( frame_probability_tables ) );
+  write_frame( true, frame_probability_tables, output, thread_count );
 }
 
 template <>
-vector<uint8_t> InterFrame::serialize( const ProbabilityTables & probability_tables ) const
+void InterFrame::serialize( const ProbabilityTables & probability_tables, vector< uint8_t > & output,
+                            const unsigned int thread_count ) const
 {
   ProbabilityTables frame_probability_tables( probability_tables );
   frame_probability_tables.update( header() );
 
-  return make_frame( false,
-                     show_,
-                     false,
-                     false,
-                     display_width_, display_height_,
-                     serialize_first_partition( frame_probability_tables ),
-                     serialize_tokens( frame_probability_tables ) );
+  write_frame( false, frame_probability_tables, output, thread_count );
 }
+
+template <class FrameHeaderType, class MacroblockType>
+vector< uint8_t > Frame< FrameHeaderType, MacroblockType >::serialize( const ProbabilityTables & probability_tables ) const
+{
+  vector< uint8_t > output;
+  serialize( probability_tables, output );
+  return output;
+}
+
+template vector< uint8_t > KeyFrame::serialize( const ProbabilityTables & probability_tables ) const;
+template vector< uint8_t > InterFrame::serialize( const ProbabilityTables & probability_tables ) const;
@@ -32,6 +32,16 @@
 
 using namespace std;
 
+/* Prediction along the edges of the subsampled frame reads pixels that the
+   estimate never reconstructs. The raster is recycled, so it is blanked
+   first to keep the estimate from depending on what it held before. */
+static void clear_estimate_raster( VP8Raster & raster )
+{
+  raster.Y().fill( 0 );
+  raster.U().fill( 0 );
+  raster.V().fill( 0 );
+}
+
 template<>
 size_t Encoder::estimate_size<KeyFrame>( const VP8Raster & raster, const size_t y_ac_qi )
 {
@@ -41,10 +51,10 @@ size_t Encoder::estimate_size<KeyFrame>( const VP8Raster & raster, const size_t
       return { column * WIDTH_SAMPLE_DIMENSION_FACTOR, row * HEIGHT_SAMPLE_DIMENSION_FACTOR };
     };
 
-  DecoderState decoder_state_copy = decoder_state_;
-  decoder_state_ = DecoderState( width(), height() );
+  const shared_ptr<State> saved_state = state_;
+  mutable_state().decoder_state = DecoderState( width(), height() );
 
-  KeyFrame & frame = subsampled_key_frame_;
+  KeyFrame & frame = workspace().subsampled_key_frame;
 
   QuantIndices quant_indices;
   quant_indices.y_ac_qi = y_ac_qi;
@@ -56,6 +66,7 @@ size_t Encoder::estimate_size<KeyFrame>( const VP8Raster & raster, const size_t
   MutableRasterHandle reconstructed_raster_handle { width(), height() };
 
   VP8Raster & reconstructed_raster = reconstructed_raster_handle.get();
+  clear_estimate_raster( reconstructed_raster );
 
   update_rd_multipliers( quantizer );
 
@@ -89,8 +100,9 @@ size_t Encoder::estimate_size<KeyFrame>( const VP8Raster & raster, const size_t
   optimize_prob_skip( frame );
   // optimize_probability_tables( frame, token_branch_counts );
 
-  size_t size = frame.serialize( decoder_state_.probability_tables ).size();
-  decoder_state_ = decoder_state_copy;
+  frame.serialize( decoder_state().probability_tables, workspace().bitstream );
+  size_t size = workspace().bitstream.size();
+  state_ = saved_state;
 
   return size * WIDTH_SAMPLE_DIMENSION_FACTOR * HEIGHT_SAMPLE_DIMENSION_FACTOR;
 }
@@ -104,9 +116,9 @@ size_t Encoder::estimate_size<InterFrame>( const VP8Raster & raster, const size_
       return make_pair( column * WIDTH_SAMPLE_DIMENSION_FACTOR, row * HEIGHT_SAMPLE_DIMENSION_FACTOR );
     };
 
-  InterFrame & frame = subsampled_inter_frame_;
+  InterFrame & frame = workspace().subsampled_inter_frame;
 
-  DecoderState decoder_state_copy = decoder_state_;
+  const shared_ptr<State> saved_state = state_;
 
   QuantIndices quant_indices;
   quant_indices.y_ac_qi = y_ac_qi;
@@ -121,6 +133,7 @@ size_t Encoder::estimate_size<InterFrame>( const VP8Raster & raster, const size_
   MVComponentCounts component_counts;
 
   VP8Raster & reconstructed_raster = reconstructed_raster_handle.get();
+  clear_estimate_raster( reconstructed_raster );
 
   update_rd_multipliers( quantizer );
 
@@ -152,7 +165,7 @@ size_t Encoder::estimate_size<InterFrame>( const VP8Raster & raster, const size_
       frame_mb.calculate_has_nonzero();
 
       if ( frame_mb.inter_coded() ) {
-        frame_mb.reconstruct_inter( quantizer, references_, reconstructed_mb );
+        frame_mb.reconstruct_inter( quantizer, references(), reconstructed_mb );
       }
       else {
         frame_mb.reconstruct_intra( quantizer, reconstructed_mb );
@@ -164,8 +177,9 @@ size_t Encoder::estimate_size<InterFrame>( const VP8Raster & raster, const size_
   optimize_prob_skip( frame );
   optimize_interframe_probs( frame );
 
-  size_t size = frame.serialize( decoder_state_.probability_tables ).size();
-  decoder_state_ = decoder_state_copy;
+  frame.serialize( decoder_state().probability_tables, workspace().bitstream );
+  size_t size = workspace().bitstream.size();
+  state_ = saved_state;
 
   return size * WIDTH_SAMPLE_DIMENSION_FACTOR * HEIGHT_SAMPLE_DIMENSION_FACTOR;
 }
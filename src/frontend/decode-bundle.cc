@@ -26,14 +26,23 @@
    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
+#include <getopt.h>
+
 #include <cstdio>
 #include <cstring>
 #include <iostream>
 #include <sstream>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
 
 #include "file_descriptor.hh"
 #include "optional.hh"
 #include "player.hh"
+#include "ivf_stream.hh"
+#include "uncompressed_chunk.hh"
 #include "yuv4mpeg.hh"
 
 using namespace std;
@@ -41,63 +50,394 @@ using namespace std;
 /*
    xc-decode-bundle: decodes a sequence of IVF files whose
    filenames are given on standard input,
-   to a YUV4MPEG video on standard output
+   to a YUV4MPEG video on standard output.
+   Each file is read as a stream, so it can be a pipe.
+
+   Each line is a filename. It can be followed by a tab and the
+   serialized decoder state the file starts from. With --jobs,
+   files that start from such a state or from a key frame are
+   decoded concurrently.
 */
 
-int main( int argc, char *argv[] )
+static void check_minihash( const string & filename, const uint32_t expected, const Decoder & decoder )
 {
-  try {
-    if ( argc > 2 ) {
-      cerr << "Usage: " << argv[ 0 ] << " [starting_state]" << endl;
-      return EXIT_FAILURE;
+  if ( not decoder.minihash_match( expected ) ) {
+    stringstream error;
+    error << hex << filename << ": hash mismatch. Expected " << expected
+          << " but decoder is in state " << decoder.minihash();
+    throw Invalid( error.str() );
+  }
+}
+
+/* the whole line is the filename, up to a tab if there is one */
+static bool read_line( string & filename, string & state_filename )
+{
+  getline( cin, filename );
+  if ( not cin.good() ) {
+    return false;
+  }
+
+  state_filename.clear();
+  const size_t separator = filename.find( '\t' );
+  if ( separator != string::npos ) {
+    state_filename = filename.substr( separator + 1 );
+    filename.resize( separator );
+  }
+
+  return true;
+}
+
+static void decode_sequentially( const string & starting_state )
+{
+  FileDescriptor stdout( STDOUT_FILENO );
+  unique_ptr<FramePlayer> player;
+
+  string filename, state_filename;
+  while ( read_line( filename, state_filename ) ) {
+    /* open file */
+    cerr << "Opening " << filename << "... ";
+    IVFStream ivf { filename };
+    cerr << "done.\n";
+
+    if ( not player and state_filename.empty() ) {
+      state_filename = starting_state;
     }
 
-    FileDescriptor stdout( STDOUT_FILENO );
-    unique_ptr<FramePlayer> player;
+    /* initialize player and output if necessary */
+    if ( not player ) {
+      cerr << "Initializing with size " << ivf.width() << "x" << ivf.height() << "\n";
+      if ( not state_filename.empty() ) {
+        player.reset( new FramePlayer { move( EncoderStateDeserializer::build<FramePlayer>( state_filename ) ) } );
+        assert(ivf.width() == player->width());
+        assert(ivf.height() == player->height());
+      } else {
+        player.reset( new FramePlayer { ivf.width(), ivf.height() } );
+      }
+
+      player->set_pipelining( true );
+
+      stdout.write( YUV4MPEGHeader( player->example_raster() ).to_string() );
+    } else if ( not state_filename.empty() ) {
+      Decoder state = EncoderStateDeserializer::build<Decoder>( state_filename );
+      player->set_decoder( state );
+    }
+
+    check_minihash( filename, ivf.expected_decoder_minihash(), player->current_decoder() );
+
+    /* decode file */
+    cerr << filename << " entering state: " << *player << "\n";
+    for ( unsigned int frame_no = 0; ivf.has_frame( frame_no ); frame_no++ ) {
+      ivf.release_before( frame_no );
+      Optional<RasterHandle> raster = ivf.has_frame( frame_no + 1 )
+        ? player->decode( ivf.frame( frame_no ), ivf.frame( frame_no + 1 ) )
+        : player->decode( ivf.frame( frame_no ) );
+      if ( raster.initialized() ) {
+        YUV4MPEGFrameWriter::write( raster.get(), stdout );
+      }
+    }
+    cerr << filename << " exiting state: " << *player << "\n";
+  }
+}
+
+/* one file of the bundle, decoded by one of the jobs */
+struct BundleEntry
+{
+  string filename;
+  string state_filename;
+
+  /* the decoder left behind by the previous file, if this one needs it */
+  shared_future<Decoder> previous_exit;
+
+  promise<Decoder> exit_promise {};
+  shared_future<Decoder> exit { exit_promise.get_future().share() };
+
+  /* the rest is guarded by the bundle's mutex */
+  bool opened { false };
+  uint32_t expected_minihash { 0 };
+  string output_header {};
+
+  /* the state it starts from, if not the previous file's exit state */
+  Optional<Decoder> entry_state {};
 
+  /* decoded but not yet written out */
+  deque<RasterHandle> frames {};
+  bool done { false };
+  exception_ptr error {};
+
+  BundleEntry( const string & s_filename, const string & s_state_filename,
+               const shared_future<Decoder> & s_previous_exit )
+    : filename( s_filename ), state_filename( s_state_filename ), previous_exit( s_previous_exit )
+  {}
+};
+
+class ParallelBundleDecoder
+{
+private:
+  string starting_state_;
+  unsigned int window_;
+
+  mutex mutex_ {};
+  condition_variable progress_ {};
+
+  /* entries that have been read but not yet written out */
+  deque<shared_ptr<BundleEntry>> entries_ {};
+  uint64_t read_count_ { 0 }, written_count_ { 0 };
+  bool input_done_ { false }, stopped_ { false };
+  bool header_written_ { false };
+
+  /* a job that gets this far ahead of the output waits for it to catch up */
+  static constexpr size_t max_buffered_frames = 8;
+
+  shared_ptr<BundleEntry> next_entry( void );
+  void decode( BundleEntry & entry );
+
+public:
+  ParallelBundleDecoder( const string & starting_state, const unsigned int jobs )
+    : starting_state_( starting_state ), window_( 2 * jobs )
+  {}
+
+  void run_job( void );
+  void write_output( void );
+
+  /* stop reading more files and buffering frames, so the jobs can finish */
+  void stop( void );
+};
+
+shared_ptr<BundleEntry> ParallelBundleDecoder::next_entry( void )
+{
+  unique_lock<mutex> lock { mutex_ };
+
+  /* don't get too far ahead of the output */
+  progress_.wait( lock, [&]() { return input_done_ or read_count_ < written_count_ + window_; } );
+
+  string filename, state_filename;
+  if ( input_done_ or not read_line( filename, state_filename ) ) {
+    input_done_ = true;
+    progress_.notify_all();
+    return nullptr;
+  }
+
+  if ( read_count_ == 0 and state_filename.empty() ) {
+    state_filename = starting_state_;
+  }
+
+  shared_future<Decoder> previous_exit;
+  if ( not entries_.empty() ) {
+    previous_exit = entries_.back()->exit;
+  }
+
+  entries_.push_back( make_shared<BundleEntry>( filename, state_filename, previous_exit ) );
+  read_count_++;
+  progress_.notify_all();
+
+  return entries_.back();
+}
+
+void ParallelBundleDecoder::decode( BundleEntry & entry )
+{
+  IVFStream ivf { entry.filename };
+
+  /* a file is independent of the one before it if it comes with
+     its starting state or begins with a key frame */
+  Optional<FramePlayer> player;
+  if ( not entry.state_filename.empty() ) {
+    player.initialize( EncoderStateDeserializer::build<FramePlayer>( entry.state_filename ) );
+  } else {
+    player.initialize( ivf.width(), ivf.height() );
+
+    const bool key_frame = ivf.has_frame( 0 )
+      and UncompressedChunk( ivf.frame( 0 ), ivf.width(), ivf.height(), false ).key_frame();
+
+    if ( not key_frame and entry.previous_exit.valid() ) {
+      Decoder previous = entry.previous_exit.get();
+      player.get().set_decoder( previous );
+    }
+  }
+
+  player.get().set_pipelining( true );
+
+  {
+    unique_lock<mutex> lock { mutex_ };
+    entry.opened = true;
+    entry.expected_minihash = ivf.expected_decoder_minihash();
+    entry.output_header = YUV4MPEGHeader( player.get().example_raster() ).to_string();
+
+    if ( not entry.state_filename.empty() or not entry.previous_exit.valid() ) {
+      entry.entry_state.initialize( player.get().current_decoder() );
+    }
+    progress_.notify_all();
+  }
+
+  for ( unsigned int frame_no = 0; ivf.has_frame( frame_no ); frame_no++ ) {
+    ivf.release_before( frame_no );
+    Optional<RasterHandle> raster = ivf.has_frame( frame_no + 1 )
+      ? player.get().decode( ivf.frame( frame_no ), ivf.frame( frame_no + 1 ) )
+      : player.get().decode( ivf.frame( frame_no ) );
+
+    if ( raster.initialized() ) {
+      unique_lock<mutex> lock { mutex_ };
+      progress_.wait( lock, [&]() { return stopped_ or entry.frames.size() < max_buffered_frames; } );
+      if ( stopped_ ) {
+        throw Invalid( "bundle output stopped" );
+      }
+      entry.frames.push_back( raster.get() );
+      progress_.notify_all();
+    }
+  }
+
+  entry.exit_promise.set_value( player.get().current_decoder() );
+}
+
+void ParallelBundleDecoder::run_job( void )
+{
+  while ( shared_ptr<BundleEntry> entry = next_entry() ) {
+    try {
+      decode( *entry );
+    } catch ( const exception & e ) {
+      unique_lock<mutex> lock { mutex_ };
+      entry->error = current_exception();
+      entry->exit_promise.set_exception( current_exception() );
+    }
+
+    unique_lock<mutex> lock { mutex_ };
+    entry->done = true;
+    progress_.notify_all();
+  }
+}
+
+void ParallelBundleDecoder::write_output( void )
+{
+  FileDescriptor stdout( STDOUT_FILENO );
+
+  while ( true ) {
+    unique_lock<mutex> lock { mutex_ };
+    progress_.wait( lock, [&]() { return input_done_ or not entries_.empty(); } );
+    if ( entries_.empty() ) {
+      break;
+    }
+
+    const shared_ptr<BundleEntry> entry = entries_.front();
+
+    progress_.wait( lock, [&]() { return entry->done or entry->opened; } );
+    if ( entry->error ) {
+      rethrow_exception( entry->error );
+    }
+
+    /* the entries before this one have all been written, so its
+       previous_exit is ready if it starts from there */
+    check_minihash( entry->filename, entry->expected_minihash,
+                    entry->entry_state.initialized() ? entry->entry_state.get()
+                                                     : entry->previous_exit.get() );
+
+    if ( not header_written_ ) {
+      stdout.write( entry->output_header );
+      header_written_ = true;
+    }
+
+    /* write its frames as they are decoded, making room for more */
+    size_t written = 0;
     while ( true ) {
-      /* read filename */
-      string filename;
-      getline( cin, filename );
-      if ( not cin.good() ) {
-        break;
+      progress_.wait( lock, [&]() { return entry->done or not entry->frames.empty(); } );
+      if ( entry->error ) {
+        rethrow_exception( entry->error );
       }
 
-      /* open file */
-      cerr << "Opening " << filename << "... ";
-      IVF ivf { filename };
-      cerr << "done (" << ivf.frame_count() << " frames).\n";
-
-      /* initialize player and output if necessary */
-      if ( not player ) {
-        cerr << "Initializing with size " << ivf.width() << "x" << ivf.height() << "\n";
-        if (argc > 1) {
-          player.reset( new FramePlayer { move( EncoderStateDeserializer::build<FramePlayer>(argv[1]) ) } );
-          assert(ivf.width() == player->width());
-          assert(ivf.height() == player->height());
-        } else {
-          player.reset( new FramePlayer { ivf.width(), ivf.height() } );
-        }
-
-        stdout.write( YUV4MPEGHeader( player->example_raster() ).to_string() );
+      if ( entry->frames.empty() ) {
+        break;
       }
 
-      if ( not player->current_decoder().minihash_match( ivf.expected_decoder_minihash() ) ) {
-        stringstream error;
-        error << hex << "Hash mismatch. Expected " << ivf.expected_decoder_minihash()
-              << " but decoder is in state " << player->current_decoder().minihash();
-        throw Invalid( error.str() );
+      const RasterHandle raster = entry->frames.front();
+      entry->frames.pop_front();
+      progress_.notify_all();
+      lock.unlock();
+
+      YUV4MPEGFrameWriter::write( raster, stdout );
+      written++;
+
+      lock.lock();
+    }
+
+    cerr << entry->filename << " done (" << written << " frames).\n";
+
+    entries_.pop_front();
+    written_count_++;
+    progress_.notify_all();
+  }
+}
+
+void ParallelBundleDecoder::stop( void )
+{
+  unique_lock<mutex> lock { mutex_ };
+  input_done_ = stopped_ = true;
+  progress_.notify_all();
+}
+
+void usage( const char * argv0 )
+{
+  cerr << "Usage: " << argv0 << " [-j|--jobs N] [starting_state]" << endl;
+}
+
+int main( int argc, char *argv[] )
+{
+  try {
+    unsigned int jobs = 1;
+
+    const option command_line_options[] = {
+      { "jobs", required_argument, nullptr, 'j' },
+      { 0, 0, 0, 0 }
+    };
+
+    while ( true ) {
+      const int opt = getopt_long( argc, argv, "j:", command_line_options, nullptr );
+
+      if ( opt == -1 ) {
+        break;
       }
 
-      /* decode file */
-      cerr << filename << " entering state: " << *player << "\n";
-      for ( unsigned int frame_no = 0; frame_no < ivf.frame_count(); frame_no++ ) {
-        Optional<RasterHandle> raster = player->decode( ivf.frame( frame_no ) );
-        if ( raster.initialized() ) {
-          YUV4MPEGFrameWriter::write( raster.get(), stdout );
-        }
+      switch ( opt ) {
+      case 'j':
+        jobs = max( 1ul, stoul( optarg ) );
+        break;
+
+      default:
+        usage( argv[ 0 ] );
+        return EXIT_FAILURE;
       }
-      cerr << filename << " exiting state: " << *player << "\n";
+    }
+
+    if ( argc - optind > 1 ) {
+      usage( argv[ 0 ] );
+      return EXIT_FAILURE;
+    }
+
+    const string starting_state = optind < argc ? argv[ optind ] : "";
+
+    if ( jobs == 1 ) {
+      decode_sequentially( starting_state );
+      return EXIT_SUCCESS;
+    }
+
+    ParallelBundleDecoder decoder { starting_state, jobs };
+
+    vector<thread> threads;
+    for ( unsigned int i = 0; i < jobs; i++ ) {
+      threads.emplace_back( [&]() { decoder.run_job(); } );
+    }
+
+    exception_ptr error;
+    try {
+      decoder.write_output();
+    } catch ( const exception & e ) {
+      error = current_exception();
+      decoder.stop();
+    }
+
+    for ( auto & t : threads ) {
+      t.join();
+    }
+
+    if ( error ) {
+      rethrow_exception( error );
     }
   } catch ( const exception & e ) {
     print_exception( argv[ 0 ], e );
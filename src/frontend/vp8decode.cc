@@ -49,9 +49,11 @@ int main( int argc, char *argv[] )
 
     Optional<FileDescriptor> y4m_fd;
     char *decoder_state = NULL;
+    unsigned int threads = 1;
+    unsigned int wait_ms = 0;
 
     while (true) {
-      const int opt = getopt(argc, argv, "s:o:");
+      const int opt = getopt(argc, argv, "s:o:j:w:");
 
       if (opt == -1) {
         break;
@@ -66,6 +68,14 @@ int main( int argc, char *argv[] )
           y4m_fd.initialize(fopen(optarg, "wb"));
           break;
 
+        case 'j':
+          threads = stoul(optarg);
+          break;
+
+        case 'w':
+          wait_ms = stoul(optarg);
+          break;
+
         default:
           return usage(argv[0]);
       }
@@ -76,8 +86,11 @@ int main( int argc, char *argv[] )
     }
 
     Player player = decoder_state == NULL
-      ? Player( argv[optind] )
-      : EncoderStateDeserializer::build<Player>(decoder_state, argv[optind]);
+      ? Player( argv[optind], wait_ms )
+      : EncoderStateDeserializer::build<Player>(decoder_state, argv[optind], wait_ms);
+
+    player.set_decode_threads(threads);
+    player.set_pipelining(true);
 
     while ( not player.eof() ) {
       RasterHandle raster = player.advance();
@@ -101,6 +114,8 @@ int main( int argc, char *argv[] )
 }
 
 int usage(char *argv0) {
-  cerr << "Usage: " << argv0 << " [-s decoder_state] [-o y4m_output] input_file" << endl;
+  cerr << "Usage: " << argv0 << " [-s decoder_state] [-o y4m_output] [-j threads] [-w wait_ms] input_file" << endl
+       << "  input_file may be - for standard input; -w keeps reading a file that is still" << endl
+       << "  being written until it has not grown for wait_ms milliseconds" << endl;
   return EXIT_FAILURE;
 }
@@ -36,6 +36,7 @@
 #include "modemv_data.hh"
 #include "frame.hh"
 #include "decoder.hh"
+#include "decoder_state.hh"
 #include "ivf.hh"
 
 using namespace std;
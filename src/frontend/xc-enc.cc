@@ -71,6 +71,10 @@ void usage_error( const string & program_name )
        << "                                         Each line specifies the target size"     << endl
        << "                                         in bytes for the corresponding frame."   << endl
        << " --two-pass                            Do the second encoding pass"               << endl
+       << " --simple-loopfilter                   Use the cheaper luma-only deblocking filter" << endl
+       << " -j <arg>, --threads=<arg>             Threads encoding each frame (default: 1)"  << endl
+       << " --dct-partitions=<arg>                Token partitions per frame: 1 (default),"  << endl
+       << "                                         2, 4 or 8"                               << endl
                                                                                              << endl
        << "Re-encode:"                                                                       << endl
        << " -r, --reencode                        Re-encode"                                 << endl
@@ -114,6 +118,9 @@ int main( int argc, char *argv[] )
     string frame_sizes_file = "";
     double ssim = 0.99;
     bool two_pass = false;
+    bool simple_loopfilter = false;
+    unsigned int threads = 1;
+    unsigned int dct_partitions = 1;
     bool re_encode_only = false;
     double kf_q_weight = 1.0;
     bool extra_frame_chunk = false;
@@ -140,11 +147,14 @@ int main( int argc, char *argv[] )
       { "quality",              required_argument, nullptr, 'q' },
       { "frame-sizes",          required_argument, nullptr, 'F' },
       { "no-wait",              no_argument,       nullptr, 'W' },
+      { "simple-loopfilter",    no_argument,       nullptr, 'L' },
+      { "threads",              required_argument, nullptr, 'j' },
+      { "dct-partitions",       required_argument, nullptr, 'P' },
       { 0, 0, 0, 0 }
     };
 
     while ( true ) {
-      const int opt = getopt_long( argc, argv, "o:s:i:O:I:2y:p:S:rw:eq:F:W", command_line_options, nullptr );
+      const int opt = getopt_long( argc, argv, "o:s:i:O:I:2y:p:S:rw:eq:F:Wj:", command_line_options, nullptr );
 
       if ( opt == -1 ) {
         break;
@@ -176,6 +186,18 @@ int main( int argc, char *argv[] )
         two_pass = true;
         break;
 
+      case 'L':
+        simple_loopfilter = true;
+        break;
+
+      case 'j':
+        threads = stoul( optarg );
+        break;
+
+      case 'P':
+        dct_partitions = stoul( optarg );
+        break;
+
       case 'y':
         y_ac_qi = stoul( optarg );
         encoder_mode = CONSTANT_QUANTIZER;
@@ -232,12 +254,8 @@ int main( int argc, char *argv[] )
     shared_ptr<FrameInput> input_reader;
 
     if ( input_format == "ivf" ) {
-      if ( input_file == "-" ) {
-        throw runtime_error( "not supported" );
-      }
-      else {
-        input_reader = make_shared<IVFReader>( input_file );
-      }
+      /* reads standard input for "-" */
+      input_reader = make_shared<IVFReader>( input_file );
     }
     else if ( input_format == "y4m" ) {
       if ( input_file == "-" ) {
@@ -313,6 +331,9 @@ int main( int argc, char *argv[] )
       Encoder encoder( EncoderStateDeserializer::build<Decoder>( input_state ),
                        two_pass, quality );
 
+      encoder.set_encode_threads( threads );
+      encoder.set_dct_partitions( dct_partitions );
+
       output.set_expected_decoder_entry_hash( encoder.export_decoder().get_hash().hash() );
 
       encoder.reencode( original_rasters, prediction_frames, kf_q_weight,
@@ -336,6 +357,10 @@ int main( int argc, char *argv[] )
         output.set_expected_decoder_entry_hash( encoder.export_decoder().get_hash().hash() );
       }
 
+      encoder.set_simple_loop_filter( simple_loopfilter );
+      encoder.set_encode_threads( threads );
+      encoder.set_dct_partitions( dct_partitions );
+
       ifstream frame_sizes_if;
 
       if ( encoder_mode == TARGET_FRAME_SIZE ) {
@@ -0,0 +1,93 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* Copyright 2013-2018 the Alfalfa authors
+                       and the Massachusetts Institute of Technology
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+      1. Redistributions of source code must retain the above copyright
+         notice, this list of conditions and the following disclaimer.
+
+      2. Redistributions in binary form must reproduce the above copyright
+         notice, this list of conditions and the following disclaimer in the
+         documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#include <iostream>
+#include <cstring>
+
+#include "ivf.hh"
+#include "ivf_index.hh"
+#include "decoder.hh"
+#include "uncompressed_chunk.hh"
+
+using namespace std;
+
+void usage_error( const string & program_name )
+{
+  cerr << "Usage: " << program_name << " [-m] <ivf>" << endl
+       << endl
+       << "Writes <ivf>.idx, an index of where each frame is and which are key frames." << endl
+       << " -m   also decode the file and record the decoder's minihash before each frame" << endl
+       << endl;
+}
+
+int main( int argc, char const *argv[] )
+{
+  if ( argc <= 0 ) {
+    abort();
+  }
+
+  const bool minihashes = argc == 3 and strcmp( argv[ 1 ], "-m" ) == 0;
+
+  if ( argc != ( minihashes ? 3 : 2 ) ) {
+    usage_error( argv[ 0 ] );
+    return EXIT_FAILURE;
+  }
+
+  try {
+    const string filename = argv[ argc - 1 ];
+    IVF ivf( filename );
+    IVFIndex index( ivf );
+
+    if ( minihashes ) {
+      if ( ivf.fourcc() != "VP80" ) {
+        throw Unsupported( "not a VP8 file" );
+      }
+
+      Decoder decoder( ivf.width(), ivf.height() );
+      bool decoding = false;
+
+      for ( uint32_t i = 0; i < ivf.frame_count(); i++ ) {
+        /* frames before the first key frame can't be decoded from scratch,
+           so they are left without a minihash */
+        decoding = decoding or index.key_frame( i );
+        if ( decoding ) {
+          index.set_decoder_minihash( i, decoder.minihash() );
+          decoder.parse_and_decode_frame( ivf.frame( i ) );
+        }
+      }
+    }
+
+    index.write( IVFIndex::sidecar_filename( filename ) );
+  }
+  catch ( const exception &  e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -114,13 +114,15 @@ void display_task( const VP8Raster & example_raster, bool fullscreen )
   }
 }
 
-void enqueue_frame( FramePlayer & player, const Chunk & frame )
+void enqueue_frame( FramePlayer & player, const Chunk & frame, const Chunk & next_frame = { nullptr, 0 } )
 {
   if ( frame.size() == 0 ) {
     return;
   }
 
-  const Optional<RasterHandle> raster = player.decode( frame );
+  const Optional<RasterHandle> raster = next_frame.size()
+    ? player.decode( frame, next_frame )
+    : player.decode( frame );
 
   async( launch::async,
     [&raster]()
@@ -190,6 +192,7 @@ int main( int argc, char *argv[] )
   /* construct FramePlayer */
   FramePlayer player( paranoid::stoul( argv[ optind + 1 ] ), paranoid::stoul( argv[ optind + 2 ] ) );
   player.set_error_concealment( true );
+  player.set_pipelining( true );
 
   /* construct display thread */
   thread( [&player, fullscreen]() { display_task( player.example_raster(), fullscreen ); } ).detach();
@@ -231,13 +234,20 @@ int main( int argc, char *argv[] )
         cerr << "got a packet for frame #" << packet.frame_no()
              << ", display previous frame(s)." << endl;
 
+        vector<string> partial_frames;
         for ( size_t i = next_frame_no; i < packet.frame_no(); i++ ) {
           if ( fragmented_frames.count( i ) == 0 ) continue;
 
-          enqueue_frame( player, fragmented_frames.at( i ).partial_frame() );
+          partial_frames.push_back( fragmented_frames.at( i ).partial_frame() );
           fragmented_frames.erase( i );
         }
 
+        /* each frame's successor can be parsed while it is reconstructed */
+        for ( size_t i = 0; i < partial_frames.size(); i++ ) {
+          enqueue_frame( player, partial_frames[ i ],
+                         i + 1 < partial_frames.size() ? Chunk( partial_frames[ i + 1 ] ) : Chunk( nullptr, 0 ) );
+        }
+
         next_frame_no = packet.frame_no();
         current_state = player.current_decoder().minihash();
       }
@@ -173,7 +173,7 @@ void usage( const char *argv0 )
 {
   cerr << "Usage: " << argv0
        << " [-m,--mode MODE] [-d, --device CAMERA] [-p, --pixfmt PIXEL_FORMAT]"
-       << " [-u,--update-rate RATE] [--log-mem-usage] HOST PORT CONNECTION_ID" << endl
+       << " [-u,--update-rate RATE] [--log-mem-usage] [--simple-loopfilter] HOST PORT CONNECTION_ID" << endl
        << endl
        << "Accepted MODEs are s1, s2 (default), conventional." << endl;
 }
@@ -204,6 +204,7 @@ int main( int argc, char *argv[] )
   size_t update_rate __attribute__((unused)) = 1;
   OperationMode operation_mode = OperationMode::S2;
   bool log_mem_usage = false;
+  bool simple_loopfilter = false;
 
   const option command_line_options[] = {
     { "mode",          required_argument, nullptr, 'm' },
@@ -211,6 +212,7 @@ int main( int argc, char *argv[] )
     { "pixfmt",        required_argument, nullptr, 'p' },
     { "update-rate",   required_argument, nullptr, 'u' },
     { "log-mem-usage", no_argument,       nullptr, 'M' },
+    { "simple-loopfilter", no_argument,   nullptr, 'L' },
     { 0, 0, 0, 0 }
   };
 
@@ -243,6 +245,10 @@ int main( int argc, char *argv[] )
       log_mem_usage = true;
       break;
 
+    case 'L':
+      simple_loopfilter = true;
+      break;
+
     default:
       usage( argv[ 0 ] );
       return EXIT_FAILURE;
@@ -286,6 +292,7 @@ int main( int argc, char *argv[] )
   /* construct the encoder */
   Encoder base_encoder { camera.display_width(), camera.display_height(),
                          false /* two-pass */, REALTIME_QUALITY };
+  base_encoder.set_simple_loop_filter( simple_loopfilter );
 
   const uint32_t initial_state = base_encoder.minihash();
 
@@ -0,0 +1,205 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* Copyright 2013-2018 the Alfalfa authors
+                       and the Massachusetts Institute of Technology
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+      1. Redistributions of source code must retain the above copyright
+         notice, this list of conditions and the following disclaimer.
+
+      2. Redistributions in binary form must reproduce the above copyright
+         notice, this list of conditions and the following disclaimer in the
+         documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+/* Checks the word-at-a-time BoolDecoder against the original bit-at-a-time
+   one (bits and validity must agree, including on truncated chunks). Given
+   a number of repetitions, it then reports how long each takes to decode
+   the same data; run as a test, it only does the comparison. */
+
+#include <random>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+
+#include "exception.hh"
+#include "bool_decoder.hh"
+#include "bool_encoder.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+/* the previous BoolDecoder, renormalizing one bit and loading one octet at a time */
+class ReferenceBoolDecoder
+{
+private:
+  Chunk chunk_;
+
+  uint32_t range_, value_;
+  char bit_count_;
+
+  bool valid_;
+  bool complete_chunk_;
+
+  void load_octet( void )
+  {
+    if ( chunk_.size() ) {
+      value_ |= chunk_.octet();
+      chunk_ = chunk_( 1 );
+    }
+    else if ( not complete_chunk_ ) {
+      valid_ = false;
+    }
+  }
+
+public:
+  ReferenceBoolDecoder( const Chunk & s_chunk, const bool complete_chunk = true )
+    : chunk_( s_chunk ),
+      range_( 255 ),
+      value_( 0 ),
+      bit_count_( 0 ),
+      valid_( true ),
+      complete_chunk_( complete_chunk )
+  {
+    load_octet();
+    value_ <<= 8;
+    load_octet();
+  }
+
+  bool get( const Probability probability = 128 )
+  {
+    const uint32_t split = 1 + (((range_ - 1) * probability) >> 8);
+    const uint32_t SPLIT = split << 8;
+    bool ret;
+
+    if ( value_ >= SPLIT ) { /* encoded a one */
+      ret = 1;
+      range_ -= split;
+      value_ -= SPLIT;
+    } else { /* encoded a zero */
+      ret = 0;
+      range_ = split;
+    }
+
+    while ( range_ < 128 ) {
+      value_ <<= 1;
+      range_ <<= 1;
+      if ( ++bit_count_ == 8 ) {
+        bit_count_ = 0;
+        load_octet();
+      }
+    }
+
+    return ret;
+  }
+
+  bool valid() const { return valid_; }
+};
+
+template <class DecoderType>
+static double time_decode( const vector< uint8_t > & encoded,
+                           const vector< pair< Probability, bool > > & bitlist,
+                           const unsigned int repetitions, unsigned int & checksum )
+{
+  const auto start = steady_clock::now();
+
+  for ( unsigned int i = 0; i < repetitions; i++ ) {
+    DecoderType decoder { Chunk( encoded ) };
+    for ( const auto & x : bitlist ) {
+      checksum += decoder.get( x.first );
+    }
+  }
+
+  return duration<double, nano>( steady_clock::now() - start ).count() / ( repetitions * bitlist.size() );
+}
+
+int main( int argc, char *argv[] )
+{
+  try {
+    if ( argc > 2 ) {
+      cerr << "Usage: " << argv[ 0 ] << " [REPETITIONS]" << endl;
+      return EXIT_FAILURE;
+    }
+
+    const unsigned int repetitions = argc == 2 ? stoul( argv[ 1 ] ) : 0;
+
+    /* uniform_int_distribution isn't defined for 8-bit types */
+    default_random_engine gen( 1 );
+    uniform_int_distribution< int > probs( 0, 255 );
+
+    /* skewed bits, as most tokens are coded with confident probabilities */
+    vector< pair< Probability, bool > > bitlist;
+    for ( unsigned int i = 0; i < 1000000; i++ ) {
+      const Probability probability = Probability( probs( gen ) );
+      bernoulli_distribution bit( 1.0 - probability / 256.0 );
+      bitlist.emplace_back( probability, bit( gen ) );
+    }
+
+    vector< uint8_t > encoded;
+    BoolEncoder encoder( encoded );
+    for ( const auto & x : bitlist ) {
+      encoder.put( x.second, x.first );
+    }
+    encoder.finish();
+
+    /* the two decoders have to agree on every bit and, for truncated
+       partitions, on when they stop being valid */
+    for ( const size_t length : { size_t( 0 ), size_t( 1 ), size_t( 2 ), size_t( 7 ), size_t( 9 ),
+                                  size_t( 4096 ), encoded.size() } ) {
+      for ( const bool complete : { true, false } ) {
+        const Chunk chunk( encoded.data(), length );
+        ReferenceBoolDecoder reference( chunk, complete );
+        BoolDecoder decoder( chunk, complete );
+
+        for ( size_t i = 0; i < min( bitlist.size(), 8 * length + 128 ); i++ ) {
+          if ( decoder.valid() != reference.valid() ) {
+            cerr << "validity mismatch after " << i << " bits of a " << length << "-byte chunk" << endl;
+            return EXIT_FAILURE;
+          }
+
+          const Probability probability = bitlist.at( i ).first;
+          if ( decoder.get( probability ) != reference.get( probability ) ) {
+            cerr << "bit " << i << " of a " << length << "-byte chunk differs" << endl;
+            return EXIT_FAILURE;
+          }
+        }
+      }
+    }
+
+    if ( repetitions == 0 ) {
+      return EXIT_SUCCESS;
+    }
+
+    unsigned int reference_checksum = 0, checksum = 0;
+    const double reference_ns = time_decode<ReferenceBoolDecoder>( encoded, bitlist, repetitions, reference_checksum );
+    const double ns = time_decode<BoolDecoder>( encoded, bitlist, repetitions, checksum );
+
+    if ( checksum != reference_checksum ) {
+      cerr << "decoded bits differ" << endl;
+      return EXIT_FAILURE;
+    }
+
+    cout << fixed << setprecision( 2 );
+    cout << "bit-at-a-time:  " << reference_ns << " ns/bool" << endl;
+    cout << "word-at-a-time: " << ns << " ns/bool (" << reference_ns / ns << "x)" << endl;
+  } catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
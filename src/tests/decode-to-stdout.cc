@@ -35,13 +35,17 @@ using namespace std;
 int main( int argc, char *argv[] )
 {
   try {
-    if ( argc != 2 ) {
-      cerr << "Usage: " << argv[ 0 ] << " FILENAME" << endl;
+    if ( argc != 2 and argc != 3 ) {
+      cerr << "Usage: " << argv[ 0 ] << " FILENAME [THREADS]" << endl;
       return EXIT_FAILURE;
     }
 
     Player player( argv[ 1 ] );
 
+    if ( argc == 3 ) {
+      player.set_decode_threads( stoul( argv[ 2 ] ) );
+    }
+
     while ( not player.eof() ) {
       RasterHandle raster = player.advance();
 
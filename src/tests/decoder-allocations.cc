@@ -0,0 +1,120 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* Copyright 2013-2018 the Alfalfa authors
+                       and the Massachusetts Institute of Technology
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+      1. Redistributions of source code must retain the above copyright
+         notice, this list of conditions and the following disclaimer.
+
+      2. Redistributions in binary form must reproduce the above copyright
+         notice, this list of conditions and the following disclaimer in the
+         documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#include <iostream>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+
+#include "decoder.hh"
+#include "encoder.hh"
+#include "exception.hh"
+
+using namespace std;
+
+/* count every heap allocation made while the decoder is being measured */
+
+static atomic<bool> counting { false };
+static atomic<size_t> allocations { 0 };
+
+void * operator new( size_t size )
+{
+  if ( counting ) {
+    allocations++;
+  }
+
+  void * ret = malloc( size ? size : 1 );
+  if ( not ret ) {
+    throw bad_alloc();
+  }
+  return ret;
+}
+
+void operator delete( void * ptr ) noexcept { free( ptr ); }
+void operator delete( void * ptr, size_t ) noexcept { free( ptr ); }
+
+/* a gradient with a square moving across it */
+static void draw( VP8Raster & raster, const unsigned int frame_no )
+{
+  raster.Y().forall_ij( [&] ( uint8_t & pixel, const unsigned int column, const unsigned int row ) {
+      const bool square = ( column - 3 * frame_no ) % 64 < 24 and row % 48 < 24;
+      pixel = square ? 235 : ( 2 * column + row + frame_no ) & 0x7f;
+    } );
+  raster.U().fill( 100 + frame_no );
+  raster.V().fill( 150 - frame_no );
+}
+
+int main( int argc, char *argv[] )
+{
+  try {
+    if ( argc != 1 ) {
+      cerr << "Usage: " << argv[ 0 ] << endl;
+      return EXIT_FAILURE;
+    }
+
+    const uint16_t width = 200, height = 120;
+    const unsigned int frame_count = 24, warmup_frames = 4;
+
+    /* encode a stream with a second key frame halfway through */
+    vector<vector<uint8_t>> frames;
+    Encoder encoder( width, height, false, REALTIME_QUALITY );
+    for ( unsigned int frame_no = 0; frame_no < frame_count; frame_no++ ) {
+      if ( frame_no == frame_count / 2 ) {
+        encoder = Encoder( width, height, false, REALTIME_QUALITY );
+      }
+
+      MutableRasterHandle raster { width, height };
+      draw( raster, frame_no );
+      frames.emplace_back( encoder.encode_with_quantizer( raster, 40 ) );
+    }
+
+    /* decode it, counting allocations once every pool has been filled */
+    Decoder decoder( width, height );
+    for ( unsigned int frame_no = 0; frame_no < frame_count; frame_no++ ) {
+      counting = frame_no >= warmup_frames;
+      decoder.parse_and_decode_frame( Chunk( frames.at( frame_no ) ) );
+      counting = false;
+    }
+
+    if ( decoder.get_hash() != encoder.export_decoder().get_hash() ) {
+      cerr << "decoder state does not match the encoder's" << endl;
+      return EXIT_FAILURE;
+    }
+
+    if ( allocations != 0 ) {
+      cerr << allocations << " allocations in " << frame_count - warmup_frames
+           << " frames after warm-up, expected none" << endl;
+      return EXIT_FAILURE;
+    }
+  } catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
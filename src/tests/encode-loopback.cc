@@ -41,13 +41,15 @@ using namespace std;
 vector< uint8_t > encode( const vector< pair< Probability, bool > > & bitlist )
 {
   /* encode the bits */
-  BoolEncoder encoder;
+  vector< uint8_t > output;
+  BoolEncoder encoder( output );
 
   for ( const auto & x : bitlist ) {
     encoder.put( x.second, x.first );
   }
 
-  return encoder.finish();
+  encoder.finish();
+  return output;
 }
 
 int main( int argc, char *argv[] )
@@ -89,7 +91,8 @@ int main( int argc, char *argv[] )
       for ( mbmode i = mbmode( 0 ); i < num_y_modes; i = mbmode( i + 1 ) ) {
         Tree< mbmode, num_y_modes, kf_y_mode_tree > test_mode = i;
 
-        BoolEncoder encoder;
+        vector< uint8_t > encoded_string;
+        BoolEncoder encoder( encoded_string );
 
         ProbabilityArray< num_y_modes > probabilities;
         for ( uint8_t j = 0; j < probabilities.size(); j++ ) {
@@ -98,7 +101,7 @@ int main( int argc, char *argv[] )
 
         encode( encoder, test_mode, probabilities );
 
-        const auto encoded_string = encoder.finish();
+        encoder.finish();
 
         BoolDecoder decoder( Chunk( &encoded_string.front(), encoded_string.size() ) );
 
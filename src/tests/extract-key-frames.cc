@@ -30,7 +30,7 @@
 #include <vector>
 
 #include "ivf.hh"
-#include "uncompressed_chunk.hh"
+#include "ivf_index.hh"
 
 using namespace std;
 
@@ -50,11 +50,12 @@ int main( int argc, char *argv[] )
 
     vector< uint32_t > key_frames;
 
-    /* count key frames */
+    /* count key frames, from the sidecar index if there is one */
+    const IVFIndex index = IVFIndex::open( argv[ 1 ], file );
+
     unsigned int num_key_frames = 0;
-    for ( uint32_t i = 0; i < file.frame_count(); i++ ) {
-      UncompressedChunk chunk( file.frame( i ), file.width(), file.height(), false );
-      if ( chunk.key_frame() ) {
+    for ( uint32_t i = 0; i < index.frame_count(); i++ ) {
+      if ( index.key_frame( i ) ) {
         num_key_frames++;
         key_frames.emplace_back( i );
       }
@@ -0,0 +1,195 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* Copyright 2013-2018 the Alfalfa authors
+                       and the Massachusetts Institute of Technology
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+      1. Redistributions of source code must retain the above copyright
+         notice, this list of conditions and the following disclaimer.
+
+      2. Redistributions in binary form must reproduce the above copyright
+         notice, this list of conditions and the following disclaimer in the
+         documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#include <iostream>
+#include <cstdlib>
+#include <cstdio>
+#include <vector>
+#include <fcntl.h>
+
+#include "player.hh"
+#include "encoder.hh"
+#include "ivf_writer.hh"
+#include "ivf_index.hh"
+#include "exception.hh"
+#include "file_descriptor.hh"
+
+using namespace std;
+
+static const string filename = "ivf-seek-test.ivf";
+static const uint16_t width = 160, height = 96;
+
+/* a square moving across a gradient, with key frames at 0 and key_frame */
+static void write_stream( const unsigned int frame_count, const unsigned int key_frame )
+{
+  IVFWriter writer { filename, "VP80", width, height, 1, 1 };
+  Encoder encoder( width, height, false, REALTIME_QUALITY );
+
+  for ( unsigned int frame_no = 0; frame_no < frame_count; frame_no++ ) {
+    if ( frame_no == key_frame ) {
+      encoder = Encoder( width, height, false, REALTIME_QUALITY );
+    }
+
+    MutableRasterHandle raster { width, height };
+    raster.get().Y().forall_ij( [&] ( uint8_t & pixel, const unsigned int column, const unsigned int row ) {
+        const bool square = ( column - 4 * frame_no ) % 64 < 24 and row % 48 < 24;
+        pixel = square ? 235 : ( 2 * column + row + frame_no ) & 0x7f;
+      } );
+    raster.get().U().fill( 100 + frame_no );
+    raster.get().V().fill( 150 - frame_no );
+
+    writer.append_frame( encoder.encode_with_quantizer( raster, 40 ) );
+  }
+}
+
+struct Expected
+{
+  size_t raster_hash;
+  uint32_t minihash;
+};
+
+static void check_frame( FilePlayer & player, const vector<Expected> & expected,
+                         const unsigned int frame_no, const string & how )
+{
+  const RasterHandle raster = player.advance();
+
+  if ( player.cur_frame_no() != frame_no
+       or raster.hash() != expected.at( frame_no ).raster_hash
+       or player.current_decoder().minihash() != expected.at( frame_no ).minihash ) {
+    throw runtime_error( how + " to frame " + to_string( frame_no ) + " decoded something else" );
+  }
+}
+
+int main( int argc, char *argv[] )
+{
+  try {
+    if ( argc != 1 ) {
+      cerr << "Usage: " << argv[ 0 ] << endl;
+      return EXIT_FAILURE;
+    }
+
+    const unsigned int frame_count = 24, key_frame = 12;
+    const string index_filename = IVFIndex::sidecar_filename( filename );
+
+    remove( index_filename.c_str() );
+    write_stream( frame_count, key_frame );
+
+    /* what each frame decodes to, and the state it leaves behind */
+    vector<Expected> expected;
+    Optional<Decoder> saved_state;
+    {
+      FilePlayer player( filename );
+      while ( not player.eof() ) {
+        const RasterHandle raster = player.advance();
+        expected.push_back( { raster.hash(), player.current_decoder().minihash() } );
+
+        if ( player.cur_frame_no() == 16 ) {
+          saved_state.initialize( player.current_decoder() );
+        }
+      }
+    }
+
+    /* forwards, backwards, across the second key frame and onto both */
+    {
+      FilePlayer player( filename );
+      for ( const unsigned int frame_no : { 5u, 20u, 3u, 13u, 12u, 23u, 0u, 11u } ) {
+        player.seek( frame_no );
+        check_frame( player, expected, frame_no, "seeking" );
+      }
+    }
+
+    /* only frames that were decoded get a minihash */
+    {
+      IVFIndex index { IVF( filename ) };
+      if ( index.has_minihashes() or index.decoder_minihash( 0 ).initialized() ) {
+        throw runtime_error( "fresh index has minihashes" );
+      }
+
+      Decoder decoder( width, height );
+      const IVF ivf( filename );
+      for ( uint32_t i = 0; i < frame_count; i++ ) {
+        index.set_decoder_minihash( i, decoder.minihash() );
+        decoder.parse_and_decode_frame( ivf.frame( i ) );
+      }
+
+      if ( not index.has_minihashes() or not index.key_frame( key_frame )
+           or index.decoder_minihash( 17 ).get_or( 0 ) != expected.at( 16 ).minihash ) {
+        throw runtime_error( "index minihashes were not recorded" );
+      }
+
+      index.write( index_filename );
+    }
+
+    /* from a saved state, which the sidecar's minihashes place after frame 16 */
+    {
+      FilePlayer player( filename );
+      player.seek( 20, saved_state.get() );
+      check_frame( player, expected, 20, "seeking from a saved state" );
+    }
+
+    /* the sidecar no longer matches once the file is rewritten shorter */
+    {
+      const IVF ivf( filename );
+      IVFWriter writer { filename + ".new", "VP80", width, height, 1, 1 };
+      for ( uint32_t i = 0; i < frame_count - 4; i++ ) {
+        writer.append_frame( ivf.frame( i ) );
+      }
+    }
+    SystemCall( "rename", rename( ( filename + ".new" ).c_str(), filename.c_str() ) );
+    {
+      const IVFIndex index = IVFIndex::open( filename, IVF( filename ) );
+      if ( index.frame_count() != frame_count - 4 or index.has_minihashes() ) {
+        throw runtime_error( "stale index was used" );
+      }
+
+      FilePlayer player( filename );
+      player.seek( 15 );
+      check_frame( player, expected, 15, "seeking past a stale index" );
+    }
+
+    /* nor is a sidecar that isn't an index at all */
+    {
+      FileDescriptor index_file { SystemCall( index_filename, ::open( index_filename.c_str(), O_WRONLY | O_TRUNC ) ) };
+      index_file.write( string( IVFIndex::header_len, 'x' ) );
+    }
+    {
+      const IVFIndex index = IVFIndex::open( filename, IVF( filename ) );
+      if ( index.frame_count() != frame_count - 4 ) {
+        throw runtime_error( "corrupt index was used" );
+      }
+    }
+
+    remove( index_filename.c_str() );
+    remove( filename.c_str() );
+  } catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
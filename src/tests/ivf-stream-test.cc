@@ -0,0 +1,191 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* Copyright 2013-2018 the Alfalfa authors
+                       and the Massachusetts Institute of Technology
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+      1. Redistributions of source code must retain the above copyright
+         notice, this list of conditions and the following disclaimer.
+
+      2. Redistributions in binary form must reproduce the above copyright
+         notice, this list of conditions and the following disclaimer in the
+         documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+/* Reads IVF files the ways that only a stream can: from a pipe, and
+   while another thread is still writing them. */
+
+#include <iostream>
+#include <cstdlib>
+#include <cstdio>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "player.hh"
+#include "encoder.hh"
+#include "ivf_writer.hh"
+#include "ivf_stream.hh"
+#include "file.hh"
+#include "exception.hh"
+#include "file_descriptor.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+static const string filename = "ivf-stream-test.ivf";
+static const uint16_t width = 160, height = 96;
+static const unsigned int frame_count = 8;
+
+static void write_stream()
+{
+  IVFWriter writer { filename, "VP80", width, height, 1, 1 };
+  Encoder encoder( width, height, false, REALTIME_QUALITY );
+
+  for ( unsigned int frame_no = 0; frame_no < frame_count; frame_no++ ) {
+    MutableRasterHandle raster { width, height };
+    raster.get().Y().forall_ij( [&] ( uint8_t & pixel, const unsigned int column, const unsigned int row ) {
+        pixel = ( column + 3 * row + 5 * frame_no ) & 0xff;
+      } );
+    raster.get().U().fill( 100 + frame_no );
+    raster.get().V().fill( 150 - frame_no );
+
+    writer.append_frame( encoder.encode_with_quantizer( raster, 40 ) );
+  }
+}
+
+/* the raster hash of every frame, decoded from the file itself */
+static vector<size_t> decode( FilePlayer && player )
+{
+  vector<size_t> hashes;
+  player.set_pipelining( true );
+
+  while ( not player.eof() ) {
+    hashes.push_back( player.advance().hash() );
+  }
+
+  return hashes;
+}
+
+/* writes the stream to fd in pieces, pausing between them */
+static void trickle( FileDescriptor && fd, const string & stream, const size_t piece )
+{
+  for ( size_t offset = 0; offset < stream.size(); offset += piece ) {
+    fd.write( stream.substr( offset, piece ) );
+    this_thread::sleep_for( milliseconds( 2 ) );
+  }
+}
+
+int main( int argc, char *argv[] )
+{
+  try {
+    if ( argc != 1 ) {
+      cerr << "Usage: " << argv[ 0 ] << endl;
+      return EXIT_FAILURE;
+    }
+
+    /* anything that blocks for good fails the test instead of hanging it */
+    alarm( 60 );
+
+    write_stream();
+    const string stream = File( filename ).chunk().to_string();
+    const vector<size_t> expected = decode( FilePlayer( filename ) );
+    if ( expected.size() != frame_count ) {
+      throw runtime_error( "stream has the wrong number of frames" );
+    }
+
+    const size_t first_frame_end = IVF::supported_header_len + IVF::frame_header_len
+      + Chunk( stream )( IVF::supported_header_len, 4 ).le32();
+
+    /* a frame is only available without waiting once all of it has arrived */
+    {
+      int fds[ 2 ];
+      SystemCall( "pipe", pipe( fds ) );
+      FileDescriptor write_end { fds[ 1 ] };
+
+      write_end.write( stream.substr( 0, IVF::supported_header_len ) );
+      IVFStream ivf { FileDescriptor( fds[ 0 ] ) };
+
+      if ( ivf.has_frame_now( 0 ) ) {
+        throw runtime_error( "frame available before any of it was written" );
+      }
+
+      write_end.write( stream.substr( IVF::supported_header_len, IVF::frame_header_len + 10 ) );
+      if ( ivf.has_frame_now( 0 ) ) {
+        throw runtime_error( "frame available before all of it was written" );
+      }
+
+      const size_t written = IVF::supported_header_len + IVF::frame_header_len + 10;
+      write_end.write( stream.substr( written, first_frame_end - written ) );
+      if ( not ivf.has_frame_now( 0 )
+           or ivf.frame( 0 ).to_string() != stream.substr( IVF::supported_header_len + IVF::frame_header_len,
+                                                           first_frame_end - IVF::supported_header_len
+                                                           - IVF::frame_header_len ) ) {
+        throw runtime_error( "written frame was not read" );
+      }
+    }
+
+    /* a pipe that delivers the file a little at a time */
+    {
+      const string fifo_name = filename + ".fifo";
+      remove( fifo_name.c_str() );
+      SystemCall( "mkfifo", mkfifo( fifo_name.c_str(), S_IRUSR | S_IWUSR ) );
+
+      thread writer( [&]() {
+          trickle( FileDescriptor( SystemCall( fifo_name, open( fifo_name.c_str(), O_WRONLY ) ) ),
+                   stream, 1000 );
+        } );
+
+      const vector<size_t> hashes = decode( FilePlayer( fifo_name ) );
+      writer.join();
+      remove( fifo_name.c_str() );
+
+      if ( hashes != expected ) {
+        throw runtime_error( "decoding from a pipe gave different frames" );
+      }
+    }
+
+    /* a file that is still being written, followed until it stops growing */
+    {
+      const string growing_name = filename + ".growing";
+      FileDescriptor growing { SystemCall( growing_name, open( growing_name.c_str(),
+                                                               O_WRONLY | O_CREAT | O_TRUNC,
+                                                               S_IRUSR | S_IWUSR ) ) };
+      growing.write( stream.substr( 0, IVF::supported_header_len ) );
+
+      thread writer( [&]() { trickle( move( growing ), stream.substr( IVF::supported_header_len ), 1000 ); } );
+
+      const vector<size_t> hashes = decode( FilePlayer( growing_name, 1000 ) );
+      writer.join();
+      remove( growing_name.c_str() );
+
+      if ( hashes != expected ) {
+        throw runtime_error( "decoding a growing file gave different frames" );
+      }
+    }
+
+    remove( filename.c_str() );
+  } catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
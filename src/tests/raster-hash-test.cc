@@ -0,0 +1,90 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* Copyright 2013-2018 the Alfalfa authors
+                       and the Massachusetts Institute of Technology
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+      1. Redistributions of source code must retain the above copyright
+         notice, this list of conditions and the following disclaimer.
+
+      2. Redistributions in binary form must reproduce the above copyright
+         notice, this list of conditions and the following disclaimer in the
+         documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#include <iostream>
+#include <cstdlib>
+
+#include "raster_handle.hh"
+#include "exception.hh"
+
+using namespace std;
+
+/* raster hashes end up in IVF headers, indexes and serialized decoder
+   states (as minihashes), so they must never change by accident */
+
+static const size_t expected_hash = 0xcd781159ed5e4d7b;
+
+/* a small raster with a different pattern in each plane, two strips high */
+static MutableRasterHandle make_raster( void )
+{
+  MutableRasterHandle raster { 40, 24 };
+
+  raster.get().Y().forall_ij( [] ( uint8_t & pixel, const unsigned int column, const unsigned int row ) {
+      pixel = 3 * column + 5 * row;
+    } );
+  raster.get().U().forall_ij( [] ( uint8_t & pixel, const unsigned int column, const unsigned int row ) {
+      pixel = column + 7 * row;
+    } );
+  raster.get().V().forall_ij( [] ( uint8_t & pixel, const unsigned int column, const unsigned int row ) {
+      pixel = 255 - column - row;
+    } );
+
+  raster.get().reset_cache();
+  return raster;
+}
+
+int main( int argc, char *argv[] )
+{
+  try {
+    if ( argc != 1 ) {
+      cerr << "Usage: " << argv[ 0 ] << endl;
+      return EXIT_FAILURE;
+    }
+
+    /* hashed all at once */
+    const RasterHandle whole { make_raster() };
+
+    /* hashed a strip at a time, as the decoder does */
+    MutableRasterHandle strips_raster = make_raster();
+    for ( unsigned int strip = 0; strip < strips_raster.get().hash_strip_count(); strip++ ) {
+      strips_raster.get().hash_strip( strip );
+    }
+    const RasterHandle strips { move( strips_raster ) };
+
+    if ( whole.hash() != expected_hash or strips.hash() != expected_hash ) {
+      cerr << hex << "raster hash is " << whole.hash() << " (" << strips.hash()
+           << " a strip at a time), expected " << expected_hash << endl;
+      return EXIT_FAILURE;
+    }
+  } catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
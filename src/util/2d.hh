@@ -80,10 +80,19 @@ public:
 
     storage_.reserve( width * height );
 
+    reset( Fargs... );
+  }
+
+  /* destroy and re-construct every member in place, without reallocating */
+  template< typename... Targs >
+  void reset( Targs&&... Fargs )
+  {
+    storage_.clear();
+
     /* we want to construct each member separately */
-    for ( unsigned int row = 0; row < height; row++ ) {
-      for ( unsigned int column = 0; column < width; column++ ) {
-        const Context c( column, row, width, height, *this );
+    for ( unsigned int row = 0; row < height_; row++ ) {
+      for ( unsigned int column = 0; column < width_; column++ ) {
+        const Context c( column, row, width_, height_, *this );
         storage_.emplace_back( c, Fargs... );
       }
     }
@@ -233,6 +242,9 @@ public:
   template <class lambda>
   void forall_ij( const lambda & f ) const { storage_->forall_ij( f ); }
 
+  template <typename... Targs>
+  void reset( Targs&&... Fargs ) { storage_->reset( std::forward<Targs>( Fargs )... ); }
+
   void fill( const T & value )
   {
     forall( [&] ( T & x ) { x = value; } );
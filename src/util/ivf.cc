@@ -44,39 +44,61 @@ try :
     time_scale_( header_( 20, 4 ).le32() ),
     frame_count_( header_( 24, 4 ).le32() ),
     expected_decoder_minihash_( header_( 28, 4 ).le32() ),
-    frame_index_()
+    index_mutex_(),
+    frame_index_(),
+    next_frame_position_( supported_header_len )
       {
-        if ( header_( 0, 4 ).to_string() != "DKIF" ) {
-          throw Invalid( "missing IVF file header" );
-        }
+        check_header( header_ );
+      }
+catch ( const out_of_range & e )
+  {
+    throw Invalid( "IVF file truncated" );
+  }
+
+void IVF::check_header( const Chunk & header )
+{
+  if ( header( 0, 4 ).to_string() != "DKIF" ) {
+    throw Invalid( "missing IVF file header" );
+  }
+
+  if ( header( 4, 2 ).le16() != 0 ) {
+    throw Unsupported( "not an IVF version 0 file" );
+  }
+
+  if ( header( 6, 2 ).le16() != supported_header_len ) {
+    throw Unsupported( "unsupported IVF header length" );
+  }
+}
 
-        if ( header_( 4, 2 ).le16() != 0 ) {
-          throw Unsupported( "not an IVF version 0 file" );
-        }
+pair<uint64_t, uint32_t> IVF::index_entry( const uint32_t index ) const
+{
+  if ( index >= frame_count_ ) {
+    throw out_of_range( "IVF frame index out of range" );
+  }
 
-        if ( header_( 6, 2 ).le16() != supported_header_len ) {
-          throw Unsupported( "unsupported IVF header length" );
-        }
+  unique_lock<mutex> lock { index_mutex_ };
 
-        /* build the index */
-        frame_index_.reserve( frame_count_ );
+  try {
+    while ( frame_index_.size() <= index ) {
+      const uint32_t frame_len = file_( next_frame_position_, frame_header_len ).le32();
 
-        uint64_t position = supported_header_len;
-        for ( uint32_t i = 0; i < frame_count_; i++ ) {
-          Chunk frame_header = file_( position, frame_header_len );
-          const uint32_t frame_len = frame_header.le32();
+      frame_index_.emplace_back( next_frame_position_ + frame_header_len, frame_len );
+      next_frame_position_ += frame_header_len + frame_len;
+    }
 
-          frame_index_.emplace_back( position + frame_header_len, frame_len );
-          position += frame_header_len + frame_len;
-        }
-      }
-catch ( const out_of_range & e )
-  {
+    return frame_index_[ index ];
+  } catch ( const out_of_range & e ) {
     throw Invalid( "IVF file truncated" );
   }
+}
 
 Chunk IVF::frame( const uint32_t & index ) const
 {
-  const auto & entry = frame_index_.at( index );
-  return file_( entry.first, entry.second );
+  const auto entry = index_entry( index );
+
+  try {
+    return file_( entry.first, entry.second );
+  } catch ( const out_of_range & e ) {
+    throw Invalid( "IVF file truncated" );
+  }
 }
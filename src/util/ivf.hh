@@ -32,6 +32,7 @@
 #include <string>
 #include <cstdint>
 #include <vector>
+#include <mutex>
 
 #include "file.hh"
 
@@ -46,7 +47,13 @@ private:
   uint32_t frame_rate_, time_scale_, frame_count_;
   uint32_t expected_decoder_minihash_;
 
-  std::vector< std::pair<uint64_t, uint32_t> > frame_index_;
+  /* frames are indexed as they are asked for; the lock lets frame()
+     be called from several threads at once */
+  mutable std::mutex index_mutex_;
+  mutable std::vector< std::pair<uint64_t, uint32_t> > frame_index_;
+  mutable uint64_t next_frame_position_;
+
+  std::pair<uint64_t, uint32_t> index_entry( const uint32_t index ) const;
 
 public:
   static constexpr int supported_header_len = 32;
@@ -54,6 +61,9 @@ public:
 
   IVF( const std::string & filename );
 
+  /* throws unless the chunk starts with a supported IVF header */
+  static void check_header( const Chunk & header );
+
   const std::string & fourcc( void ) const { return fourcc_; }
   uint16_t width( void ) const { return width_; }
   uint16_t height( void ) const { return height_; }
@@ -63,6 +73,9 @@ public:
 
   Chunk frame( const uint32_t & index ) const;
 
+  /* where the frame's data starts in the file */
+  uint64_t frame_offset( const uint32_t & index ) const { return index_entry( index ).first; }
+
   size_t size() const { return file_.size(); }
 
   uint32_t expected_decoder_minihash() const { return expected_decoder_minihash_; }
@@ -0,0 +1,193 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* Copyright 2013-2018 the Alfalfa authors
+                       and the Massachusetts Institute of Technology
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+      1. Redistributions of source code must retain the above copyright
+         notice, this list of conditions and the following disclaimer.
+
+      2. Redistributions in binary form must reproduce the above copyright
+         notice, this list of conditions and the following disclaimer in the
+         documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <endian.h>
+
+#include <stdexcept>
+
+#include "ivf_index.hh"
+#include "exception.hh"
+
+using namespace std;
+
+/* header:  "AIDX", version (16 bits), header length (16 bits),
+            IVF file size (64 bits), frame count (32 bits), flags (32 bits), reserved
+   entries: frame data offset (64 bits), size (32 bits), flags (32 bits),
+            decoder minihash (32 bits, only meaningful with its flag set) */
+
+static constexpr uint32_t minihashes_flag = 1;
+static constexpr uint32_t key_frame_flag = 1;
+static constexpr uint32_t minihash_flag = 2;
+
+static void put_le32( string & dest, const size_t offset, const uint32_t val )
+{
+  const uint32_t swizzled = htole32( val );
+  dest.replace( offset, sizeof( swizzled ), reinterpret_cast<const char *>( &swizzled ), sizeof( swizzled ) );
+}
+
+static void put_le64( string & dest, const size_t offset, const uint64_t val )
+{
+  const uint64_t swizzled = htole64( val );
+  dest.replace( offset, sizeof( swizzled ), reinterpret_cast<const char *>( &swizzled ), sizeof( swizzled ) );
+}
+
+IVFIndex::IVFIndex( const IVF & ivf )
+  : built_( header_len + entry_len * ivf.frame_count(), 0 ),
+    ivf_size_( ivf.size() ),
+    frame_count_( ivf.frame_count() ),
+    has_minihashes_( false )
+{
+  built_.replace( 0, 4, "AIDX" );
+  built_[ 6 ] = header_len;
+  put_le64( built_, 8, ivf_size_ );
+  put_le32( built_, 16, frame_count_ );
+
+  for ( uint32_t i = 0; i < frame_count_; i++ ) {
+    const Chunk frame = ivf.frame( i );
+    const size_t entry_offset = header_len + entry_len * i;
+
+    put_le64( built_, entry_offset, ivf.frame_offset( i ) );
+    put_le32( built_, entry_offset + 8, frame.size() );
+
+    /* the low bit of a VP8 frame tag is clear for key frames */
+    if ( frame.size() > 0 and not frame.bits( 0, 1 ) ) {
+      put_le32( built_, entry_offset + 12, key_frame_flag );
+    }
+  }
+}
+
+IVFIndex::IVFIndex( const string & index_filename )
+try :
+  file_( File( index_filename ) ),
+    ivf_size_( file_.get()( 8, 8 ).le64() ),
+    frame_count_( file_.get()( 16, 4 ).le32() ),
+    has_minihashes_( file_.get()( 20, 4 ).le32() & minihashes_flag )
+      {
+        const Chunk header = file_.get()( 0, header_len );
+
+        if ( header( 0, 4 ).to_string() != "AIDX" ) {
+          throw Invalid( "missing IVF index header" );
+        }
+
+        if ( header( 4, 2 ).le16() != 0 or header( 6, 2 ).le16() != header_len ) {
+          throw Unsupported( "unsupported IVF index version" );
+        }
+
+        if ( file_.get().size() != header_len + uint64_t( entry_len ) * frame_count_ ) {
+          throw Invalid( "IVF index truncated" );
+        }
+      }
+catch ( const out_of_range & e )
+  {
+    throw Invalid( "IVF index truncated" );
+  }
+
+IVFIndex IVFIndex::open( const string & ivf_filename, const IVF & ivf )
+{
+  const string index_filename = sidecar_filename( ivf_filename );
+
+  if ( access( index_filename.c_str(), R_OK ) == 0 ) {
+    try {
+      IVFIndex index { index_filename };
+      if ( index.ivf_size() == ivf.size() and index.frame_count() == ivf.frame_count() ) {
+        return index;
+      }
+    } catch ( const exception & e ) {
+      /* fall back to indexing the file again */
+    }
+  }
+
+  return IVFIndex( ivf );
+}
+
+Chunk IVFIndex::entries( void ) const
+{
+  return file_.initialized() ? file_.get().chunk() : Chunk( built_ );
+}
+
+Chunk IVFIndex::entry( const uint32_t index ) const
+{
+  if ( index >= frame_count_ ) {
+    throw out_of_range( "IVF index entry out of range" );
+  }
+
+  return entries()( header_len + entry_len * index, entry_len );
+}
+
+void IVFIndex::set_decoder_minihash( const uint32_t index, const uint32_t minihash )
+{
+  if ( file_.initialized() ) {
+    throw LogicError();
+  }
+
+  if ( index >= frame_count_ ) {
+    throw out_of_range( "IVF index entry out of range" );
+  }
+
+  has_minihashes_ = true;
+  put_le32( built_, 20, minihashes_flag );
+
+  const size_t entry_offset = header_len + entry_len * index;
+  put_le32( built_, entry_offset + 12, Chunk( built_ )( entry_offset + 12, 4 ).le32() | minihash_flag );
+  put_le32( built_, entry_offset + 16, minihash );
+}
+
+bool IVFIndex::key_frame( const uint32_t index ) const
+{
+  return entry( index )( 12, 4 ).le32() & key_frame_flag;
+}
+
+Optional<uint32_t> IVFIndex::decoder_minihash( const uint32_t index ) const
+{
+  const Chunk this_entry = entry( index );
+  return make_optional<uint32_t>( this_entry( 12, 4 ).le32() & minihash_flag, this_entry( 16, 4 ).le32() );
+}
+
+void IVFIndex::write( const string & index_filename ) const
+{
+  FileDescriptor fd { SystemCall( index_filename,
+                                  ::open( index_filename.c_str(),
+                                          O_WRONLY | O_CREAT | O_TRUNC,
+                                          S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH ) ) };
+  fd.write( entries() );
+}
+
+Optional<uint32_t> IVFIndex::key_frame_before( const uint32_t index ) const
+{
+  for ( uint32_t i = min( index + 1, frame_count_ ); i > 0; i-- ) {
+    if ( key_frame( i - 1 ) ) {
+      return make_optional( true, i - 1 );
+    }
+  }
+
+  return {};
+}
@@ -0,0 +1,90 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* Copyright 2013-2018 the Alfalfa authors
+                       and the Massachusetts Institute of Technology
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+      1. Redistributions of source code must retain the above copyright
+         notice, this list of conditions and the following disclaimer.
+
+      2. Redistributions in binary form must reproduce the above copyright
+         notice, this list of conditions and the following disclaimer in the
+         documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#ifndef IVF_INDEX_HH
+#define IVF_INDEX_HH
+
+/* where each frame of an IVF file is, and which are key frames,
+   kept in a sidecar file so it only has to be worked out once */
+
+#include <string>
+#include <cstdint>
+
+#include "ivf.hh"
+#include "file.hh"
+#include "optional.hh"
+
+class IVFIndex
+{
+private:
+  Optional<File> file_ {};
+  std::string built_ {};
+
+  uint64_t ivf_size_;
+  uint32_t frame_count_;
+  bool has_minihashes_;
+
+  Chunk entries( void ) const;
+  Chunk entry( const uint32_t index ) const;
+
+public:
+  static constexpr int header_len = 32;
+  static constexpr int entry_len = 20;
+
+  /* walks the frame headers of the file */
+  IVFIndex( const IVF & ivf );
+
+  /* maps an index that was written out earlier */
+  IVFIndex( const std::string & index_filename );
+
+  static std::string sidecar_filename( const std::string & ivf_filename ) { return ivf_filename + ".idx"; }
+
+  /* the sidecar index, if there is one and it matches the file; otherwise a new index */
+  static IVFIndex open( const std::string & ivf_filename, const IVF & ivf );
+
+  /* the minihash of the decoder's state before the frame is decoded, for built indexes */
+  void set_decoder_minihash( const uint32_t index, const uint32_t minihash );
+
+  void write( const std::string & index_filename ) const;
+
+  uint64_t ivf_size( void ) const { return ivf_size_; }
+  uint32_t frame_count( void ) const { return frame_count_; }
+  bool has_minihashes( void ) const { return has_minihashes_; }
+
+  uint64_t offset( const uint32_t index ) const { return entry( index )( 0, 8 ).le64(); }
+  uint32_t size( const uint32_t index ) const { return entry( index )( 8, 4 ).le32(); }
+  bool key_frame( const uint32_t index ) const;
+
+  /* none for frames that weren't decoded, such as those before the first key frame */
+  Optional<uint32_t> decoder_minihash( const uint32_t index ) const;
+
+  /* the last key frame at or before this frame */
+  Optional<uint32_t> key_frame_before( const uint32_t index ) const;
+};
+
+#endif /* IVF_INDEX_HH */
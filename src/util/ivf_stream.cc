@@ -0,0 +1,211 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* Copyright 2013-2018 the Alfalfa authors
+                       and the Massachusetts Institute of Technology
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+      1. Redistributions of source code must retain the above copyright
+         notice, this list of conditions and the following disclaimer.
+
+      2. Redistributions in binary form must reproduce the above copyright
+         notice, this list of conditions and the following disclaimer in the
+         documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include <stdexcept>
+#include <chrono>
+#include <thread>
+
+#include "ivf_stream.hh"
+#include "ivf.hh"
+#include "exception.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+static FileDescriptor open_input( const string & filename )
+{
+  if ( filename == "-" ) {
+    return FileDescriptor( STDIN_FILENO );
+  }
+
+  return FileDescriptor( SystemCall( filename, open( filename.c_str(), O_RDONLY ) ) );
+}
+
+IVFStream::IVFStream( const string & filename, const unsigned int wait_ms )
+  : IVFStream( open_input( filename ), wait_ms )
+{}
+
+IVFStream::IVFStream( FileDescriptor && fd, const unsigned int wait_ms )
+  : fd_( move( fd ) ),
+    wait_ms_( wait_ms )
+{
+  if ( not read_exactly( header_, IVF::supported_header_len ) ) {
+    throw Invalid( "missing IVF file header" );
+  }
+
+  const Chunk header { header_ };
+  IVF::check_header( header );
+
+  fourcc_ = header( 8, 4 ).to_string();
+  width_ = header( 12, 2 ).le16();
+  height_ = header( 14, 2 ).le16();
+  frame_rate_ = header( 16, 4 ).le32();
+  time_scale_ = header( 20, 4 ).le32();
+  frame_count_ = header( 24, 4 ).le32();
+  expected_decoder_minihash_ = header( 28, 4 ).le32();
+}
+
+/* returns false if the stream ended before any of it could be read */
+bool IVFStream::read_exactly( string & output, const size_t length )
+{
+  output.resize( length );
+
+  size_t filled = 0;
+  auto last_read = steady_clock::now();
+
+  while ( filled < length ) {
+    const ssize_t bytes_read = SystemCall( "read", ::read( fd_.fd_num(), &output[ filled ],
+                                                           length - filled ) );
+    if ( bytes_read > 0 ) {
+      filled += bytes_read;
+      last_read = steady_clock::now();
+      continue;
+    }
+
+    /* end of file, but the file may still be growing */
+    if ( steady_clock::now() - last_read < milliseconds( wait_ms_ ) ) {
+      this_thread::sleep_for( milliseconds( 10 ) );
+      continue;
+    }
+
+    if ( filled == 0 ) {
+      return false;
+    }
+
+    throw Invalid( "IVF file truncated" );
+  }
+
+  return true;
+}
+
+bool IVFStream::read_frame( void )
+{
+  if ( end_of_stream_ ) {
+    return false;
+  }
+
+  if ( next_frame_header_.empty() and not read_exactly( next_frame_header_, IVF::frame_header_len ) ) {
+    next_frame_header_.clear();
+    end_of_stream_ = true;
+    return false;
+  }
+
+  string frame;
+  if ( not spare_.empty() ) {
+    frame = move( spare_.back() );
+    spare_.pop_back();
+  }
+
+  if ( not read_exactly( frame, Chunk( next_frame_header_ ).le32() ) ) {
+    throw Invalid( "IVF file truncated" );
+  }
+
+  next_frame_header_.clear();
+  buffered_.push_back( move( frame ) );
+  return true;
+}
+
+bool IVFStream::has_frame( const uint32_t index )
+{
+  while ( first_buffered_ + buffered_.size() <= index ) {
+    if ( not read_frame() ) {
+      return false;
+    }
+  }
+
+  return index >= first_buffered_;
+}
+
+/* bytes that can be read right away, whether from a pipe or a regular file */
+size_t IVFStream::bytes_available( void ) const
+{
+  int available = 0;
+  SystemCall( "ioctl", ioctl( fd_.fd_num(), FIONREAD, &available ) );
+  return available;
+}
+
+bool IVFStream::has_frame_now( const uint32_t index )
+{
+  while ( first_buffered_ + buffered_.size() <= index ) {
+    if ( end_of_stream_ ) {
+      return false;
+    }
+
+    /* the header can be read ahead, but the frame waits until all of it
+       has arrived, so that reading it doesn't block */
+    if ( next_frame_header_.empty() ) {
+      if ( bytes_available() < size_t( IVF::frame_header_len ) ) {
+        return false;
+      }
+
+      read_exactly( next_frame_header_, IVF::frame_header_len );
+    }
+
+    if ( bytes_available() < Chunk( next_frame_header_ ).le32() or not read_frame() ) {
+      return false;
+    }
+  }
+
+  return index >= first_buffered_;
+}
+
+Chunk IVFStream::frame( const uint32_t index ) const
+{
+  if ( index < first_buffered_ or index - first_buffered_ >= buffered_.size() ) {
+    throw out_of_range( "IVF frame is not buffered" );
+  }
+
+  return buffered_[ index - first_buffered_ ];
+}
+
+void IVFStream::release_before( const uint32_t index )
+{
+  while ( first_buffered_ < index and not buffered_.empty() ) {
+    spare_.push_back( move( buffered_.front() ) );
+    buffered_.pop_front();
+    first_buffered_++;
+  }
+}
+
+void IVFStream::seek( const uint32_t index, const uint64_t offset )
+{
+  if ( offset < uint64_t( IVF::supported_header_len + IVF::frame_header_len ) ) {
+    throw out_of_range( "IVF frame offset out of range" );
+  }
+
+  SystemCall( "lseek", lseek( fd_.fd_num(), offset - IVF::frame_header_len, SEEK_SET ) );
+
+  release_before( first_buffered_ + buffered_.size() );
+  first_buffered_ = index;
+  next_frame_header_.clear();
+  end_of_stream_ = false;
+}
@@ -0,0 +1,109 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* Copyright 2013-2018 the Alfalfa authors
+                       and the Massachusetts Institute of Technology
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+      1. Redistributions of source code must retain the above copyright
+         notice, this list of conditions and the following disclaimer.
+
+      2. Redistributions in binary form must reproduce the above copyright
+         notice, this list of conditions and the following disclaimer in the
+         documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#ifndef IVF_STREAM_HH
+#define IVF_STREAM_HH
+
+/* reads an IVF file front to back, so it works on pipes and on
+   files that are still being written. Only the frames that have
+   been read but not yet released are kept in memory. */
+
+#include <string>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "file_descriptor.hh"
+#include "chunk.hh"
+
+class IVFStream
+{
+private:
+  FileDescriptor fd_;
+
+  /* at the end of the file, how long to wait for it to grow (0 = not at all) */
+  unsigned int wait_ms_;
+
+  std::string header_ {};
+
+  std::string fourcc_ {};
+  uint16_t width_ {}, height_ {};
+  uint32_t frame_rate_ {}, time_scale_ {}, frame_count_ {};
+  uint32_t expected_decoder_minihash_ {};
+
+  /* frames [ first_buffered_, first_buffered_ + buffered_.size() ) */
+  std::deque<std::string> buffered_ {};
+  uint32_t first_buffered_ { 0 };
+  bool end_of_stream_ { false };
+
+  /* storage of released frames, to be reused */
+  std::vector<std::string> spare_ {};
+
+  /* the header of the next frame, if it was read before the frame itself */
+  std::string next_frame_header_ {};
+
+  bool read_exactly( std::string & output, const size_t length );
+  size_t bytes_available( void ) const;
+  bool read_frame( void );
+
+public:
+  IVFStream( FileDescriptor && fd, const unsigned int wait_ms = 0 );
+
+  /* "-" is standard input */
+  IVFStream( const std::string & filename, const unsigned int wait_ms = 0 );
+
+  const std::string & fourcc( void ) const { return fourcc_; }
+  uint16_t width( void ) const { return width_; }
+  uint16_t height( void ) const { return height_; }
+  uint32_t frame_rate( void ) const { return frame_rate_; }
+  uint32_t time_scale( void ) const { return time_scale_; }
+
+  /* as given in the header, which may not be up to date for a stream */
+  uint32_t frame_count( void ) const { return frame_count_; }
+
+  uint32_t expected_decoder_minihash() const { return expected_decoder_minihash_; }
+
+  /* reads up to the frame if necessary; false once the stream has ended before it */
+  bool has_frame( const uint32_t index );
+
+  /* same, but never waits: true only if the frame is buffered already or
+     all of it can be read without blocking */
+  bool has_frame_now( const uint32_t index );
+
+  /* a frame that has been read and not released */
+  Chunk frame( const uint32_t index ) const;
+
+  /* frames before this one will not be asked for again */
+  void release_before( const uint32_t index );
+
+  /* carry on reading at another frame, whose data starts at the given
+     offset (as in an IVFIndex); only works on regular files */
+  void seek( const uint32_t index, const uint64_t offset );
+};
+
+#endif /* IVF_STREAM_HH */
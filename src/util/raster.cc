@@ -26,12 +26,12 @@
    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
-#include <boost/functional/hash.hpp>
 #include <cstdio>
 
 #include "exception.hh"
 #include "raster.hh"
 #include "ssim.hh"
+#include "xxhash.hh"
 
 using namespace std;
 
@@ -49,13 +49,45 @@ BaseRaster::BaseRaster( const uint16_t display_width, const uint16_t display_hei
   }
 }
 
+/* rows first_row up to (not including) end_row of a plane, whose rows are contiguous */
+static uint64_t plane_rows_hash( const TwoD<uint8_t> & plane, const unsigned int first_row,
+                                 const unsigned int end_row, const uint64_t seed )
+{
+  const unsigned int last_row = min( end_row, plane.height() );
+  if ( first_row >= last_row ) {
+    return seed;
+  }
+
+  return xxhash64( &plane.at( 0, first_row ), plane.width() * ( last_row - first_row ), seed );
+}
+
+uint64_t BaseRaster::strip_hash( const unsigned int strip ) const
+{
+  uint64_t hash_val = plane_rows_hash( Y_, strip * 16, strip * 16 + 16, 0 );
+  hash_val = plane_rows_hash( U_, strip * 8, strip * 8 + 8, hash_val );
+  hash_val = plane_rows_hash( V_, strip * 8, strip * 8 + 8, hash_val );
+
+  return hash_val;
+}
+
+uint64_t BaseRaster::fold_strip_hash( const uint64_t hash, const uint64_t strip_hash )
+{
+  /* little-endian, so the result is the same on every machine */
+  uint8_t bytes[ 8 ];
+  for ( unsigned int i = 0; i < 8; i++ ) {
+    bytes[ i ] = strip_hash >> ( 8 * i );
+  }
+
+  return xxhash64( bytes, sizeof( bytes ), hash );
+}
+
 size_t BaseRaster::raw_hash( void ) const
 {
-  size_t hash_val = 0;
+  uint64_t hash_val = 0;
 
-  boost::hash_range( hash_val, Y_.begin(), Y_.end() );
-  boost::hash_range( hash_val, U_.begin(), U_.end() );
-  boost::hash_range( hash_val, V_.begin(), V_.end() );
+  for ( unsigned int strip = 0; strip < hash_strip_count(); strip++ ) {
+    hash_val = fold_strip_hash( hash_val, strip_hash( strip ) );
+  }
 
   return hash_val;
 }
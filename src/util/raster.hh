@@ -55,8 +55,13 @@ protected:
     U_ { width_ / 2, height_ / 2 },
     V_ { width_ / 2, height_ / 2 };
 
+  /* hashes every strip, in order */
   size_t raw_hash( void ) const;
 
+  /* the raster's hash is built up from the hashes of its strips of 16 luma
+     rows (and the 8 rows of each chroma plane beside them), one at a time */
+  static uint64_t fold_strip_hash( const uint64_t hash, const uint64_t strip_hash );
+
 public:
   BaseRaster( const uint16_t display_width, const uint16_t display_height,
     const uint16_t width, const uint16_t height );
@@ -74,6 +79,9 @@ public:
   uint16_t display_width( void ) const { return display_width_; }
   uint16_t display_height( void ) const { return display_height_; }
 
+  unsigned int hash_strip_count( void ) const { return ( height_ + 15 ) / 16; }
+  uint64_t strip_hash( const unsigned int strip ) const;
+
   uint16_t chroma_display_width() const { return (1 + display_width_) / 2; }
   uint16_t chroma_display_height() const { return (1 + display_height_) / 2; }
 
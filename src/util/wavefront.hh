@@ -0,0 +1,139 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* Copyright 2013-2018 the Alfalfa authors
+                       and the Massachusetts Institute of Technology
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+      1. Redistributions of source code must retain the above copyright
+         notice, this list of conditions and the following disclaimer.
+
+      2. Redistributions in binary form must reproduce the above copyright
+         notice, this list of conditions and the following disclaimer in the
+         documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#ifndef WAVEFRONT_HH
+#define WAVEFRONT_HH
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Visits every cell of a width x height grid, calling f( column, row ).
+
+   Cell (column, row) is only started once cell (column + 1, row - 1) has
+   finished, which is everything a raster scan guarantees about the left,
+   above-left, above and above-right neighbours. Rows are dealt round-robin
+   to `threads` workers (the calling thread is one of them), so row r + 1
+   trails row r by two cells. With a single thread this is a raster scan.
+
+   Once a row is finished, row_done( row ) is called by the worker that
+   produced it. These calls are made in row order and never overlap, so
+   row_done( r ) may rely on row_done( r - 1 ) having returned. */
+
+template <class lambda, class row_lambda>
+void wavefront_forall_ij( const unsigned int width, const unsigned int height,
+                          const unsigned int threads, const lambda & f,
+                          const row_lambda & row_done )
+{
+  if ( threads <= 1 or height <= 1 ) {
+    for ( unsigned int row = 0; row < height; row++ ) {
+      for ( unsigned int column = 0; column < width; column++ ) {
+        f( column, row );
+      }
+      row_done( row );
+    }
+    return;
+  }
+
+  const unsigned int worker_count = std::min( threads, height );
+
+  /* number of finished cells in each row */
+  std::vector<std::atomic<unsigned int>> progress( height );
+
+  /* number of rows that have been passed to row_done */
+  std::atomic<unsigned int> rows_done { 0 };
+
+  std::atomic<bool> abort { false };
+  std::mutex error_mutex;
+  std::exception_ptr error;
+
+  auto worker = [&]( const unsigned int first_row )
+    {
+      try {
+        for ( unsigned int row = first_row; row < height; row += worker_count ) {
+          for ( unsigned int column = 0; column < width; column++ ) {
+            if ( row > 0 ) {
+              const unsigned int needed = std::min( column + 2, width );
+              while ( progress[ row - 1 ].load( std::memory_order_acquire ) < needed ) {
+                if ( abort.load( std::memory_order_relaxed ) ) {
+                  return;
+                }
+                std::this_thread::yield();
+              }
+            }
+
+            f( column, row );
+            progress[ row ].store( column + 1, std::memory_order_release );
+          }
+
+          while ( rows_done.load( std::memory_order_acquire ) < row ) {
+            if ( abort.load( std::memory_order_relaxed ) ) {
+              return;
+            }
+            std::this_thread::yield();
+          }
+
+          row_done( row );
+          rows_done.store( row + 1, std::memory_order_release );
+        }
+      } catch ( ... ) {
+        std::lock_guard<std::mutex> lock( error_mutex );
+        if ( not error ) {
+          error = std::current_exception();
+        }
+        abort = true;
+      }
+    };
+
+  std::vector<std::thread> helpers;
+  for ( unsigned int i = 1; i < worker_count; i++ ) {
+    helpers.emplace_back( worker, i );
+  }
+
+  worker( 0 );
+
+  for ( auto & helper : helpers ) {
+    helper.join();
+  }
+
+  if ( error ) {
+    std::rethrow_exception( error );
+  }
+}
+
+template <class lambda>
+void wavefront_forall_ij( const unsigned int width, const unsigned int height,
+                          const unsigned int threads, const lambda & f )
+{
+  wavefront_forall_ij( width, height, threads, f, []( const unsigned int ) {} );
+}
+
+#endif /* WAVEFRONT_HH */
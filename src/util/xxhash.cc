@@ -0,0 +1,132 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* Copyright 2013-2018 the Alfalfa authors
+                       and the Massachusetts Institute of Technology
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+      1. Redistributions of source code must retain the above copyright
+         notice, this list of conditions and the following disclaimer.
+
+      2. Redistributions in binary form must reproduce the above copyright
+         notice, this list of conditions and the following disclaimer in the
+         documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+#include <cstring>
+
+#include "xxhash.hh"
+
+static constexpr uint64_t PRIME1 = 11400714785074694791ULL;
+static constexpr uint64_t PRIME2 = 14029467366897019727ULL;
+static constexpr uint64_t PRIME3 = 1609587929392839161ULL;
+static constexpr uint64_t PRIME4 = 9650029242287828579ULL;
+static constexpr uint64_t PRIME5 = 2870177450012600261ULL;
+
+static inline uint64_t rotl( const uint64_t x, const unsigned int r )
+{
+  return ( x << r ) | ( x >> ( 64 - r ) );
+}
+
+/* the input is read as little-endian on every machine */
+static inline uint64_t read64( const uint8_t * p )
+{
+  uint64_t val;
+  memcpy( &val, p, sizeof( val ) );
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  val = __builtin_bswap64( val );
+#endif
+  return val;
+}
+
+static inline uint32_t read32( const uint8_t * p )
+{
+  uint32_t val;
+  memcpy( &val, p, sizeof( val ) );
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  val = __builtin_bswap32( val );
+#endif
+  return val;
+}
+
+static inline uint64_t lane_round( uint64_t acc, const uint64_t input )
+{
+  acc += input * PRIME2;
+  acc = rotl( acc, 31 );
+  return acc * PRIME1;
+}
+
+static inline uint64_t merge_round( uint64_t acc, const uint64_t val )
+{
+  acc ^= lane_round( 0, val );
+  return acc * PRIME1 + PRIME4;
+}
+
+uint64_t xxhash64( const uint8_t * data, const size_t length, const uint64_t seed )
+{
+  const uint8_t * const end = data + length;
+  uint64_t hash;
+
+  if ( length >= 32 ) {
+    /* four independent lanes, 32 bytes per iteration */
+    uint64_t v1 = seed + PRIME1 + PRIME2;
+    uint64_t v2 = seed + PRIME2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - PRIME1;
+
+    const uint8_t * const limit = end - 32;
+    do {
+      v1 = lane_round( v1, read64( data ) );
+      v2 = lane_round( v2, read64( data + 8 ) );
+      v3 = lane_round( v3, read64( data + 16 ) );
+      v4 = lane_round( v4, read64( data + 24 ) );
+      data += 32;
+    } while ( data <= limit );
+
+    hash = rotl( v1, 1 ) + rotl( v2, 7 ) + rotl( v3, 12 ) + rotl( v4, 18 );
+    hash = merge_round( hash, v1 );
+    hash = merge_round( hash, v2 );
+    hash = merge_round( hash, v3 );
+    hash = merge_round( hash, v4 );
+  } else {
+    hash = seed + PRIME5;
+  }
+
+  hash += length;
+
+  for ( ; data + 8 <= end; data += 8 ) {
+    hash ^= lane_round( 0, read64( data ) );
+    hash = rotl( hash, 27 ) * PRIME1 + PRIME4;
+  }
+
+  if ( data + 4 <= end ) {
+    hash ^= uint64_t( read32( data ) ) * PRIME1;
+    hash = rotl( hash, 23 ) * PRIME2 + PRIME3;
+    data += 4;
+  }
+
+  for ( ; data < end; data++ ) {
+    hash ^= *data * PRIME5;
+    hash = rotl( hash, 11 ) * PRIME1;
+  }
+
+  hash ^= hash >> 33;
+  hash *= PRIME2;
+  hash ^= hash >> 29;
+  hash *= PRIME3;
+  hash ^= hash >> 32;
+
+  return hash;
+}